@@ -34,12 +34,14 @@
 #include "ringct/rctOps.h"
 
 #include "lmdb/db_lmdb.h"
+#include "memory/db_memory.h"
 #ifdef BERKELEY_DB
 #include "berkeleydb/db_bdb.h"
 #endif
 
 static const char *db_types[] = {
   "lmdb",
+  "memory",
 #ifdef BERKELEY_DB
   "berkeley",
 #endif
@@ -94,11 +96,23 @@ const command_line::arg_descriptor<bool> arg_db_salvage  = {
 , "Try to salvage a blockchain database if it seems corrupted"
 , false
 };
+const command_line::arg_descriptor<bool> arg_db_prune  = {
+  "prune-blockchain"
+, "Drop the prunable data of transactions not near the tip, except for one stripe of blocks"
+, false
+};
+const command_line::arg_descriptor<bool> arg_db_read_only_replica  = {
+  "db-read-only-replica"
+, "Serve RPC from the database of another daemon running on the same data directory, without p2p or writes"
+, false
+};
 
 BlockchainDB *new_db(const std::string& db_type)
 {
   if (db_type == "lmdb")
     return new BlockchainLMDB();
+  if (db_type == "memory")
+    return new BlockchainMemory();
 #if defined(BERKELEY_DB)
   if (db_type == "berkeley")
     return new BlockchainBDB();
@@ -106,11 +120,25 @@ BlockchainDB *new_db(const std::string& db_type)
   return NULL;
 }
 
+uint32_t get_pruning_stripe(uint64_t block_height)
+{
+  return (block_height / CRYPTONOTE_PRUNING_STRIPE_SIZE) % CRYPTONOTE_PRUNING_STRIPES + 1;
+}
+
+bool has_unpruned_block(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_seed)
+{
+  if (!pruning_seed || block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS >= blockchain_height)
+    return true;
+  return get_pruning_stripe(block_height) == pruning_seed;
+}
+
 void BlockchainDB::init_options(boost::program_options::options_description& desc)
 {
   command_line::add_arg(desc, arg_db_type);
   command_line::add_arg(desc, arg_db_sync_mode);
   command_line::add_arg(desc, arg_db_salvage);
+  command_line::add_arg(desc, arg_db_prune);
+  command_line::add_arg(desc, arg_db_read_only_replica);
 }
 
 void BlockchainDB::pop_block()
@@ -252,6 +280,26 @@ void BlockchainDB::pop_block(block& blk, std::vector<transaction>& txs)
   remove_transaction(get_transaction_hash(blk.miner_tx));
 }
 
+void BlockchainDB::pop_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs)
+{
+  if (nblocks > height())
+    throw BLOCK_DNE("Attempting to pop more blocks than there are in the db");
+
+  blocks.clear();
+  txs.clear();
+
+  // pop_block returns the txes of each block newest first, so the whole
+  // list is in reverse chain order once all blocks are popped
+  for (uint64_t i = 0; i < nblocks; ++i)
+  {
+    block blk;
+    pop_block(blk, txs);
+    blocks.push_back(blk);
+  }
+  std::reverse(blocks.begin(), blocks.end());
+  std::reverse(txs.begin(), txs.end());
+}
+
 bool BlockchainDB::is_open() const
 {
   return m_open;
@@ -297,7 +345,17 @@ bool BlockchainDB::get_tx(const crypto::hash& h, cryptonote::transaction &tx) co
 {
   blobdata bd;
   if (!get_tx_blob(h, bd))
-    return false;
+  {
+    // a pruned tx still has its prefix, which is what is needed internally
+    if (!get_pruned_tx_blob(h, bd))
+      return false;
+    if (!parse_and_validate_tx_base_from_blob(bd, tx))
+      throw new DB_ERROR("Failed to parse pruned transaction from blob retrieved from the db");
+    // the hash cannot be computed without the prunable data
+    tx.hash = h;
+    tx.set_hash_valid(true);
+    return true;
+  }
   if (!parse_and_validate_tx_from_blob(bd, tx))
     throw new DB_ERROR("Failed to parse transaction from blob retrieved from the db");
 
@@ -106,6 +106,8 @@ typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 extern const command_line::arg_descriptor<std::string> arg_db_type;
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<bool, false> arg_db_prune;
+extern const command_line::arg_descriptor<bool, false> arg_db_read_only_replica;
 
 #pragma pack(push, 1)
 
@@ -130,6 +132,16 @@ struct tx_data_t
 };
 #pragma pack(pop)
 
+/**
+ * @brief how much of each object the parallel iteration functions read
+ */
+enum iteration_detail
+{
+  iterate_keys,   //!< only what the indices have, no blobs are read
+  iterate_blobs,  //!< the stored blobs as well, without parsing them
+  iterate_parsed  //!< the blobs, and the objects parsed from them
+};
+
 /**
  * @brief a struct containing txpool per transaction metadata
  */
@@ -531,6 +543,7 @@ protected:
   mutable uint64_t time_tx_exists = 0;  //!< a performance metric
   uint64_t time_commit1 = 0;  //!< a performance metric
   bool m_auto_remove_logs = true;  //!< whether or not to automatically remove old logs
+  uint64_t m_pruning_tip_blocks = CRYPTONOTE_PRUNING_TIP_BLOCKS;  //!< blocks at the tip a pruned database keeps in full
 
   HardFork* m_hardfork;
 
@@ -1045,6 +1058,27 @@ public:
    */
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
 
+  /**
+   * @brief pops the given number of blocks off the top of the blockchain
+   *
+   * This removes the same data as calling pop_block repeatedly, but the
+   * subclass may do it in one write transaction and remove whole key ranges
+   * at once rather than looking each entry up.  The default implementation
+   * calls pop_block for each block.
+   *
+   * The popped blocks and their transactions (without the miner
+   * transactions) are returned in chain order, oldest first.  Transactions
+   * which are pruned in the database cannot be returned in full, and are
+   * left out.
+   *
+   * If any of the blocks cannot be removed, an exception is thrown.
+   *
+   * @param nblocks the number of blocks to pop
+   * @param blocks return-by-reference the blocks which were popped
+   * @param txs return-by-reference the transactions from the popped blocks
+   */
+  virtual void pop_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs);
+
 
   /**
    * @brief check if a transaction with a given hash exists
@@ -1105,7 +1139,8 @@ public:
    * The subclass should return the transaction stored which has the given
    * hash.
    *
-   * If the transaction does not exist, the subclass should return false.
+   * If the transaction does not exist, or its prunable data was pruned,
+   * the subclass should return false.
    *
    * @param h the hash to look for
    *
@@ -1113,6 +1148,20 @@ public:
    */
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
 
+  /**
+   * @brief fetches the unprunable part of the transaction blob with the given hash
+   *
+   * This is the transaction prefix and, for RingCT transactions, the RingCT
+   * signature base. It is available whether or not the transaction was pruned.
+   *
+   * If the transaction does not exist, the subclass should return false.
+   *
+   * @param h the hash to look for
+   *
+   * @return true iff the transaction was found
+   */
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
+
   /**
    * @brief fetches the total number of transactions ever
    *
@@ -1356,6 +1405,20 @@ public:
    */
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const = 0;
 
+  /**
+   * @brief get the key images a txpool transaction spends
+   *
+   * They are stored when the transaction is added, so the pool can be
+   * indexed without parsing the transactions.
+   *
+   * @param txid the transaction id of the transation to lookup
+   * @param key_images return-by-reference the key images, in input order
+   *
+   * @return false if the key images were not stored, eg for a transaction
+   *         added by an older version, otherwise true
+   */
+  virtual bool get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const = 0;
+
   /**
    * @brief runs a function over all txpool transactions
    *
@@ -1443,6 +1506,72 @@ public:
    */
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const = 0;
 
+  /**
+   * @brief runs a function over a range of blocks, on several threads
+   *
+   * Like for_blocks_range, but the range is split into shards of
+   * consecutive heights, which are run on several threads, each reading
+   * through its own read transaction.  The function is called concurrently,
+   * in height order within a shard but in no particular order overall, and
+   * must be safe to call that way.  Each thread reads its own snapshot of
+   * the database, so a consistent view needs the database to be left alone
+   * by writers meanwhile.
+   *
+   * The function is passed (block_height, block_hash, blob, block).  The
+   * blob is NULL unless detail asks for blobs, and the block is NULL unless
+   * detail asks for parsed objects.
+   *
+   * If any call to the function returns false, the other threads stop soon
+   * after, and false is returned.  An exception thrown by the function, or
+   * while reading, is rethrown on the calling thread.
+   *
+   * @param h1 the start height
+   * @param h2 the end height, included
+   * @param f the function to run
+   * @param detail how much of each block to read
+   * @param num_threads the number of threads to use, or 0 for one per core
+   *
+   * @return false if the function returns false for any block, otherwise true
+   */
+  virtual bool for_blocks_range_parallel(uint64_t h1, uint64_t h2, std::function<bool(uint64_t height, const crypto::hash &hash, const cryptonote::blobdata *blob, const cryptonote::block *blk)> f, iteration_detail detail, unsigned num_threads = 0) const = 0;
+
+  /**
+   * @brief runs a function over all transactions stored, on several threads
+   *
+   * Like for_all_transactions, but the transactions are visited by block,
+   * with the blocks split into shards as for for_blocks_range_parallel, and
+   * the same concurrency rules apply.  Miner transactions are included.
+   *
+   * The function is passed (block_height, transaction_hash, blob,
+   * transaction).  The blob is NULL unless detail asks for blobs, and the
+   * transaction is NULL unless detail asks for parsed objects.  For a pruned
+   * transaction, the blob and transaction only have its unprunable part.
+   *
+   * @param f the function to run
+   * @param detail how much of each transaction to read
+   * @param num_threads the number of threads to use, or 0 for one per core
+   *
+   * @return false if the function returns false for any transaction, otherwise true
+   */
+  virtual bool for_all_transactions_parallel(std::function<bool(uint64_t height, const crypto::hash &tx_hash, const cryptonote::blobdata *blob, const cryptonote::transaction *tx)> f, iteration_detail detail, unsigned num_threads = 0) const = 0;
+
+  /**
+   * @brief runs a function over all outputs stored, on several threads
+   *
+   * Like for_all_outputs, but passing what the output index has for each
+   * output, without looking up its transaction: (amount, amount_index,
+   * global_index, output data).  The commitment in the output data may be
+   * left zero for pre-RingCT outputs.  The outputs of each amount are split into
+   * shards, and the same concurrency rules as for for_blocks_range_parallel
+   * apply.
+   *
+   * @param f the function to run
+   * @param num_threads the number of threads to use, or 0 for one per core
+   *
+   * @return false if the function returns false for any output, otherwise true
+   */
+  virtual bool for_all_outputs_parallel(std::function<bool(uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data)> f, unsigned num_threads = 0) const = 0;
+
 
   //
   // Hard fork related storage
@@ -1493,6 +1622,62 @@ public:
    */
   virtual bool is_read_only() const = 0;
 
+  /**
+   * @brief get the pruning seed of the database
+   *
+   * A pruned database drops the prunable data of transactions in blocks
+   * more than CRYPTONOTE_PRUNING_TIP_BLOCKS deep (see set_pruning_tip_blocks), except for those in the
+   * pruning stripe given by its seed.
+   *
+   * @return 0 if the database is not pruned, its pruning stripe otherwise
+   */
+  virtual uint32_t get_pruning_seed() const = 0;
+
+  /**
+   * @brief prune the database, and keep it pruned as blocks are added
+   *
+   * If the database is already pruned, this only checks the seed matches.
+   *
+   * @param pruning_seed the stripe to keep in full, or 0 to pick one at random
+   *
+   * @return true if the database is pruned with that seed
+   */
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0) = 0;
+
+  /**
+   * @brief whether the stored block and transaction blobs are compressed
+   *
+   * @return true if blobs added to the database are compressed
+   */
+  virtual bool get_blob_compression() const = 0;
+
+  /**
+   * @brief compress the stored block and transaction blobs, or stop doing so
+   *
+   * Compression is transparent to readers. Enabling it rewrites the stored
+   * blobs compressed, and compresses the blobs added later. Disabling it
+   * rewrites them uncompressed. Either way, this goes over the whole
+   * database, and is meant to be run offline.
+   *
+   * @param enable whether to compress
+   *
+   * @return false if the database does not support compression
+   */
+  virtual bool set_blob_compression(bool enable) = 0;
+
+  /**
+   * @brief write a compacted copy of the database
+   *
+   * Pruning and compression free space inside the database, which later
+   * writes reuse, but which is not given back to the filesystem. The copy
+   * leaves it out, and can replace the database files once it is closed.
+   *
+   * @param folder an existing, empty folder to write the copy's files to
+   *
+   * @return false if the database does not support compaction
+   */
+  virtual bool copy_compacted(const std::string &folder) = 0;
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -1510,6 +1695,16 @@ public:
    */
   void set_auto_remove_logs(bool auto_remove) { m_auto_remove_logs = auto_remove; }
 
+  /**
+   * @brief set how many blocks at the tip a pruned database keeps in full
+   *
+   * This is CRYPTONOTE_PRUNING_TIP_BLOCKS unless changed, and is meant to
+   * be lowered by tests only, as peers expect that many to be available.
+   *
+   * @param blocks the number of blocks
+   */
+  void set_pruning_tip_blocks(uint64_t blocks) { m_pruning_tip_blocks = blocks; }
+
   bool m_open;  //!< Whether or not the BlockchainDB is open/ready for use
   mutable epee::critical_section m_synchronization_lock;  //!< A lock, currently for when BlockchainLMDB needs to resize the backing db file
 
@@ -1517,6 +1712,26 @@ public:
 
 BlockchainDB *new_db(const std::string& db_type);
 
+/**
+ * @brief get the pruning stripe a block belongs to
+ *
+ * @param block_height the height of the block
+ *
+ * @return the stripe, from 1 to CRYPTONOTE_PRUNING_STRIPES
+ */
+uint32_t get_pruning_stripe(uint64_t block_height);
+
+/**
+ * @brief whether a database has the txes of a block in full
+ *
+ * @param block_height the height of the block
+ * @param blockchain_height the height of the database's chain
+ * @param pruning_seed the database's pruning seed, 0 if not pruned
+ *
+ * @return true if the block is near the tip or in the stripe kept in full
+ */
+bool has_unpruned_block(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_seed);
+
 }  // namespace cryptonote
 
 #endif  // BLOCKCHAIN_DB_H
@@ -0,0 +1,277 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "blob_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "common/varint.h"
+
+namespace
+{
+
+const unsigned char COMPRESSED_BLOB_MARKER = 0xff;
+
+// sanity limit on the size of a decompressed blob, far above any real one
+const uint64_t MAX_BLOB_SIZE = 100 * 1024 * 1024;
+
+// length of the byte strings counted when training a dictionary
+const size_t GRAM_SIZE = 8;
+
+uint64_t get_gram(const std::string &s, size_t pos)
+{
+  uint64_t gram;
+  memcpy(&gram, s.data() + pos, sizeof(gram));
+  return gram;
+}
+
+}  // anonymous namespace
+
+namespace cryptonote
+{
+
+const size_t blob_compressor::MAX_DICTIONARY_SIZE;
+
+// the streams of a thread, set up on first use. Setting up a deflate stream
+// allocates and clears a few hundred kB, which would otherwise be done for
+// each blob. A reset drops the dictionary, which is then set again.
+struct blob_compressor::zlib_streams
+{
+#ifdef HAVE_ZLIB
+  z_stream deflate_stream;
+  z_stream inflate_stream;
+  bool deflate_ready = false;
+  bool inflate_ready = false;
+
+  ~zlib_streams()
+  {
+    if (deflate_ready)
+      deflateEnd(&deflate_stream);
+    if (inflate_ready)
+      inflateEnd(&inflate_stream);
+  }
+#endif
+};
+
+// out of line, where zlib_streams is complete
+blob_compressor::blob_compressor()
+{
+}
+
+blob_compressor::~blob_compressor()
+{
+}
+
+bool blob_compressor::available()
+{
+#ifdef HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string blob_compressor::train_dictionary(const std::vector<std::string> &samples, size_t max_size)
+{
+  static_assert(GRAM_SIZE == sizeof(uint64_t), "Byte strings are counted as uint64_t");
+
+  // the number of samples each byte string appears in
+  std::unordered_map<uint64_t, uint32_t> counts;
+  for (const std::string &sample: samples)
+  {
+    std::unordered_set<uint64_t> seen;
+    for (size_t pos = 0; pos + GRAM_SIZE <= sample.size(); ++pos)
+    {
+      const uint64_t gram = get_gram(sample, pos);
+      if (seen.insert(gram).second)
+        ++counts[gram];
+    }
+  }
+
+  // keys, signatures and the like are unique to each blob, so the common
+  // byte strings are the structure shared between blobs. Runs of them are
+  // kept as segments, scored by how common they are.
+  const uint32_t threshold = std::max<uint32_t>(2, samples.size() / 100);
+  std::map<std::string, uint64_t> segments;
+  for (const std::string &sample: samples)
+  {
+    size_t pos = 0;
+    while (pos + GRAM_SIZE <= sample.size())
+    {
+      if (counts[get_gram(sample, pos)] < threshold)
+      {
+        ++pos;
+        continue;
+      }
+      const size_t start = pos;
+      uint64_t score = 0;
+      while (pos + GRAM_SIZE <= sample.size())
+      {
+        const uint32_t count = counts[get_gram(sample, pos)];
+        if (count < threshold)
+          break;
+        score += count;
+        ++pos;
+      }
+      uint64_t &best = segments[sample.substr(start, pos - start + GRAM_SIZE - 1)];
+      best = std::max(best, score);
+    }
+  }
+
+  std::vector<std::pair<uint64_t, const std::string*>> ranked;
+  ranked.reserve(segments.size());
+  for (const auto &segment: segments)
+    ranked.push_back(std::make_pair(segment.second, &segment.first));
+  std::sort(ranked.begin(), ranked.end(), [](const std::pair<uint64_t, const std::string*> &a, const std::pair<uint64_t, const std::string*> &b) {
+    return a.first > b.first || (a.first == b.first && *a.second < *b.second);
+  });
+
+  std::vector<const std::string*> chosen;
+  size_t size = 0;
+  for (const auto &r: ranked)
+  {
+    if (size + r.second->size() > max_size)
+      continue;
+    chosen.push_back(r.second);
+    size += r.second->size();
+  }
+
+  // deflate codes closer matches with fewer bits, so the best segments go last
+  std::string dictionary;
+  dictionary.reserve(size);
+  for (auto i = chosen.rbegin(); i != chosen.rend(); ++i)
+    dictionary += **i;
+  return dictionary;
+}
+
+bool blob_compressor::is_compressed(const void *data, size_t size)
+{
+  return size > 0 && *(const unsigned char*)data == COMPRESSED_BLOB_MARKER;
+}
+
+bool blob_compressor::compress(const void *data, size_t size, std::string &out) const
+{
+#ifdef HAVE_ZLIB
+  if (!enabled())
+    return false;
+
+  if (!m_streams.get())
+    m_streams.reset(new zlib_streams());
+  z_stream &zs = m_streams->deflate_stream;
+  if (m_streams->deflate_ready)
+  {
+    if (deflateReset(&zs) != Z_OK)
+      return false;
+  }
+  else
+  {
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    m_streams->deflate_ready = true;
+  }
+  if (deflateSetDictionary(&zs, (const Bytef*)m_dictionary.data(), m_dictionary.size()) != Z_OK)
+    return false;
+
+  out.clear();
+  out.push_back(COMPRESSED_BLOB_MARKER);
+  tools::write_varint(std::back_inserter(out), (uint64_t)size);
+  const size_t header_size = out.size();
+  out.resize(header_size + deflateBound(&zs, size));
+
+  zs.next_in = (Bytef*)data;
+  zs.avail_in = size;
+  zs.next_out = (Bytef*)&out[header_size];
+  zs.avail_out = out.size() - header_size;
+  const int result = deflate(&zs, Z_FINISH);
+  const size_t compressed_size = zs.total_out;
+  if (result != Z_STREAM_END)
+    return false;
+
+  out.resize(header_size + compressed_size);
+  return out.size() < size;
+#else
+  return false;
+#endif
+}
+
+bool blob_compressor::decompress(const void *data, size_t size, std::string &out) const
+{
+#ifdef HAVE_ZLIB
+  if (!is_compressed(data, size))
+    return false;
+
+  const unsigned char *p = (const unsigned char*)data + 1;
+  const unsigned char *end = (const unsigned char*)data + size;
+  uint64_t raw_size;
+  const int read = tools::read_varint((const unsigned char*)p, (const unsigned char*)end, raw_size);
+  if (read <= 0 || raw_size > MAX_BLOB_SIZE)
+    return false;
+  p += read;
+
+  if (!m_streams.get())
+    m_streams.reset(new zlib_streams());
+  z_stream &zs = m_streams->inflate_stream;
+  if (m_streams->inflate_ready)
+  {
+    if (inflateReset(&zs) != Z_OK)
+      return false;
+  }
+  else
+  {
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+      return false;
+    m_streams->inflate_ready = true;
+  }
+  if (inflateSetDictionary(&zs, (const Bytef*)m_dictionary.data(), m_dictionary.size()) != Z_OK)
+    return false;
+
+  out.resize(raw_size);
+  zs.next_in = (Bytef*)p;
+  zs.avail_in = end - p;
+  zs.next_out = (Bytef*)&out[0];
+  zs.avail_out = raw_size;
+  const int result = inflate(&zs, Z_FINISH);
+  const uint64_t decompressed_size = zs.total_out;
+  return result == Z_STREAM_END && decompressed_size == raw_size;
+#else
+  return false;
+#endif
+}
+
+}  // namespace cryptonote
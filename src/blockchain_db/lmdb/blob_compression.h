@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/thread/tss.hpp>
+
+namespace cryptonote
+{
+
+/**
+ * @brief Compresses the block and tx blobs stored in the LMDB
+ *
+ * Blobs are compressed one at a time with raw deflate, primed with a preset
+ * dictionary trained on a sample of the stored blobs. Single blobs are too
+ * short for deflate to find much on its own, but share a lot of structure
+ * (field tags, varints, extra fields) with each other.
+ *
+ * A compressed blob starts with a marker byte, followed by the varint size
+ * of the original blob and the deflate stream. Block and tx blobs start
+ * with a small version varint, so they never start with the marker, and
+ * compressed and uncompressed blobs can be stored side by side. A blob is
+ * left uncompressed when compressing does not make it smaller.
+ *
+ * Needs zlib, without which nothing can be compressed, and compressed blobs
+ * can't be read back.
+ *
+ * Each thread keeps its zlib streams, which are reset between blobs rather
+ * than set up from scratch.
+ */
+class blob_compressor
+{
+public:
+  static const size_t MAX_DICTIONARY_SIZE = 32768; // deflate's window size
+
+  blob_compressor();
+  ~blob_compressor();
+
+  /**
+   * @brief whether this build supports compression
+   */
+  static bool available();
+
+  /**
+   * @brief builds a dictionary from sample blobs
+   *
+   * Picks the byte strings shared by the most samples, with the most common
+   * ones last, where deflate finds them the cheapest.
+   */
+  static std::string train_dictionary(const std::vector<std::string> &samples, size_t max_size = MAX_DICTIONARY_SIZE);
+
+  /**
+   * @brief whether a stored blob is compressed
+   */
+  static bool is_compressed(const void *data, size_t size);
+
+  void set_dictionary(const std::string &dictionary) { m_dictionary = dictionary; }
+  const std::string &get_dictionary() const { return m_dictionary; }
+
+  /**
+   * @brief whether a dictionary is set, which is needed to compress
+   */
+  bool enabled() const { return !m_dictionary.empty(); }
+
+  /**
+   * @brief compresses a blob
+   *
+   * @return false if the blob is not worth compressing, or compression is not available
+   */
+  bool compress(const void *data, size_t size, std::string &out) const;
+
+  /**
+   * @brief decompresses a blob for which is_compressed is true
+   *
+   * @return false if the blob is corrupt, or compression is not available
+   */
+  bool decompress(const void *data, size_t size, std::string &out) const;
+
+private:
+  struct zlib_streams;
+
+  std::string m_dictionary;
+  mutable boost::thread_specific_ptr<zlib_streams> m_streams;
+};
+
+}  // namespace cryptonote
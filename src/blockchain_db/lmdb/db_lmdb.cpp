@@ -33,7 +33,11 @@
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
 #include <random>
+#include <atomic>
+#include <exception>
+#include <boost/thread/thread.hpp>
 
+#include "common/util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
 #include "profile_tools.h"
@@ -172,6 +176,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  *
  * txpool_meta      txn hash     txn metadata
  * txpool_blob      txn hash     txn blob
+ * txpool_key_images txn hash    [key images spent by the txn]
  *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
@@ -195,6 +200,7 @@ const char* const LMDB_SPENT_KEYS = "spent_keys";
 
 const char* const LMDB_TXPOOL_META = "txpool_meta";
 const char* const LMDB_TXPOOL_BLOB = "txpool_blob";
+const char* const LMDB_TXPOOL_KEY_IMAGES = "txpool_key_images";
 
 const char* const LMDB_HF_STARTING_HEIGHTS = "hf_starting_heights";
 const char* const LMDB_HF_VERSIONS = "hf_versions";
@@ -204,6 +210,55 @@ const char* const LMDB_PROPERTIES = "properties";
 const char zerokey[8] = {0};
 const MDB_val zerokval = { sizeof(zerokey), (void *)zerokey };
 
+// the parallel iteration functions hand out work in shards of this size
+const uint64_t ITERATION_BLOCKS_PER_SHARD = 1000;
+const uint64_t ITERATION_OUTPUTS_PER_SHARD = 50000;
+
+// Runs f for each of num_shards shards, on num_threads threads (0 for one
+// per core), until f returns false for one of them. Threads started here
+// read through their own LMDB read txns. The first exception thrown by f is
+// rethrown on the calling thread.
+bool run_shards(uint64_t num_shards, unsigned num_threads, const std::function<bool(uint64_t shard, const std::atomic<bool> &stop)> &f)
+{
+  if (num_threads == 0)
+    num_threads = tools::get_max_concurrency();
+  num_threads = std::max<uint64_t>(std::min<uint64_t>(num_threads, num_shards), 1);
+
+  std::atomic<uint64_t> next_shard(0);
+  std::atomic<bool> stop(false);
+  boost::mutex error_lock;
+  std::exception_ptr error;
+  auto work = [&]() {
+    try
+    {
+      uint64_t shard;
+      while (!stop && (shard = next_shard++) < num_shards)
+      {
+        if (!f(shard, stop))
+          stop = true;
+      }
+    }
+    catch (...)
+    {
+      boost::lock_guard<boost::mutex> lock(error_lock);
+      if (!error)
+        error = std::current_exception();
+      stop = true;
+    }
+  };
+
+  // the calling thread may have a write txn, which the others could not
+  // see into, so it only waits
+  boost::thread_group workers;
+  for (unsigned n = 0; n < num_threads; ++n)
+    workers.create_thread(work);
+  workers.join_all();
+
+  if (error)
+    std::rethrow_exception(error);
+  return !stop;
+}
+
 const std::string lmdb_error(const std::string& error_string, int mdb_res)
 {
   const std::string full_string = error_string + mdb_strerror(mdb_res);
@@ -477,29 +532,35 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  // a batch txn keeps what it has added so far, and goes on in a new txn
+  // once the map is resized
+  const bool resume_batch = m_batch_active && m_write_batch_txn != nullptr && m_writer == boost::this_thread::get_id();
+  if (resume_batch)
+    batch_commit();
+
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
   {
-    if (m_batch_active)
-    {
-      throw0(DB_ERROR("lmdb resizing not yet supported when batch transactions enabled!"));
-    }
-    else
-    {
-      throw0(DB_ERROR("attempting resize with write transaction in progress, this should not happen!"));
-    }
+    mdb_txn_safe::allow_new_txns();
+    throw0(DB_ERROR("attempting resize with write transaction in progress, this should not happen!"));
   }
 
   mdb_txn_safe::wait_no_active_txns();
 
   int result = mdb_env_set_mapsize(m_env, new_mapsize);
   if (result)
+  {
+    mdb_txn_safe::allow_new_txns();
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
+  }
 
   MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
 
   mdb_txn_safe::allow_new_txns();
+
+  if (resume_batch)
+    batch_txn_begin();
 }
 
 // threshold_size is used for batch transactions
@@ -554,102 +615,39 @@ bool BlockchainLMDB::need_resize(uint64_t threshold_size) const
 #endif
 }
 
-void BlockchainLMDB::check_and_resize_for_batch(uint64_t batch_num_blocks)
+// Batch transactions only commit at the end, so the map has to hold all the
+// data they add. Rather than estimating that for the whole batch up front,
+// each block is checked as it comes, and if it might not fit, the batch is
+// committed and resumed around a resize.
+void BlockchainLMDB::check_and_resize_for_batch(uint64_t block_size)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  LOG_PRINT_L1("[" << __func__ << "] " << "checking DB size");
+#if defined(ENABLE_AUTO_RESIZE)
+  // estimate of stored block expanded from raw block, including denormalization and db overhead,
+  // doubled as this probably doesn't grow linearly with block size.
+  const float db_expand_factor = 4.5f * 2;
+  // allow for at least 4k per block
+  const uint64_t min_block_size = 4 * 1024;
   const uint64_t min_increase_size = 512 * (1 << 20);
-  uint64_t threshold_size = 0;
-  uint64_t increase_size = 0;
-  if (batch_num_blocks > 0)
-  {
-    threshold_size = get_estimated_batch_size(batch_num_blocks);
-    LOG_PRINT_L1("calculated batch size: " << threshold_size);
-
-    // The increased DB size could be a multiple of threshold_size, a fixed
-    // size increase (> threshold_size), or other variations.
-    //
-    // Currently we use the greater of threshold size and a minimum size. The
-    // minimum size increase is used to avoid frequent resizes when the batch
-    // size is set to a very small numbers of blocks.
-    increase_size = (threshold_size > min_increase_size) ? threshold_size : min_increase_size;
-    LOG_PRINT_L1("increase size: " << increase_size);
-  }
-
-  // if threshold_size is 0 (i.e. number of blocks for batch not passed in), it
-  // will fall back to the percent-based threshold check instead of the
-  // size-based check
-  if (need_resize(threshold_size))
-  {
-    MGINFO("[batch] DB resize needed");
-    do_resize(increase_size);
-  }
-}
 
-uint64_t BlockchainLMDB::get_estimated_batch_size(uint64_t batch_num_blocks) const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  uint64_t threshold_size = 0;
+  const uint64_t needed = std::max(block_size, min_block_size) * db_expand_factor;
 
-  // batch size estimate * batch safety factor = final size estimate
-  // Takes into account "reasonable" block size increases in batch.
-  float batch_safety_factor = 1.7f;
-  float batch_fudge_factor = batch_safety_factor * batch_num_blocks;
-  // estimate of stored block expanded from raw block, including denormalization and db overhead.
-  // Note that this probably doesn't grow linearly with block size.
-  float db_expand_factor = 4.5f;
-  uint64_t num_prev_blocks = 500;
-  // For resizing purposes, allow for at least 4k average block size.
-  uint64_t min_block_size = 4 * 1024;
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  MDB_stat mst;
+  mdb_env_stat(m_env, &mst);
 
-  uint64_t block_stop = 0;
-  uint64_t m_height = height();
-  if (m_height > 1)
-    block_stop = m_height - 1;
-  uint64_t block_start = 0;
-  if (block_stop >= num_prev_blocks)
-    block_start = block_stop - num_prev_blocks + 1;
-  uint32_t num_blocks_used = 0;
-  uint64_t total_block_size = 0;
-  LOG_PRINT_L1("[" << __func__ << "] " << "m_height: " << m_height << "  block_start: " << block_start << "  block_stop: " << block_stop);
-  size_t avg_block_size = 0;
-  if (m_height == 0)
-  {
-    LOG_PRINT_L1("No existing blocks to check for average block size");
-  }
-  else if (m_cum_count >= num_prev_blocks)
-  {
-    avg_block_size = m_cum_size / m_cum_count;
-    LOG_PRINT_L1("average block size across recent " << m_cum_count << " blocks: " << avg_block_size);
-    m_cum_size = 0;
-    m_cum_count = 0;
-  }
-  else
+  // the env info only reflects committed data, so the space used by the
+  // batch so far has to be accounted for separately
+  const uint64_t size_used = mst.ms_psize * mei.me_last_pgno + m_batch_size_estimate;
+  if (size_used + needed > mei.me_mapsize)
   {
-    MDB_txn *rtxn;
-    mdb_txn_cursors *rcurs;
-    block_rtxn_start(&rtxn, &rcurs);
-    for (uint64_t block_num = block_start; block_num <= block_stop; ++block_num)
-    {
-      uint32_t block_size = get_block_size(block_num);
-      total_block_size += block_size;
-      // Track number of blocks being totalled here instead of assuming, in case
-      // some blocks were to be skipped for being outliers.
-      ++num_blocks_used;
-    }
-    block_rtxn_stop();
-    avg_block_size = total_block_size / num_blocks_used;
-    LOG_PRINT_L1("average block size across recent " << num_blocks_used << " blocks: " << avg_block_size);
+    const uint64_t increase_size = std::max(min_increase_size, 2 * (m_batch_size_estimate + needed));
+    MGINFO("[batch] DB resize needed, " << m_batch_size_estimate / (1024 * 1024) << " MiB estimated in the current batch");
+    do_resize(increase_size);
   }
-  if (avg_block_size < min_block_size)
-    avg_block_size = min_block_size;
-  LOG_PRINT_L1("estimated average block size for batch: " << avg_block_size);
-
-  // bigger safety margin on smaller block sizes
-  if (batch_fudge_factor < 5000.0)
-    batch_fudge_factor = 5000.0;
-  threshold_size = avg_block_size * db_expand_factor * batch_fudge_factor;
-  return threshold_size;
+  m_batch_size_estimate += needed;
+#endif
 }
 
 void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
@@ -689,7 +687,7 @@ void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const
   CURSOR(block_info)
 
   // this call to mdb_cursor_put will change height()
-  MDB_val_copy<blobdata> blob(block_to_blob(blk));
+  MDB_val_copy<blobdata> blob(compress_blob(block_to_blob(blk)));
   result = mdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block blob to db transaction: ", result).c_str()));
@@ -711,8 +709,18 @@ void BlockchainLMDB::add_block(const block& blk, const size_t& block_size, const
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
 
-  m_cum_size += block_size;
-  m_cum_count++;
+  // a pruned database keeps pruning one block as each block is added, so the
+  // pruned area follows the tip
+  if (m_pruning_seed)
+  {
+    uint64_t pruned_height = get_pruned_height(*m_write_txn);
+    if (pruned_height + m_pruning_tip_blocks <= m_height)
+    {
+      if (get_pruning_stripe(pruned_height) != m_pruning_seed)
+        prune_block_txs(*m_write_txn, pruned_height);
+      set_pruning_property(*m_write_txn, "pruned_height", pruned_height + 1);
+    }
+  }
 }
 
 void BlockchainLMDB::remove_block()
@@ -752,6 +760,10 @@ void BlockchainLMDB::remove_block()
 
   if ((result = mdb_cursor_del(m_cur_block_info, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+  // blocks added back at this height will have their txes in full
+  if (m_pruning_seed && get_pruned_height(*m_write_txn) > m_height - 1)
+    set_pruning_property(*m_write_txn, "pruned_height", m_height - 1);
 }
 
 uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash)
@@ -790,7 +802,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
 
-  MDB_val_copy<blobdata> blob(tx_to_blob(tx));
+  MDB_val_copy<blobdata> blob(compress_blob(tx_to_blob(tx)));
   result = mdb_cursor_put(m_cur_txs, &val_tx_id, &blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add tx blob to db transaction: ", result).c_str()));
@@ -907,6 +919,9 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   if ((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
       throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
 
+  if (m_output_table.is_usable())
+    m_output_table.add(ok.output_id, tx_output.amount, ok.amount_index, ok.data);
+
   return ok.amount_index;
 }
 
@@ -1083,8 +1098,9 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions)
   m_write_txn = nullptr;
   m_write_batch_txn = nullptr;
   m_batch_active = false;
-  m_cum_size = 0;
-  m_cum_count = 0;
+  m_batch_size_estimate = 0;
+  m_pruning_seed = 0;
+  m_has_txpool_key_images = false;
 
   m_hardfork = nullptr;
 }
@@ -1156,7 +1172,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     LOG_PRINT_L1("LMDB memory map size: " << cur_mapsize);
   }
 
-  if (need_resize())
+  if (!(mdb_flags & MDB_RDONLY) && need_resize())
   {
     LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
     do_resize();
@@ -1190,6 +1206,20 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   lmdb_db_open(txn, LMDB_TXPOOL_META, MDB_CREATE, m_txpool_meta, "Failed to open db handle for m_txpool_meta");
   lmdb_db_open(txn, LMDB_TXPOOL_BLOB, MDB_CREATE, m_txpool_blob, "Failed to open db handle for m_txpool_blob");
 
+  // this subdb was added later, so an older database opened read-only may not
+  // have it. The txpool then parses the transactions for their key images.
+  m_has_txpool_key_images = true;
+  if (mdb_flags & MDB_RDONLY)
+  {
+    result = mdb_dbi_open(txn, LMDB_TXPOOL_KEY_IMAGES, 0, &m_txpool_key_images);
+    if (result == MDB_NOTFOUND)
+      m_has_txpool_key_images = false;
+    else if (result)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_txpool_key_images: ", result).c_str()));
+  }
+  else
+    lmdb_db_open(txn, LMDB_TXPOOL_KEY_IMAGES, MDB_CREATE, m_txpool_key_images, "Failed to open db handle for m_txpool_key_images");
+
   // this subdb is dropped on sight, so it may not be present when we open the DB.
   // Since we use MDB_CREATE, we'll get an exception if we open read-only and it does not exist.
   // So we don't open for read-only, and also not drop below. It is not used elsewhere.
@@ -1209,6 +1239,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   mdb_set_compare(txn, m_txpool_meta, compare_hash32);
   mdb_set_compare(txn, m_txpool_blob, compare_hash32);
+  if (m_has_txpool_key_images)
+    mdb_set_compare(txn, m_txpool_key_images, compare_hash32);
   mdb_set_compare(txn, m_properties, compare_string);
 
   if (!(mdb_flags & MDB_RDONLY))
@@ -1269,6 +1301,34 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     return;
   }
 
+  MDB_val_copy<const char*> k_seed("pruning_seed");
+  if (mdb_get(txn, m_properties, &k_seed, &v) == MDB_SUCCESS)
+    m_pruning_seed = *(const uint64_t*)v.mv_data;
+  else
+    m_pruning_seed = 0;
+  if (m_pruning_seed)
+    MINFO("Database is pruned, keeping pruning stripe " << m_pruning_seed);
+
+  MDB_val_copy<const char*> k_dictionary("blob_dictionary");
+  if (mdb_get(txn, m_properties, &k_dictionary, &v) == MDB_SUCCESS)
+  {
+    if (!blob_compressor::available())
+    {
+      txn.abort();
+      mdb_env_close(m_env);
+      m_open = false;
+      MFATAL("Existing lmdb database has compressed blobs, but this build does not support compression.");
+      MFATAL("Please use a build with zlib support.");
+      return;
+    }
+    m_blob_compressor.set_dictionary(std::string((const char*)v.mv_data, v.mv_size));
+    MINFO("Database blobs are compressed");
+  }
+  else
+  {
+    m_blob_compressor.set_dictionary(std::string());
+  }
+
   if (!(mdb_flags & MDB_RDONLY))
   {
     // only write version on an empty DB
@@ -1292,6 +1352,13 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+
+  // a read only db may be a replica of a running primary, which rebuilds the
+  // table in place under any mapping of it, so lookups stay in the LMDB
+  if (mdb_flags & MDB_RDONLY)
+    MINFO("Read only database, output lookups will use the LMDB");
+  else
+    open_output_table();
   // from here, init should be finished
 }
 
@@ -1304,6 +1371,7 @@ void BlockchainLMDB::close()
     batch_abort();
   }
   this->sync();
+  m_output_table.close();
   m_tinfo.reset();
 
   // FIXME: not yet thread safe!!!  Use with care.
@@ -1316,12 +1384,29 @@ void BlockchainLMDB::sync()
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // a read only environment has nothing to flush, and LMDB refuses to try
+  if (is_read_only())
+    return;
+
   // Does nothing unless LMDB environment was opened with MDB_NOSYNC or in part
   // MDB_NOMETASYNC. Force flush to be synchronous.
+  // a write in progress may have put outputs in the table that the LMDB
+  // does not have yet, the table is then left dirty until a later sync
+  const bool idle = !m_batch_active && !m_write_txn;
+  const uint64_t generation = m_output_table.get_generation();
+
   if (auto result = mdb_env_sync(m_env, true))
   {
     throw0(DB_ERROR(lmdb_error("Failed to sync database: ", result).c_str()));
   }
+
+  if (m_output_table.is_open())
+  {
+    if (idle)
+      m_output_table.set_clean(num_outputs(), get_num_outputs(0), top_block_hash(), generation);
+    else
+      m_output_table.sync();
+  }
 }
 
 void BlockchainLMDB::safesyncmode(const bool onoff)
@@ -1369,8 +1454,11 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
   txn.commit();
-  m_cum_size = 0;
-  m_cum_count = 0;
+  m_pruning_seed = 0;
+  m_blob_compressor.set_dictionary(std::string());
+
+  if (m_output_table.is_open())
+    m_output_table.reset();
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -1386,6 +1474,12 @@ std::vector<std::string> BlockchainLMDB::get_filenames() const
   filenames.push_back(datafile.string());
   filenames.push_back(lockfile.string());
 
+  for (const std::string &filename: output_table::get_filenames(m_folder))
+  {
+    if (boost::filesystem::exists(filename))
+      filenames.push_back(filename);
+  }
+
   return filenames;
 }
 
@@ -1489,6 +1583,21 @@ void BlockchainLMDB::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t
     else
       throw1(DB_ERROR(lmdb_error("Error adding txpool tx blob to db transaction: ", result).c_str()));
   }
+
+  // the pool indexes these, keeping them saves parsing the tx at startup
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
+  for (const txin_v &in: tx.vin)
+    if (in.type() == typeid(txin_to_key))
+      key_images.push_back(boost::get<txin_to_key>(in).k_image);
+  if (key_images.size() == tx.vin.size())
+  {
+    CURSOR(txpool_key_images)
+    // an older version may have left an entry behind, it is overwritten
+    MDB_val ki_val = {key_images.size() * sizeof(crypto::key_image), (void *)key_images.data()};
+    if (auto result = mdb_cursor_put(m_cur_txpool_key_images, &k, &ki_val, 0))
+      throw1(DB_ERROR(lmdb_error("Error adding txpool tx key images to db transaction: ", result).c_str()));
+  }
 }
 
 void BlockchainLMDB::update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
@@ -1578,6 +1687,16 @@ void BlockchainLMDB::remove_txpool_tx(const crypto::hash& txid)
     if (result)
       throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx blob to db transaction: ", result).c_str()));
   }
+  CURSOR(txpool_key_images)
+  result = mdb_cursor_get(m_cur_txpool_key_images, &k, NULL, MDB_SET);
+  if (result != 0 && result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Error finding txpool tx key images to remove: ", result).c_str()));
+  if (!result)
+  {
+    result = mdb_cursor_del(m_cur_txpool_key_images, 0);
+    if (result)
+      throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx key images to db transaction: ", result).c_str()));
+  }
 }
 
 txpool_tx_meta_t BlockchainLMDB::get_txpool_tx_meta(const crypto::hash& txid) const
@@ -1628,6 +1747,32 @@ cryptonote::blobdata BlockchainLMDB::get_txpool_tx_blob(const crypto::hash& txid
   return bd;
 }
 
+bool BlockchainLMDB::get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  if (!m_has_txpool_key_images)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(txpool_key_images)
+
+  MDB_val k = {sizeof(txid), (void *)&txid};
+  MDB_val v;
+  auto result = mdb_cursor_get(m_cur_txpool_key_images, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result != 0)
+      throw1(DB_ERROR(lmdb_error("Error finding txpool tx key images: ", result).c_str()));
+  if (v.mv_size % sizeof(crypto::key_image))
+    throw0(DB_ERROR("Unexpected txpool tx key images size"));
+
+  const crypto::key_image *key_image = (const crypto::key_image*)v.mv_data;
+  key_images.assign(key_image, key_image + v.mv_size / sizeof(crypto::key_image));
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
 bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1765,7 +1910,7 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
     throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
   blobdata bd;
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  decompress_blob(result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -2113,6 +2258,41 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   if (get_result == 0)
   {
     txindex *tip = (txindex *)v.mv_data;
+    // only the unprunable part of a pruned tx is left, which is not a valid tx blob
+    if (is_tx_pruned(m_txn, tip->data.block_id))
+      return false;
+    MDB_val_set(val_tx_id, tip->data.tx_id);
+    get_result = mdb_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
+  }
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+
+  decompress_blob(result, bd);
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
+bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs);
+
+  MDB_val_set(v, h);
+  MDB_val result;
+  bool pruned = false;
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == 0)
+  {
+    txindex *tip = (txindex *)v.mv_data;
+    pruned = is_tx_pruned(m_txn, tip->data.block_id);
     MDB_val_set(val_tx_id, tip->data.tx_id);
     get_result = mdb_cursor_get(m_cur_txs, &val_tx_id, &result, MDB_SET);
   }
@@ -2121,7 +2301,17 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  if (pruned)
+  {
+    decompress_blob(result, bd);
+  }
+  else
+  {
+    blobdata full;
+    decompress_blob(result, full);
+    if (!get_pruned_transaction_blob(full, bd))
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+  }
 
   TXN_POSTFIX_RDONLY();
 
@@ -2211,12 +2401,24 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__ << " (unused version - does nothing)");
   check_open();
+
+  output_data_t od;
+  if (m_output_table.is_usable())
+  {
+    if (global_index >= num_outputs())
+      throw1(OUTPUT_DNE("output with given index not in db"));
+    const output_table_entry &e = m_output_table.get(global_index);
+    od = e.data;
+    if (e.amount != 0)
+      od.commitment = rct::zeroCommit(e.amount);
+    return od;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(output_txs);
   RCURSOR(tx_indices);
   RCURSOR(txs);
 
-  output_data_t od;
   MDB_val_set(v, global_index);
   auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
@@ -2241,10 +2443,11 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t &global_index) const
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
   blobdata bd;
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  decompress_blob(result, bd);
 
+  // the outputs are in the unprunable part, so this works for pruned txes too
   transaction tx;
-  if (!parse_and_validate_tx_from_blob(bd, tx))
+  if (!parse_and_validate_tx_base_from_blob(bd, tx))
     throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
 
   const tx_out tx_output = tx.vout[ot->local_index];
@@ -2261,6 +2464,13 @@ output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint6
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (amount == 0 && m_output_table.is_usable())
+  {
+    if (index >= get_num_outputs(0))
+      throw1(OUTPUT_DNE("Attempting to get output pubkey by index, but key does not exist"));
+    return m_output_table.get(m_output_table.get_rct_output_id(index)).data;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(output_amounts);
 
@@ -2443,7 +2653,7 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, st
       throw0(DB_ERROR("Failed to enumerate blocks"));
     uint64_t height = *(const uint64_t*)k.mv_data;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    decompress_blob(v, bd);
     block b;
     if (!parse_and_validate_block_from_blob(bd, b))
       throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
@@ -2495,11 +2705,17 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
       break;
     if (ret)
       throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
+    const bool pruned = is_tx_pruned(m_txn, ti->data.block_id);
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    decompress_blob(v, bd);
     transaction tx;
-    if (!parse_and_validate_tx_from_blob(bd, tx))
+    if (pruned ? !parse_and_validate_tx_base_from_blob(bd, tx) : !parse_and_validate_tx_from_blob(bd, tx))
       throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    if (pruned)
+    {
+      tx.hash = hash;
+      tx.set_hash_valid(true);
+    }
     if (!f(hash, tx)) {
       ret = false;
       break;
@@ -2546,100 +2762,386 @@ bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const c
   return ret;
 }
 
-// batch_num_blocks: (optional) Used to check if resize needed before batch transaction starts.
-bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks)
+bool BlockchainLMDB::for_blocks_range_parallel(uint64_t h1, uint64_t h2, std::function<bool(uint64_t height, const crypto::hash &hash, const cryptonote::blobdata *blob, const cryptonote::block *blk)> f, iteration_detail detail, unsigned num_threads) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (m_batch_active)
-    return false;
-  if (m_write_batch_txn != nullptr)
-    return false;
-  if (m_write_txn)
-    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
   check_open();
 
-  m_writer = boost::this_thread::get_id();
-  check_and_resize_for_batch(batch_num_blocks);
+  const uint64_t db_height = height();
+  if (h1 > h2 || h1 >= db_height)
+    return true;
+  h2 = std::min(h2, db_height - 1);
 
-  m_write_batch_txn = new mdb_txn_safe();
+  const uint64_t num_shards = (h2 - h1) / ITERATION_BLOCKS_PER_SHARD + 1;
+  return run_shards(num_shards, num_threads, [&](uint64_t shard, const std::atomic<bool> &stop) {
+    const uint64_t start = h1 + shard * ITERATION_BLOCKS_PER_SHARD;
+    const uint64_t end = std::min(start + ITERATION_BLOCKS_PER_SHARD - 1, h2);
 
-  // NOTE: need to make sure it's destroyed properly when done
-  if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_batch_txn))
-  {
-    delete m_write_batch_txn;
-    m_write_batch_txn = nullptr;
-    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
-  }
-  // indicates this transaction is for batch transactions, but not whether it's
-  // active
-  m_write_batch_txn->m_batch_txn = true;
-  m_write_txn = m_write_batch_txn;
+    TXN_PREFIX_RDONLY();
+    RCURSOR(block_info);
+    RCURSOR(blocks);
 
-  m_batch_active = true;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
+    MDB_cursor_op op = MDB_SET;
+    for (uint64_t height = start; height <= end && !stop; ++height)
+    {
+      MDB_val_set(v, height);
+      int result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate block info: ", result).c_str()));
+      const crypto::hash hash = ((const mdb_block_info *)v.mv_data)->bi_hash;
 
-  LOG_PRINT_L3("batch transaction: begin");
-  return true;
+      blobdata bd;
+      block b;
+      if (detail != iterate_keys)
+      {
+        MDB_val_set(k, height);
+        result = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+        op = MDB_NEXT;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to enumerate blocks: ", result).c_str()));
+        if (*(const uint64_t *)k.mv_data != height)
+          throw0(DB_ERROR("Unexpected: blocks table has a gap"));
+        decompress_blob(v, bd);
+        if (detail == iterate_parsed && !parse_and_validate_block_from_blob(bd, b))
+          throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+      }
+
+      if (!f(height, hash, detail != iterate_keys ? &bd : NULL, detail == iterate_parsed ? &b : NULL))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
 }
 
-void BlockchainLMDB::batch_commit()
+bool BlockchainLMDB::for_all_transactions_parallel(std::function<bool(uint64_t height, const crypto::hash &tx_hash, const cryptonote::blobdata *blob, const cryptonote::transaction *tx)> f, iteration_detail detail, unsigned num_threads) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (! m_batch_active)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_write_batch_txn == nullptr)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_writer != boost::this_thread::get_id())
-    throw1(DB_ERROR("batch transaction owned by other thread"));
-
   check_open();
 
-  LOG_PRINT_L3("batch transaction: committing...");
-  TIME_MEASURE_START(time1);
-  m_write_txn->commit();
-  TIME_MEASURE_FINISH(time1);
-  time_commit1 += time1;
-  LOG_PRINT_L3("batch transaction: committed");
+  const uint64_t db_height = height();
+  if (db_height == 0)
+    return true;
 
-  m_write_txn = nullptr;
-  delete m_write_batch_txn;
-  m_write_batch_txn = nullptr;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
-}
+  // the hashes of the txes are in the blocks, and the txes of consecutive
+  // blocks have consecutive ids, so each shard reads its part of the txs
+  // table in order
+  const uint64_t num_shards = (db_height - 1) / ITERATION_BLOCKS_PER_SHARD + 1;
+  return run_shards(num_shards, num_threads, [&](uint64_t shard, const std::atomic<bool> &stop) {
+    const uint64_t start = shard * ITERATION_BLOCKS_PER_SHARD;
+    const uint64_t end = std::min(start + ITERATION_BLOCKS_PER_SHARD, db_height);
+
+    TXN_PREFIX_RDONLY();
+    RCURSOR(blocks);
+    RCURSOR(tx_indices);
+    RCURSOR(txs);
+
+    MDB_cursor_op block_op = MDB_SET;
+    MDB_cursor_op tx_op = MDB_SET;
+    uint64_t tx_id = 0;
+    for (uint64_t height = start; height < end && !stop; ++height)
+    {
+      MDB_val_set(k, height);
+      MDB_val v;
+      int result = mdb_cursor_get(m_cur_blocks, &k, &v, block_op);
+      block_op = MDB_NEXT;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate blocks: ", result).c_str()));
+      blobdata bd;
+      decompress_blob(v, bd);
+      block b;
+      if (!parse_and_validate_block_from_blob(bd, b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
 
-void BlockchainLMDB::cleanup_batch()
-{
-  // for destruction of batch transaction
-  m_write_txn = nullptr;
-  delete m_write_batch_txn;
-  m_write_batch_txn = nullptr;
-  m_batch_active = false;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
+      const bool pruned = is_tx_pruned(m_txn, height);
+      for (size_t i = 0; i < b.tx_hashes.size() + 1; ++i)
+      {
+        const bool is_miner_tx = i == 0;
+        const crypto::hash tx_hash = is_miner_tx ? get_transaction_hash(b.miner_tx) : b.tx_hashes[i - 1];
+
+        blobdata tx_bd;
+        transaction tx;
+        if (detail != iterate_keys)
+        {
+          if (tx_op == MDB_SET)
+          {
+            MDB_val_set(val_h, tx_hash);
+            if ((result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH)))
+              throw0(DB_ERROR(lmdb_error("Failed to get tx index: ", result).c_str()));
+            tx_id = ((const txindex *)val_h.mv_data)->data.tx_id;
+          }
+          MDB_val_set(tk, tx_id);
+          result = mdb_cursor_get(m_cur_txs, &tk, &v, tx_op);
+          tx_op = MDB_NEXT;
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+          if (*(const uint64_t *)tk.mv_data != tx_id++)
+            throw0(DB_ERROR("Unexpected: txs table has a gap"));
+          decompress_blob(v, tx_bd);
+
+          // the miner tx has nothing prunable
+          if (detail == iterate_parsed)
+          {
+            if (pruned && !is_miner_tx ? !parse_and_validate_tx_base_from_blob(tx_bd, tx) : !parse_and_validate_tx_from_blob(tx_bd, tx))
+              throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+            if (pruned && !is_miner_tx)
+            {
+              tx.hash = tx_hash;
+              tx.set_hash_valid(true);
+            }
+          }
+        }
+
+        if (!f(height, tx_hash, detail != iterate_keys ? &tx_bd : NULL, detail == iterate_parsed ? &tx : NULL))
+          return false;
+      }
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
 }
 
-void BlockchainLMDB::batch_stop()
+bool BlockchainLMDB::for_all_outputs_parallel(std::function<bool(uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data)> f, unsigned num_threads) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (! m_batch_active)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_write_batch_txn == nullptr)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_writer != boost::this_thread::get_id())
-    throw1(DB_ERROR("batch transaction owned by other thread"));
   check_open();
-  LOG_PRINT_L3("batch transaction: committing...");
-  TIME_MEASURE_START(time1);
-  try
+
+  // most outputs are RingCT ones, with amount 0, so the outputs of each
+  // amount are split into shards of amount index ranges
+  struct output_shard
   {
-    m_write_txn->commit();
-    TIME_MEASURE_FINISH(time1);
-    time_commit1 += time1;
+    uint64_t amount;
+    uint64_t start;
+    uint64_t end;
+  };
+  std::vector<output_shard> shards;
+  for (const auto &i : get_output_histogram(std::vector<uint64_t>(), false, 0))
+  {
+    const uint64_t count = std::get<0>(i.second);
+    for (uint64_t start = 0; start < count; start += ITERATION_OUTPUTS_PER_SHARD)
+      shards.push_back({i.first, start, std::min(start + ITERATION_OUTPUTS_PER_SHARD, count)});
+  }
+
+  return run_shards(shards.size(), num_threads, [&](uint64_t shard, const std::atomic<bool> &stop) {
+    const output_shard &s = shards[shard];
+
+    TXN_PREFIX_RDONLY();
+    RCURSOR(output_amounts);
+
+    MDB_val_set(k, s.amount);
+    MDB_val_set(v, s.start);
+    MDB_cursor_op op = MDB_GET_BOTH;
+    for (uint64_t amount_index = s.start; amount_index < s.end && !stop; ++amount_index)
+    {
+      int result = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+      op = MDB_NEXT_DUP;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+
+      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
+      output_data_t od;
+      if (s.amount == 0)
+      {
+        od = ((const outkey *)v.mv_data)->data;
+      }
+      else
+      {
+        memcpy(&od, &okp->data, sizeof(pre_rct_output_data_t));
+        memset(&od.commitment, 0, sizeof(od.commitment));
+      }
+
+      if (!f(s.amount, okp->amount_index, okp->output_id, od))
+        return false;
+    }
+
+    TXN_POSTFIX_RDONLY();
+    return true;
+  });
+}
+
+void BlockchainLMDB::open_output_table()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  if (!m_output_table.open(m_folder, false))
+  {
+    MINFO("Output table not available, output lookups will use the LMDB");
+    return;
+  }
+
+  // the table is marked dirty again by the first write to it
+  if (m_output_table.is_valid(num_outputs(), get_num_outputs(0), top_block_hash()))
+    return;
+
+  try
+  {
+    rebuild_output_table();
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to rebuild the output table, output lookups will use the LMDB: " << e.what());
+    m_output_table.close();
+  }
+}
+
+void BlockchainLMDB::invalidate_output_table()
+{
+  if (!m_output_table.is_usable())
+    return;
+  MWARNING("Write transaction aborted, output lookups will use the LMDB until the output table is rebuilt at the next start");
+  m_output_table.invalidate();
+}
+
+void BlockchainLMDB::rebuild_output_table()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  MGINFO("Rebuilding the output table, this may take a while...");
+
+  m_output_table.reset();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+
+  MDB_val k;
+  MDB_val v;
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+    const uint64_t amount = *(const uint64_t*)k.mv_data;
+    // the pre-RingCT layout is a prefix of the RingCT one
+    const outkey *okp = (const outkey *)v.mv_data;
+    output_data_t data;
+    if (amount == 0)
+    {
+      data = okp->data;
+    }
+    else
+    {
+      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
+      memset(&data.commitment, 0, sizeof(data.commitment));
+    }
+    m_output_table.add(okp->output_id, amount, okp->amount_index, data);
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  m_output_table.sync();
+  MGINFO("Output table rebuilt");
+}
+
+// batch_num_blocks is not needed here, the map is resized as the batch grows.
+bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (m_batch_active)
+    return false;
+  if (m_write_batch_txn != nullptr)
+    return false;
+  if (m_write_txn)
+    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
+  check_open();
+
+  m_writer = boost::this_thread::get_id();
+  if (need_resize())
+  {
+    MGINFO("[batch] DB resize needed");
+    do_resize();
+  }
+
+  batch_txn_begin();
+  m_batch_active = true;
+
+  LOG_PRINT_L3("batch transaction: begin");
+  return true;
+}
+
+void BlockchainLMDB::batch_txn_begin()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  m_write_batch_txn = new mdb_txn_safe();
+
+  // NOTE: need to make sure it's destroyed properly when done
+  if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_batch_txn))
+  {
+    delete m_write_batch_txn;
+    m_write_batch_txn = nullptr;
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+  }
+  // indicates this transaction is for batch transactions, but not whether it's
+  // active
+  m_write_batch_txn->m_batch_txn = true;
+  m_write_txn = m_write_batch_txn;
+  m_batch_size_estimate = 0;
+
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+}
+
+void BlockchainLMDB::batch_commit()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_write_batch_txn == nullptr)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+
+  check_open();
+
+  LOG_PRINT_L3("batch transaction: committing...");
+  TIME_MEASURE_START(time1);
+  m_write_txn->commit();
+  TIME_MEASURE_FINISH(time1);
+  time_commit1 += time1;
+  LOG_PRINT_L3("batch transaction: committed");
+
+  m_write_txn = nullptr;
+  delete m_write_batch_txn;
+  m_write_batch_txn = nullptr;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+}
+
+void BlockchainLMDB::cleanup_batch()
+{
+  // for destruction of batch transaction
+  m_write_txn = nullptr;
+  delete m_write_batch_txn;
+  m_write_batch_txn = nullptr;
+  m_batch_active = false;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+}
+
+void BlockchainLMDB::batch_stop()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_write_batch_txn == nullptr)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+  LOG_PRINT_L3("batch transaction: committing...");
+  TIME_MEASURE_START(time1);
+  try
+  {
+    m_write_txn->commit();
+    TIME_MEASURE_FINISH(time1);
+    time_commit1 += time1;
     cleanup_batch();
   }
   catch (const std::exception &e)
@@ -2670,6 +3172,7 @@ void BlockchainLMDB::batch_abort()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  invalidate_output_table();
   LOG_PRINT_L3("batch transaction: aborted");
 }
 
@@ -2812,6 +3315,7 @@ void BlockchainLMDB::block_txn_abort()
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+      invalidate_output_table();
     }
   }
   else if (m_tinfo->m_ti_rtxn)
@@ -2836,10 +3340,13 @@ uint64_t BlockchainLMDB::add_block(const block& blk, const size_t& block_size, c
   check_open();
   uint64_t m_height = height();
 
-  if (m_height % 1000 == 0)
+  if (m_batch_active)
+  {
+    check_and_resize_for_batch(block_size);
+  }
+  else if (m_height % 1000 == 0)
   {
-    // for batch mode, DB resize check is done at start of batch transaction
-    if (! m_batch_active && need_resize())
+    if (need_resize())
     {
       LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
       do_resize();
@@ -2882,6 +3389,185 @@ void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
   }
 }
 
+void BlockchainLMDB::pop_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  blocks.clear();
+  txs.clear();
+  if (nblocks == 0)
+    return;
+
+  block_txn_start(false);
+
+  try
+  {
+    remove_blocks(nblocks, blocks, txs);
+	block_txn_stop();
+  }
+  catch (...)
+  {
+	block_txn_abort();
+    throw;
+  }
+}
+
+// Removes the top blocks in one go. The tables keyed by height, tx id or
+// output id are cut from their end, and only the tables keyed by hash, key
+// image or amount need a lookup per entry.
+void BlockchainLMDB::remove_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+
+  const uint64_t m_height = height();
+  if (nblocks > m_height)
+    throw0(BLOCK_DNE("Attempting to pop more blocks than there are in the db"));
+  const uint64_t start_height = m_height - nblocks;
+
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+  CURSOR(blocks)
+  CURSOR(block_info)
+  CURSOR(block_heights)
+  CURSOR(txs)
+  CURSOR(tx_indices)
+  CURSOR(tx_outputs)
+  CURSOR(output_txs)
+  CURSOR(output_amounts)
+  CURSOR(spent_keys)
+
+  // first gather what is to be removed, and the entries keyed by tx hash
+  std::vector<crypto::hash> tx_hashes;
+  blocks.reserve(nblocks);
+  for (uint64_t h = start_height; h < m_height; ++h)
+  {
+    MDB_val_copy<uint64_t> k(h);
+    MDB_val v;
+    if ((result = mdb_cursor_get(m_cur_blocks, &k, &v, MDB_SET)))
+      throw1(BLOCK_DNE(lmdb_error("Attempting to remove block that's not in the db: ", result).c_str()));
+    blobdata bd;
+    decompress_blob(v, bd);
+    blocks.push_back(block());
+    if (!parse_and_validate_block_from_blob(bd, blocks.back()))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    tx_hashes.push_back(get_transaction_hash(blocks.back().miner_tx));
+    tx_hashes.insert(tx_hashes.end(), blocks.back().tx_hashes.begin(), blocks.back().tx_hashes.end());
+  }
+
+  // the txes of the popped blocks are the last ones added
+  const uint64_t first_tx_id = get_tx_count() - tx_hashes.size();
+  std::vector<crypto::key_image> key_images;
+  std::map<uint64_t, uint64_t> outputs_per_amount;
+  uint64_t num_removed_outputs = 0;
+  size_t tx_idx = 0;
+  for (uint64_t h = start_height; h < m_height; ++h)
+  {
+    const block &blk = blocks[h - start_height];
+    const bool pruned = is_tx_pruned(*m_write_txn, h);
+    for (size_t i = 0; i < blk.tx_hashes.size() + 1; ++i, ++tx_idx)
+    {
+      MDB_val_set(val_h, tx_hashes[tx_idx]);
+      if ((result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH)))
+        throw1(TX_DNE(lmdb_error("Attempting to remove transaction that isn't in the db: ", result).c_str()));
+      MDB_val_copy<uint64_t> k(((const txindex *)val_h.mv_data)->data.tx_id);
+      if (*(const uint64_t *)k.mv_data < first_tx_id)
+        throw0(DB_ERROR("Unexpected: tx of a popped block is not among the last ones added"));
+      if ((result = mdb_cursor_del(m_cur_tx_indices, 0)))
+        throw1(DB_ERROR(lmdb_error("Failed to add removal of tx index to db transaction: ", result).c_str()));
+
+      MDB_val v;
+      if ((result = mdb_cursor_get(m_cur_txs, &k, &v, MDB_SET)))
+        throw1(DB_ERROR(lmdb_error("Failed to locate tx for removal: ", result).c_str()));
+      blobdata bd;
+      decompress_blob(v, bd);
+
+      // the miner tx has nothing prunable
+      const bool is_miner_tx = i == 0;
+      transaction tx;
+      if (!(pruned && !is_miner_tx ? parse_and_validate_tx_base_from_blob(bd, tx) : parse_and_validate_tx_from_blob(bd, tx)))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+
+      for (const txin_v &tx_input : tx.vin)
+        if (tx_input.type() == typeid(txin_to_key))
+          key_images.push_back(boost::get<txin_to_key>(tx_input).k_image);
+
+      const bool is_pseudo_rct = tx.version >= 2 && tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+      for (const tx_out &out : tx.vout)
+        ++outputs_per_amount[is_pseudo_rct ? 0 : out.amount];
+      num_removed_outputs += tx.vout.size();
+
+      if (!is_miner_tx && !pruned)
+        txs.push_back(tx);
+    }
+  }
+
+  // per entry removals
+  for (const crypto::key_image &k_image : key_images)
+  {
+    MDB_val k = {sizeof(k_image), (void *)&k_image};
+    result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
+    if (result != 0 && result != MDB_NOTFOUND)
+      throw1(DB_ERROR(lmdb_error("Error finding spent key to remove", result).c_str()));
+    if (!result && (result = mdb_cursor_del(m_cur_spent_keys, 0)))
+      throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
+  }
+
+  for (const block &blk : blocks)
+  {
+    blk_height bh = {get_block_hash(blk), 0};
+    MDB_val_set(val_h, bh);
+    if ((result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH)))
+      throw1(DB_ERROR(lmdb_error("Failed to locate block height by hash for removal: ", result).c_str()));
+    if ((result = mdb_cursor_del(m_cur_block_heights, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of block height by hash to db transaction: ", result).c_str()));
+  }
+
+  // outputs of each amount are appended, so the popped ones are the last of their amount
+  const uint64_t first_output_id = num_outputs() - num_removed_outputs;
+  for (const auto &i : outputs_per_amount)
+  {
+    MDB_val_copy<uint64_t> k(i.first);
+    for (uint64_t n = 0; n < i.second; ++n)
+    {
+      MDB_val v;
+      if ((result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET)) || (result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_LAST_DUP)))
+        throw1(OUTPUT_DNE(lmdb_error("Attempting to remove an output that isn't in the db: ", result).c_str()));
+      if (((const pre_rct_outkey *)v.mv_data)->output_id < first_output_id)
+        throw0(DB_ERROR("Unexpected: output of a popped block is not the last of its amount"));
+      if ((result = mdb_cursor_del(m_cur_output_amounts, 0)))
+        throw0(DB_ERROR(lmdb_error("Error deleting amount for output: ", result).c_str()));
+    }
+  }
+
+  // range removals: the popped entries are the tail of each table, so seek
+  // to the first one and delete forward. A deletion leaves the cursor so
+  // that MDB_NEXT lands on the entry which followed the deleted one.
+  auto remove_from = [](MDB_cursor *cur, MDB_val k, MDB_val v, MDB_cursor_op op, const char *table) {
+    int result = mdb_cursor_get(cur, &k, &v, op);
+    while (result == 0)
+    {
+      if ((result = mdb_cursor_del(cur, 0)))
+        throw1(DB_ERROR(lmdb_error(std::string("Failed to add removal from ") + table + " to db transaction: ", result).c_str()));
+      result = mdb_cursor_get(cur, &k, &v, MDB_NEXT);
+    }
+    if (result != MDB_NOTFOUND)
+      throw1(DB_ERROR(lmdb_error(std::string("Failed to locate entries to remove from ") + table + ": ", result).c_str()));
+  };
+  // tables with a dummy key are sorted by the id leading their values
+  const MDB_val none = {0, NULL};
+  MDB_val_copy<uint64_t> first_output(first_output_id), first_tx(first_tx_id), first_height(start_height);
+  remove_from(m_cur_output_txs, zerokval, first_output, MDB_GET_BOTH_RANGE, "output_txs");
+  remove_from(m_cur_tx_outputs, first_tx, none, MDB_SET_RANGE, "tx_outputs");
+  remove_from(m_cur_txs, first_tx, none, MDB_SET_RANGE, "txs");
+  remove_from(m_cur_block_info, zerokval, first_height, MDB_GET_BOTH_RANGE, "block_info");
+  remove_from(m_cur_blocks, first_height, none, MDB_SET_RANGE, "blocks");
+
+  // blocks added back at these heights will have their txes in full
+  if (m_pruning_seed && get_pruned_height(*m_write_txn) > start_height)
+    set_pruning_property(*m_write_txn, "pruned_height", start_height);
+}
+
 void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
     std::vector<tx_out_index> &tx_out_indices) const
 {
@@ -2919,6 +3605,34 @@ void BlockchainLMDB::get_output_key(const uint64_t &amount, const std::vector<ui
 
   TXN_PREFIX_RDONLY();
 
+  // RingCT outputs are the bulk of the lookups, and all share amount 0, so
+  // they can be read directly from the output table. The count is taken in
+  // the same read txn, so only outputs committed in this snapshot are used.
+  if (amount == 0 && m_output_table.is_usable())
+  {
+    const uint64_t num_rct_outputs = get_num_outputs(0);
+    outputs.reserve(offsets.size());
+    for (const uint64_t &index : offsets)
+    {
+      if (index >= num_rct_outputs)
+      {
+        if (allow_partial)
+        {
+          MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
+          break;
+        }
+        throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount 0, index ") + boost::lexical_cast<std::string>(index) + ", count " + boost::lexical_cast<std::string>(num_rct_outputs) + "), but key does not exist").c_str()));
+      }
+      outputs.push_back(m_output_table.get(m_output_table.get_rct_output_id(index)).data);
+    }
+
+    TXN_POSTFIX_RDONLY();
+
+    TIME_MEASURE_FINISH(db3);
+    LOG_PRINT_L3("db3: " << db3);
+    return;
+  }
+
   RCURSOR(output_amounts);
 
   MDB_val_set(k, amount);
@@ -2969,21 +3683,34 @@ void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::
   std::vector <uint64_t> tx_indices;
   TXN_PREFIX_RDONLY();
 
-  RCURSOR(output_amounts);
-
-  MDB_val_set(k, amount);
-  for (const uint64_t &index : offsets)
+  if (amount == 0 && m_output_table.is_usable())
   {
-    MDB_val_set(v, index);
+    const uint64_t num_rct_outputs = get_num_outputs(0);
+    for (const uint64_t &index : offsets)
+    {
+      if (index >= num_rct_outputs)
+        throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
+      tx_indices.push_back(m_output_table.get_rct_output_id(index));
+    }
+  }
+  else
+  {
+    RCURSOR(output_amounts);
 
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
-    else if (get_result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
+    MDB_val_set(k, amount);
+    for (const uint64_t &index : offsets)
+    {
+      MDB_val_set(v, index);
 
-    const outkey *okp = (const outkey *)v.mv_data;
-    tx_indices.push_back(okp->output_id);
+      auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+      if (get_result == MDB_NOTFOUND)
+        throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
+      else if (get_result)
+        throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
+
+      const outkey *okp = (const outkey *)v.mv_data;
+      tx_indices.push_back(okp->output_id);
+    }
   }
 
   TIME_MEASURE_START(db3);
@@ -3153,6 +3880,360 @@ bool BlockchainLMDB::is_read_only() const
   return false;
 }
 
+uint32_t BlockchainLMDB::get_pruning_seed() const
+{
+  return m_pruning_seed;
+}
+
+uint64_t BlockchainLMDB::get_pruned_height(MDB_txn *txn) const
+{
+  MDB_val_copy<const char*> k("pruned_height");
+  MDB_val v;
+  auto result = mdb_get(txn, m_properties, &k, &v);
+  if (result == MDB_NOTFOUND)
+    return 0;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to fetch pruned height: ", result).c_str()));
+  return *(const uint64_t*)v.mv_data;
+}
+
+void BlockchainLMDB::set_pruning_property(MDB_txn *txn, const char *name, uint64_t value)
+{
+  MDB_val_copy<const char*> k(name);
+  MDB_val_copy<uint64_t> v(value);
+  if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
+    throw0(DB_ERROR(lmdb_error(std::string("Failed to write ") + name + " to database: ", result).c_str()));
+}
+
+bool BlockchainLMDB::is_tx_pruned(MDB_txn *txn, uint64_t block_height) const
+{
+  if (!m_pruning_seed || get_pruning_stripe(block_height) == m_pruning_seed)
+    return false;
+  return block_height < get_pruned_height(txn);
+}
+
+void BlockchainLMDB::prune_block_txs(MDB_txn *txn, uint64_t block_height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+
+  MDB_val_copy<uint64_t> key(block_height);
+  MDB_val v;
+  if ((result = mdb_get(txn, m_blocks, &key, &v)))
+    throw0(DB_ERROR(lmdb_error("Failed to get block to prune: ", result).c_str()));
+
+  blobdata bd;
+  decompress_blob(v, bd);
+  block b;
+  if (!parse_and_validate_block_from_blob(bd, b))
+    throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+  // the miner tx has nothing prunable
+  for (const crypto::hash &tx_hash : b.tx_hashes)
+  {
+    MDB_cursor *c_tx_indices;
+    if ((result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices)))
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+    MDB_val_set(val_h, tx_hash);
+    result = mdb_cursor_get(c_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
+    if (result)
+    {
+      mdb_cursor_close(c_tx_indices);
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to get tx index to prune for ") + epee::string_tools::pod_to_hex(tx_hash) + ": ", result).c_str()));
+    }
+    const uint64_t tx_id = ((const txindex *)val_h.mv_data)->data.tx_id;
+    mdb_cursor_close(c_tx_indices);
+
+    MDB_val_copy<uint64_t> val_tx_id(tx_id);
+    if ((result = mdb_get(txn, m_txs, &val_tx_id, &v)))
+      throw0(DB_ERROR(lmdb_error("Failed to get tx to prune: ", result).c_str()));
+
+    blobdata full, pruned;
+    decompress_blob(v, full);
+    if (!get_pruned_transaction_blob(full, pruned))
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    if (pruned.size() == full.size())
+      continue;
+
+    MDB_val_copy<blobdata> val_pruned(compress_blob(pruned));
+    if ((result = mdb_put(txn, m_txs, &val_tx_id, &val_pruned, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to write pruned tx: ", result).c_str()));
+  }
+}
+
+bool BlockchainLMDB::prune_blockchain(uint32_t pruning_seed)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (pruning_seed > CRYPTONOTE_PRUNING_STRIPES)
+  {
+    MERROR("Invalid pruning stripe " << pruning_seed << ", must be between 1 and " << CRYPTONOTE_PRUNING_STRIPES);
+    return false;
+  }
+  if (m_pruning_seed && pruning_seed && pruning_seed != m_pruning_seed)
+  {
+    MERROR("Database is already pruned, keeping pruning stripe " << m_pruning_seed);
+    return false;
+  }
+  if (m_write_txn != nullptr)
+    throw0(DB_ERROR("Attempting to prune the database with a write transaction in progress"));
+
+  if (m_pruning_seed)
+    pruning_seed = m_pruning_seed;
+  else if (!pruning_seed)
+    pruning_seed = crypto::rand<uint32_t>() % CRYPTONOTE_PRUNING_STRIPES + 1;
+
+  const uint64_t blockchain_height = height();
+  const uint64_t prune_to = blockchain_height > m_pruning_tip_blocks ? blockchain_height - m_pruning_tip_blocks : 0;
+  const uint64_t blocks_per_txn = 1000;
+
+  MGINFO("Pruning blockchain up to height " << prune_to << ", keeping pruning stripe " << pruning_seed);
+  uint64_t pruned_height = 0;
+  while (true)
+  {
+    if (need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+
+    mdb_txn_safe txn;
+    if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    // the seed goes in with the first chunk, so an interrupted prune can be
+    // resumed with the same stripe
+    if (!m_pruning_seed)
+      set_pruning_property(txn, "pruning_seed", pruning_seed);
+
+    pruned_height = get_pruned_height(txn);
+    const uint64_t chunk_end = std::min(prune_to, pruned_height + blocks_per_txn);
+    for (; pruned_height < chunk_end; ++pruned_height)
+    {
+      if (get_pruning_stripe(pruned_height) != pruning_seed)
+        prune_block_txs(txn, pruned_height);
+    }
+    set_pruning_property(txn, "pruned_height", pruned_height);
+    txn.commit();
+    m_pruning_seed = pruning_seed;
+
+    if (pruned_height >= prune_to)
+      break;
+    MINFO("Pruned blockchain up to height " << pruned_height << "/" << prune_to);
+  }
+
+  MGINFO("Blockchain pruned up to height " << pruned_height);
+  return true;
+}
+
+blobdata BlockchainLMDB::compress_blob(const blobdata &bd) const
+{
+  blobdata stored;
+  if (m_blob_compressor.enabled() && m_blob_compressor.compress(bd.data(), bd.size(), stored))
+    return stored;
+  return bd;
+}
+
+void BlockchainLMDB::decompress_blob(const MDB_val &v, blobdata &bd) const
+{
+  // uncompressed blobs are left as is when compression is enabled, so
+  // they may be found side by side with compressed ones
+  if (m_blob_compressor.enabled() && blob_compressor::is_compressed(v.mv_data, v.mv_size))
+  {
+    if (!m_blob_compressor.decompress(v.mv_data, v.mv_size, bd))
+      throw0(DB_ERROR("Failed to decompress blob retrieved from the db"));
+    return;
+  }
+  bd.assign(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+}
+
+bool BlockchainLMDB::get_blob_compression() const
+{
+  return m_blob_compressor.enabled();
+}
+
+std::string BlockchainLMDB::train_blob_dictionary()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  // txes are most of the data, but blocks get a share too. The samples are
+  // spread evenly over the chain, as the blob layout changes over time.
+  std::vector<std::string> samples;
+  auto sample = [&](MDB_dbi dbi, const char *name, uint64_t max_bytes) {
+    MDB_stat db_stats;
+    if (auto result = mdb_stat(txn, dbi, &db_stats))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to query m_") + name + ": ", result).c_str()));
+    if (db_stats.ms_entries == 0)
+      return;
+    MDB_cursor *cur;
+    if (auto result = mdb_cursor_open(txn, dbi, &cur))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to open a cursor for ") + name + ": ", result).c_str()));
+    const uint64_t max_samples = 4096;
+    const uint64_t step = std::max<uint64_t>(1, db_stats.ms_entries / max_samples);
+    uint64_t bytes = 0;
+    for (uint64_t id = 0; id < db_stats.ms_entries && bytes < max_bytes; id += step)
+    {
+      MDB_val k = {sizeof(id), (void*)&id}, v;
+      auto result = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE);
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+      {
+        mdb_cursor_close(cur);
+        throw0(DB_ERROR(lmdb_error(std::string("Failed to sample ") + name + ": ", result).c_str()));
+      }
+      blobdata bd;
+      decompress_blob(v, bd);
+      bytes += bd.size();
+      samples.push_back(std::move(bd));
+    }
+    mdb_cursor_close(cur);
+  };
+  sample(m_blocks, "blocks", 256 * 1024);
+  sample(m_txs, "txs", 1024 * 1024);
+  txn.commit();
+
+  MINFO("Training a compression dictionary on " << samples.size() << " blobs");
+  return blob_compressor::train_dictionary(samples);
+}
+
+void BlockchainLMDB::recompress_blobs(MDB_dbi dbi, const char *name, bool compress, uint64_t &raw_size, uint64_t &stored_size)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const uint64_t records_per_txn = 1000;
+
+  uint64_t next_id = 0;
+  bool done = false;
+  while (!done)
+  {
+    if (need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+
+    mdb_txn_safe txn;
+    if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    MDB_cursor *cur;
+    if (auto result = mdb_cursor_open(txn, dbi, &cur))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to open a cursor for ") + name + ": ", result).c_str()));
+
+    MDB_val k = {sizeof(next_id), (void*)&next_id}, v;
+    int result = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE);
+    for (uint64_t n = 0; n < records_per_txn; ++n)
+    {
+      if (result == MDB_NOTFOUND)
+      {
+        done = true;
+        break;
+      }
+      if (result)
+        throw0(DB_ERROR(lmdb_error(std::string("Failed to enumerate ") + name + ": ", result).c_str()));
+      const uint64_t id = *(const uint64_t*)k.mv_data;
+
+      blobdata bd;
+      decompress_blob(v, bd);
+      const blobdata stored = compress ? compress_blob(bd) : bd;
+      raw_size += bd.size();
+      stored_size += stored.size();
+
+      // compression is deterministic, so blobs already in the wanted form are left alone
+      if (stored.size() != v.mv_size || memcmp(stored.data(), v.mv_data, v.mv_size))
+      {
+        // the key must not point into the page, which a resize rewrites
+        MDB_val_copy<uint64_t> key(id);
+        MDB_val_copy<blobdata> val_stored(stored);
+        if ((result = mdb_cursor_put(cur, &key, &val_stored, MDB_CURRENT)))
+          throw0(DB_ERROR(lmdb_error(std::string("Failed to rewrite ") + name + ": ", result).c_str()));
+      }
+
+      next_id = id + 1;
+      result = mdb_cursor_get(cur, &k, &v, MDB_NEXT);
+    }
+    mdb_cursor_close(cur);
+    txn.commit();
+    MINFO((compress ? "Compressed " : "Decompressed ") << name << " up to " << next_id);
+  }
+}
+
+bool BlockchainLMDB::set_blob_compression(bool enable)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (enable && !blob_compressor::available())
+  {
+    MERROR("Blob compression needs zlib, which this build does not support");
+    return false;
+  }
+  if (m_write_txn != nullptr)
+    throw0(DB_ERROR("Attempting to change blob compression with a write transaction in progress"));
+
+  MDB_val_copy<const char*> k("blob_dictionary");
+  if (enable && !m_blob_compressor.enabled())
+  {
+    const std::string dictionary = train_blob_dictionary();
+    if (dictionary.empty())
+    {
+      MERROR("Not enough blobs in the database to train a compression dictionary");
+      return false;
+    }
+
+    // the dictionary goes in first, so an interrupted run can be resumed
+    mdb_txn_safe txn;
+    if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    MDB_val v = {dictionary.size(), (void*)dictionary.data()};
+    if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write compression dictionary to database: ", result).c_str()));
+    txn.commit();
+    m_blob_compressor.set_dictionary(dictionary);
+    MGINFO("Trained a compression dictionary of " << dictionary.size() << " bytes");
+  }
+  else if (!enable && !m_blob_compressor.enabled())
+  {
+    return true;
+  }
+
+  uint64_t raw_size = 0, stored_size = 0;
+  recompress_blobs(m_blocks, "blocks", enable, raw_size, stored_size);
+  recompress_blobs(m_txs, "txs", enable, raw_size, stored_size);
+  MGINFO("Blobs take " << stored_size << " bytes, for " << raw_size << " bytes uncompressed");
+
+  if (!enable)
+  {
+    mdb_txn_safe txn;
+    if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    if (auto result = mdb_del(txn, m_properties, &k, NULL))
+      throw0(DB_ERROR(lmdb_error("Failed to remove compression dictionary from database: ", result).c_str()));
+    txn.commit();
+    m_blob_compressor.set_dictionary(std::string());
+  }
+
+  return true;
+}
+
+bool BlockchainLMDB::copy_compacted(const std::string &folder)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (m_write_txn != nullptr)
+    throw0(DB_ERROR("Attempting to copy the database with a write transaction in progress"));
+
+  // LMDB keeps freed pages for reuse, the compacting copy skips them
+  if (auto result = mdb_env_copy2(m_env, folder.c_str(), MDB_CP_COMPACT))
+    throw0(DB_ERROR(lmdb_error("Failed to write a compacted copy of the database: ", result).c_str()));
+  return true;
+}
+
 void BlockchainLMDB::fixup()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -29,6 +29,8 @@
 #include <atomic>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/blob_compression.h"
+#include "blockchain_db/lmdb/output_table.h"
 #include "cryptonote_protocol/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
 #include <boost/thread/tss.hpp>
@@ -57,6 +59,7 @@ typedef struct mdb_txn_cursors
 
   MDB_cursor *m_txc_txpool_meta;
   MDB_cursor *m_txc_txpool_blob;
+  MDB_cursor *m_txc_txpool_key_images;
 
   MDB_cursor *m_txc_hf_versions;
 } mdb_txn_cursors;
@@ -72,6 +75,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_spent_keys	m_cursors->m_txc_spent_keys
 #define m_cur_txpool_meta	m_cursors->m_txc_txpool_meta
 #define m_cur_txpool_blob	m_cursors->m_txc_txpool_blob
+#define m_cur_txpool_key_images	m_cursors->m_txc_txpool_key_images
 #define m_cur_hf_versions	m_cursors->m_txc_hf_versions
 
 typedef struct mdb_rflags
@@ -88,6 +92,7 @@ typedef struct mdb_rflags
   bool m_rf_spent_keys;
   bool m_rf_txpool_meta;
   bool m_rf_txpool_blob;
+  bool m_rf_txpool_key_images;
   bool m_rf_hf_versions;
 } mdb_rflags;
 
@@ -219,6 +224,8 @@ public:
 
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
 
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
   virtual uint64_t get_tx_count() const;
 
   virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
@@ -250,12 +257,16 @@ public:
   virtual txpool_tx_meta_t get_txpool_tx_meta(const crypto::hash& txid) const;
   virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const;
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
+  virtual bool get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const;
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false) const;
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const;
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const;
+  virtual bool for_blocks_range_parallel(uint64_t h1, uint64_t h2, std::function<bool(uint64_t height, const crypto::hash &hash, const cryptonote::blobdata *blob, const cryptonote::block *blk)> f, iteration_detail detail, unsigned num_threads = 0) const;
+  virtual bool for_all_transactions_parallel(std::function<bool(uint64_t height, const crypto::hash &tx_hash, const cryptonote::blobdata *blob, const cryptonote::transaction *tx)> f, iteration_detail detail, unsigned num_threads = 0) const;
+  virtual bool for_all_outputs_parallel(std::function<bool(uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data)> f, unsigned num_threads = 0) const;
 
   virtual uint64_t add_block( const block& blk
                             , const size_t& block_size
@@ -278,6 +289,8 @@ public:
 
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
 
+  virtual void pop_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs);
+
   virtual bool can_thread_bulk_indices() const { return true; }
 
   /**
@@ -295,8 +308,8 @@ private:
   void do_resize(uint64_t size_increase=0);
 
   bool need_resize(uint64_t threshold_size=0) const;
-  void check_and_resize_for_batch(uint64_t batch_num_blocks);
-  uint64_t get_estimated_batch_size(uint64_t batch_num_blocks) const;
+  void check_and_resize_for_batch(uint64_t block_size);
+  void batch_txn_begin();
 
   virtual void add_block( const block& blk
                 , const size_t& block_size
@@ -326,6 +339,9 @@ private:
 
   void remove_output(const uint64_t amount, const uint64_t& out_index);
 
+  // remove the top blocks and all they added, within the current write txn
+  void remove_blocks(uint64_t nblocks, std::vector<block>& blocks, std::vector<transaction>& txs);
+
   virtual void add_spent_key(const crypto::key_image& k_image);
 
   virtual void remove_spent_key(const crypto::key_image& k_image);
@@ -360,6 +376,43 @@ private:
 
   virtual bool is_read_only() const;
 
+  virtual uint32_t get_pruning_seed() const;
+
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0);
+
+  virtual bool get_blob_compression() const;
+
+  virtual bool set_blob_compression(bool enable);
+
+  virtual bool copy_compacted(const std::string &folder);
+
+  // the stored form of a block or tx blob, compressed if that helps
+  blobdata compress_blob(const blobdata &bd) const;
+
+  // the original block or tx blob from its stored form
+  void decompress_blob(const MDB_val &v, blobdata &bd) const;
+
+  // train a compression dictionary on a sample of the stored blobs
+  std::string train_blob_dictionary();
+
+  // rewrite the blobs in a table, compressed or not
+  void recompress_blobs(MDB_dbi dbi, const char *name, bool compress, uint64_t &raw_size, uint64_t &stored_size);
+
+  // height below which blocks outside the pruning stripe are pruned
+  uint64_t get_pruned_height(MDB_txn *txn) const;
+  void set_pruning_property(MDB_txn *txn, const char *name, uint64_t value);
+  bool is_tx_pruned(MDB_txn *txn, uint64_t block_height) const;
+
+  // replace the txes of the block at the given height with their unprunable part
+  void prune_block_txs(MDB_txn *txn, uint64_t block_height);
+
+  // map the output table, and rebuild it if it does not match the LMDB
+  void open_output_table();
+  void rebuild_output_table();
+
+  // stop using the output table after an aborted write
+  void invalidate_output_table();
+
   // fix up anything that may be wrong due to past bugs
   virtual void fixup();
 
@@ -389,14 +442,14 @@ private:
 
   MDB_dbi m_txpool_meta;
   MDB_dbi m_txpool_blob;
+  MDB_dbi m_txpool_key_images;
+  bool m_has_txpool_key_images; // false if opened read only before the table was added
 
   MDB_dbi m_hf_starting_heights;
   MDB_dbi m_hf_versions;
 
   MDB_dbi m_properties;
 
-  mutable uint64_t m_cum_size;	// used in batch size estimation
-  mutable unsigned int m_cum_count;
   std::string m_folder;
   mdb_txn_safe* m_write_txn; // may point to either a short-lived txn or a batch txn
   mdb_txn_safe* m_write_batch_txn; // persist batch txn outside of BlockchainLMDB
@@ -404,6 +457,12 @@ private:
 
   bool m_batch_transactions; // support for batch transactions
   bool m_batch_active; // whether batch transaction is in progress
+  uint64_t m_batch_size_estimate; // estimated space taken by what the current batch txn added
+  uint32_t m_pruning_seed; // stripe kept in full, or 0 if not pruned
+
+  output_table m_output_table; // flat copy of the output keys, if available
+
+  blob_compressor m_blob_compressor; // enabled if blobs are compressed
 
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
@@ -0,0 +1,329 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "output_table.h"
+
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.lmdb"
+
+namespace
+{
+
+const char OUTPUTS_FILENAME[] = "outputs.dat";
+const char RCT_OUTPUTS_FILENAME[] = "rct_outputs.dat";
+
+// Increase when the record layout changes, older tables are then rebuilt
+const uint32_t OUTPUT_TABLE_VERSION = 1;
+const uint64_t OUTPUT_TABLE_MAGIC = 0x31544e4b4f545559; // "YUTOKNT1"
+
+// files grow in chunks, to keep the number of ftruncate calls down
+const uint64_t GROWTH_SIZE = 64 * 1024 * 1024;
+
+// address space reserved for each file, enough for about three billion outputs
+const uint64_t OUTPUTS_RESERVED_SIZE = (uint64_t)1 << 38;
+const uint64_t RCT_OUTPUTS_RESERVED_SIZE = (uint64_t)1 << 35;
+
+template <typename T>
+inline void throw0(const T &e)
+{
+  LOG_PRINT_L0(e.what());
+  throw e;
+}
+
+}  // anonymous namespace
+
+namespace cryptonote
+{
+
+struct output_table::header
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t clean;
+  uint64_t num_outputs;
+  uint64_t num_rct_outputs;
+  crypto::hash top_hash;
+};
+
+output_table::output_table():
+  m_read_only(false),
+  m_outputs_fd(-1),
+  m_outputs_base(nullptr),
+  m_outputs_size(0),
+  m_rct_fd(-1),
+  m_rct_base(nullptr),
+  m_rct_size(0),
+  m_generation(0),
+  m_invalid(false)
+{
+  static_assert(sizeof(header) <= HEADER_SIZE, "Output table header does not fit");
+}
+
+output_table::~output_table()
+{
+  close();
+}
+
+bool output_table::map_file(const std::string &filename, uint64_t reserved, bool read_only, int &fd, uint8_t *&base, uint64_t &size)
+{
+#ifdef _WIN32
+  return false;
+#else
+  fd = ::open(filename.c_str(), read_only ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+  if (fd < 0)
+  {
+    MWARNING("Failed to open " << filename << ": " << strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    MWARNING("Failed to stat " << filename << ": " << strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  size = st.st_size;
+  // the mapping may extend past the end of the file, the pages there are only
+  // touched once the file has grown
+  void *addr = mmap(NULL, reserved, read_only ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (addr == MAP_FAILED)
+  {
+    MWARNING("Failed to map " << filename << ": " << strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  base = (uint8_t*)addr;
+  return true;
+#endif
+}
+
+void output_table::unmap_file(int &fd, uint8_t *&base, uint64_t &size, uint64_t reserved)
+{
+#ifndef _WIN32
+  if (base)
+    munmap(base, reserved);
+  if (fd >= 0)
+    ::close(fd);
+#endif
+  fd = -1;
+  base = nullptr;
+  size = 0;
+}
+
+void output_table::grow_file(int fd, uint64_t &size, uint64_t needed, uint64_t reserved)
+{
+#ifndef _WIN32
+  if (needed <= size)
+    return;
+  uint64_t new_size = std::max(needed, size + GROWTH_SIZE);
+  new_size = std::min(new_size, reserved);
+  if (needed > new_size)
+    throw0(DB_ERROR("Output table is full"));
+  if (ftruncate(fd, new_size) < 0)
+    throw0(DB_ERROR((std::string("Failed to grow output table: ") + strerror(errno)).c_str()));
+  size = new_size;
+#endif
+}
+
+void output_table::sync_file(uint8_t *base, uint64_t size)
+{
+#ifndef _WIN32
+  if (size > 0 && msync(base, size, MS_SYNC) < 0)
+    throw0(DB_ERROR((std::string("Failed to sync output table: ") + strerror(errno)).c_str()));
+#endif
+}
+
+bool output_table::open(const std::string &folder, bool read_only)
+{
+  if (sizeof(void*) < 8)
+  {
+    MINFO("Output table not available on 32 bit platforms");
+    return false;
+  }
+
+  close();
+  m_read_only = read_only;
+  m_invalid = false;
+
+  const std::vector<std::string> filenames = get_filenames(folder);
+  if (!map_file(filenames[0], OUTPUTS_RESERVED_SIZE, read_only, m_outputs_fd, m_outputs_base, m_outputs_size))
+    return false;
+  if (!map_file(filenames[1], RCT_OUTPUTS_RESERVED_SIZE, read_only, m_rct_fd, m_rct_base, m_rct_size))
+  {
+    close();
+    return false;
+  }
+
+  if (m_outputs_size < HEADER_SIZE)
+  {
+    if (read_only)
+    {
+      close();
+      return false;
+    }
+    // a new file, the zeroed header is not valid, so it will get rebuilt
+    grow_file(m_outputs_fd, m_outputs_size, HEADER_SIZE, OUTPUTS_RESERVED_SIZE);
+  }
+
+  return true;
+}
+
+void output_table::close()
+{
+  unmap_file(m_outputs_fd, m_outputs_base, m_outputs_size, OUTPUTS_RESERVED_SIZE);
+  unmap_file(m_rct_fd, m_rct_base, m_rct_size, RCT_OUTPUTS_RESERVED_SIZE);
+}
+
+bool output_table::is_valid(uint64_t num_outputs, uint64_t num_rct_outputs, const crypto::hash &top_hash) const
+{
+  if (!is_open())
+    return false;
+  const header *h = get_header();
+  return h->magic == OUTPUT_TABLE_MAGIC
+      && h->version == OUTPUT_TABLE_VERSION
+      && h->clean
+      && h->num_outputs == num_outputs
+      && h->num_rct_outputs == num_rct_outputs
+      && h->top_hash == top_hash
+      && m_outputs_size >= HEADER_SIZE + num_outputs * sizeof(output_table_entry)
+      && m_rct_size >= num_rct_outputs * sizeof(uint64_t);
+}
+
+void output_table::set_dirty()
+{
+  if (m_read_only)
+    throw0(DB_ERROR("Attempted to write to a read only output table"));
+  boost::lock_guard<boost::mutex> lock(m_header_lock);
+  ++m_generation;
+  header *h = get_header();
+  if (!h->clean)
+    return;
+  h->clean = 0;
+  sync_file(m_outputs_base, HEADER_SIZE);
+}
+
+uint64_t output_table::get_generation() const
+{
+  boost::lock_guard<boost::mutex> lock(m_header_lock);
+  return m_generation;
+}
+
+bool output_table::set_clean(uint64_t num_outputs, uint64_t num_rct_outputs, const crypto::hash &top_hash, uint64_t generation)
+{
+  if (m_read_only)
+    throw0(DB_ERROR("Attempted to write to a read only output table"));
+  // the records must be on disk before the header says they can be used
+  sync();
+  boost::lock_guard<boost::mutex> lock(m_header_lock);
+  if (generation != m_generation || m_invalid)
+    return false;
+  header *h = get_header();
+  h->num_outputs = num_outputs;
+  h->num_rct_outputs = num_rct_outputs;
+  h->top_hash = top_hash;
+  h->clean = 1;
+  sync_file(m_outputs_base, HEADER_SIZE);
+  return true;
+}
+
+void output_table::invalidate()
+{
+  m_invalid = true;
+  set_dirty();
+}
+
+void output_table::reset()
+{
+  if (m_read_only)
+    throw0(DB_ERROR("Attempted to write to a read only output table"));
+  boost::lock_guard<boost::mutex> lock(m_header_lock);
+  ++m_generation;
+  m_invalid = false;
+  header *h = get_header();
+  memset(h, 0, HEADER_SIZE);
+  h->magic = OUTPUT_TABLE_MAGIC;
+  h->version = OUTPUT_TABLE_VERSION;
+  sync_file(m_outputs_base, HEADER_SIZE);
+#ifndef _WIN32
+  // give the space back, stale records past the end would be ignored anyway
+  if (ftruncate(m_outputs_fd, HEADER_SIZE) == 0)
+    m_outputs_size = HEADER_SIZE;
+  if (ftruncate(m_rct_fd, 0) == 0)
+    m_rct_size = 0;
+#endif
+}
+
+void output_table::add(uint64_t output_id, uint64_t amount, uint64_t amount_index, const output_data_t &data)
+{
+  set_dirty();
+  grow_file(m_outputs_fd, m_outputs_size, HEADER_SIZE + (output_id + 1) * sizeof(output_table_entry), OUTPUTS_RESERVED_SIZE);
+  output_table_entry &e = reinterpret_cast<output_table_entry*>(m_outputs_base + HEADER_SIZE)[output_id];
+  e.data = data;
+  if (amount != 0)
+    memset(&e.data.commitment, 0, sizeof(e.data.commitment));
+  e.amount = amount;
+
+  if (amount == 0)
+  {
+    grow_file(m_rct_fd, m_rct_size, (amount_index + 1) * sizeof(uint64_t), RCT_OUTPUTS_RESERVED_SIZE);
+    reinterpret_cast<uint64_t*>(m_rct_base)[amount_index] = output_id;
+  }
+}
+
+void output_table::sync()
+{
+  if (!is_open() || m_read_only)
+    return;
+  sync_file(m_outputs_base, m_outputs_size);
+  sync_file(m_rct_base, m_rct_size);
+}
+
+std::vector<std::string> output_table::get_filenames(const std::string &folder)
+{
+  std::vector<std::string> filenames;
+  filenames.push_back((boost::filesystem::path(folder) / OUTPUTS_FILENAME).string());
+  filenames.push_back((boost::filesystem::path(folder) / RCT_OUTPUTS_FILENAME).string());
+  return filenames;
+}
+
+}  // namespace cryptonote
@@ -0,0 +1,198 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+
+#pragma pack(push, 1)
+/**
+ * @brief an output as stored in the output table
+ *
+ * Pre-RingCT outputs are stored with a zero commitment, the commitment is
+ * derived from the amount when read.
+ */
+struct output_table_entry
+{
+  output_data_t data;
+  uint64_t amount;
+};
+#pragma pack(pop)
+
+/**
+ * @brief A flat, memory-mapped copy of the output keys in the LMDB
+ *
+ * LMDB resolves a ring member with a dup-sorted lookup in the output amounts
+ * table, which costs a B-tree descent per member. This table keeps the same
+ * data as fixed size records in two files next to the LMDB, so a lookup is an
+ * array access:
+ *
+ * - outputs.dat: a header, followed by one output_table_entry per global
+ *   output index
+ * - rct_outputs.dat: the global output index of each RingCT output, by
+ *   amount index
+ *
+ * The table is only a cache: LMDB stays authoritative for which outputs exist,
+ * and callers must bound lookups by the LMDB output counts. The header records
+ * the LMDB state the table was last in sync with, and is marked dirty while the
+ * table is being written, so a table left behind by a crash or by an older
+ * version is detected on open and rebuilt from the LMDB.
+ *
+ * The whole address range a file may grow to is mapped once, so the mapping
+ * never moves and readers need no locking. Records for outputs removed when
+ * popping blocks are left in place and overwritten when new outputs are added.
+ * Only the process writing the LMDB uses the table: reset() truncates the files
+ * in place, so a read only database, such as a replica's, does not map them.
+ *
+ * Not available on Windows or 32 bit platforms, where open() fails and the
+ * LMDB falls back to its own tables.
+ */
+class output_table
+{
+public:
+  output_table();
+  ~output_table();
+
+  /**
+   * @brief maps the table files in the given folder
+   *
+   * The files are created if needed, unless read_only is set.
+   *
+   * @return false if the table cannot be used
+   */
+  bool open(const std::string &folder, bool read_only);
+
+  /**
+   * @brief unmaps the table files, without marking the table clean
+   */
+  void close();
+
+  bool is_open() const { return m_outputs_base != nullptr; }
+
+  /**
+   * @brief checks whether lookups and writes may use the table, see invalidate()
+   */
+  bool is_usable() const { return is_open() && !m_invalid; }
+
+  /**
+   * @brief checks whether the table was cleanly closed in the given state
+   */
+  bool is_valid(uint64_t num_outputs, uint64_t num_rct_outputs, const crypto::hash &top_hash) const;
+
+  /**
+   * @brief marks the table as being written, add() does so before each write
+   */
+  void set_dirty();
+
+  /**
+   * @brief counts the writes to the table, see set_clean()
+   */
+  uint64_t get_generation() const;
+
+  /**
+   * @brief syncs the table and records the LMDB state it matches
+   *
+   * The state must have been read after the given generation, and is only
+   * recorded if nothing was written to the table since.
+   *
+   * @return true if the table was marked clean
+   */
+  bool set_clean(uint64_t num_outputs, uint64_t num_rct_outputs, const crypto::hash &top_hash, uint64_t generation);
+
+  /**
+   * @brief leaves the table dirty until it is reset or reopened
+   *
+   * An aborted LMDB write may have overwritten records the LMDB still has, so
+   * the table can't be marked clean or read from again, and is rebuilt on the
+   * next open.
+   */
+  void invalidate();
+
+  /**
+   * @brief empties the table, and leaves it dirty
+   */
+  void reset();
+
+  void add(uint64_t output_id, uint64_t amount, uint64_t amount_index, const output_data_t &data);
+
+  /**
+   * @brief gets an output by global index, which must be lower than the LMDB output count
+   */
+  const output_table_entry &get(uint64_t output_id) const
+  {
+    return reinterpret_cast<const output_table_entry*>(m_outputs_base + HEADER_SIZE)[output_id];
+  }
+
+  /**
+   * @brief gets the global index of a RingCT output, which must be lower than the LMDB RingCT output count
+   */
+  uint64_t get_rct_output_id(uint64_t amount_index) const
+  {
+    return reinterpret_cast<const uint64_t*>(m_rct_base)[amount_index];
+  }
+
+  void sync();
+
+  static std::vector<std::string> get_filenames(const std::string &folder);
+
+private:
+  struct header;
+
+  header *get_header() const { return reinterpret_cast<header*>(m_outputs_base); }
+
+  static bool map_file(const std::string &filename, uint64_t reserved, bool read_only, int &fd, uint8_t *&base, uint64_t &size);
+  static void unmap_file(int &fd, uint8_t *&base, uint64_t &size, uint64_t reserved);
+  static void grow_file(int fd, uint64_t &size, uint64_t needed, uint64_t reserved);
+  static void sync_file(uint8_t *base, uint64_t size);
+
+  static const uint64_t HEADER_SIZE = 4096;
+
+  bool m_read_only;
+
+  int m_outputs_fd;
+  uint8_t *m_outputs_base;
+  uint64_t m_outputs_size;
+
+  int m_rct_fd;
+  uint8_t *m_rct_base;
+  uint64_t m_rct_size;
+
+  // the header can be marked clean at a sync from another thread than the writer's
+  mutable boost::mutex m_header_lock;
+  uint64_t m_generation;
+  std::atomic<bool> m_invalid;
+};
+
+}  // namespace cryptonote
@@ -0,0 +1,1460 @@
+// Copyright (c) 2014-2017, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "db_memory.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "crypto/crypto.h"
+#include "profile_tools.h"
+#include "ringct/rctOps.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.memory"
+
+using epee::string_tools::pod_to_hex;
+
+namespace
+{
+
+template <typename T>
+inline void throw0(const T &e)
+{
+  LOG_PRINT_L0(e.what());
+  throw e;
+}
+
+template <typename T>
+inline void throw1(const T &e)
+{
+  LOG_PRINT_L1(e.what());
+  throw e;
+}
+
+}  // anonymous namespace
+
+namespace cryptonote
+{
+
+BlockchainMemory::BlockchainMemory(bool batch_transactions)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  m_open = false;
+  m_pruning_seed = 0;
+  m_pruned_height = 0;
+  m_write_txn = false;
+  m_batch_transactions = batch_transactions;
+  m_batch_active = false;
+  m_hardfork = nullptr;
+}
+
+BlockchainMemory::~BlockchainMemory()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if (m_open)
+    close();
+}
+
+void BlockchainMemory::check_open() const
+{
+  if (!m_open)
+    throw0(DB_ERROR("DB operation attempted on a not-open DB instance"));
+}
+
+void BlockchainMemory::add_undo(std::function<void()> f)
+{
+  if (m_write_txn)
+    m_undo.push_back(std::move(f));
+}
+
+void BlockchainMemory::clear()
+{
+  m_blocks.clear();
+  m_block_heights.clear();
+  m_txs.clear();
+  m_tx_indices.clear();
+  m_outputs.clear();
+  m_output_amounts.clear();
+  m_spent_keys.clear();
+  m_txpool.clear();
+  m_txpool_key_images.clear();
+  m_hf_versions.clear();
+  m_pruning_seed = 0;
+  m_pruned_height = 0;
+  m_undo.clear();
+}
+
+void BlockchainMemory::open(const std::string& filename, const int db_flags)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  if (m_open)
+    throw0(DB_OPEN_FAILURE("Attempted to open db, but it's already open"));
+
+  // the filename is only used by on-disk implementations
+  clear();
+  m_open = true;
+}
+
+void BlockchainMemory::close()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+
+  m_write_txn = false;
+  m_batch_active = false;
+  clear();
+  m_open = false;
+}
+
+void BlockchainMemory::sync()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+}
+
+void BlockchainMemory::safesyncmode(const bool onoff)
+{
+}
+
+void BlockchainMemory::reset()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (m_write_txn)
+    throw0(DB_ERROR("Attempting to reset the db with a write txn in progress"));
+  clear();
+}
+
+std::vector<std::string> BlockchainMemory::get_filenames() const
+{
+  return std::vector<std::string>();
+}
+
+std::string BlockchainMemory::get_db_name() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  return std::string("memory");
+}
+
+bool BlockchainMemory::lock()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  return false;
+}
+
+void BlockchainMemory::unlock()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+}
+
+void BlockchainMemory::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
+    const crypto::hash& blk_hash)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  const uint64_t m_height = m_blocks.size();
+
+  if (m_block_heights.find(blk_hash) != m_block_heights.end())
+    throw1(BLOCK_EXISTS("Attempting to add block that's already in the db"));
+
+  if (m_height > 0)
+  {
+    auto parent = m_block_heights.find(blk.prev_id);
+    if (parent == m_block_heights.end())
+    {
+      LOG_PRINT_L3("m_height: " << m_height);
+      LOG_PRINT_L3("parent_key: " << blk.prev_id);
+      throw0(DB_ERROR("Failed to get top block hash to check for new block's parent"));
+    }
+    if (parent->second != m_height - 1)
+      throw0(BLOCK_PARENT_DNE("Top block is not new block's parent"));
+  }
+
+  mem_block mb;
+  mb.blob = block_to_blob(blk);
+  mb.hash = blk_hash;
+  mb.timestamp = blk.timestamp;
+  mb.coins = coins_generated;
+  mb.size = block_size;
+  mb.diff = cumulative_difficulty;
+  m_blocks.push_back(std::move(mb));
+  m_block_heights[blk_hash] = m_height;
+  add_undo([this, blk_hash]() { m_block_heights.erase(blk_hash); m_blocks.pop_back(); });
+
+  // a pruned database keeps pruning one block as each block is added, so the
+  // pruned area follows the tip
+  if (m_pruning_seed && m_pruned_height + m_pruning_tip_blocks <= m_height)
+  {
+    if (get_pruning_stripe(m_pruned_height) != m_pruning_seed)
+      prune_block_txs(m_pruned_height);
+    add_undo([this]() { --m_pruned_height; });
+    ++m_pruned_height;
+  }
+}
+
+void BlockchainMemory::remove_block()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+  const uint64_t m_height = m_blocks.size();
+
+  if (m_height == 0)
+    throw0(BLOCK_DNE ("Attempting to remove block from an empty blockchain"));
+
+  mem_block mb = std::move(m_blocks.back());
+  m_blocks.pop_back();
+  m_block_heights.erase(mb.hash);
+  add_undo([this, mb, m_height]() { m_block_heights[mb.hash] = m_height - 1; m_blocks.push_back(mb); });
+
+  // blocks added back at this height will have their txes in full
+  if (m_pruning_seed && m_pruned_height > m_height - 1)
+  {
+    const uint64_t pruned_height = m_pruned_height;
+    m_pruned_height = m_height - 1;
+    add_undo([this, pruned_height]() { m_pruned_height = pruned_height; });
+  }
+}
+
+uint64_t BlockchainMemory::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  const uint64_t tx_id = m_txs.size();
+
+  auto it = m_tx_indices.find(tx_hash);
+  if (it != m_tx_indices.end())
+    throw1(TX_EXISTS(std::string("Attempting to add transaction that's already in the db (tx id ").append(boost::lexical_cast<std::string>(it->second)).append(")").c_str()));
+
+  mem_tx mt;
+  mt.hash = tx_hash;
+  mt.blob = tx_to_blob(tx);
+  mt.unlock_time = tx.unlock_time;
+  mt.block_id = m_blocks.size();  // we don't need blk_hash since we know the height
+  mt.pruned = false;
+  m_txs.push_back(std::move(mt));
+  m_tx_indices[tx_hash] = tx_id;
+  add_undo([this, tx_hash]() { m_tx_indices.erase(tx_hash); m_txs.pop_back(); });
+
+  return tx_id;
+}
+
+void BlockchainMemory::remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  auto it = m_tx_indices.find(tx_hash);
+  if (it == m_tx_indices.end())
+    throw1(TX_DNE("Attempting to remove transaction that isn't in the db"));
+  const uint64_t tx_id = it->second;
+  // txes are only ever removed when popping blocks, so from the end
+  if (tx_id + 1 != m_txs.size())
+    throw0(DB_ERROR("Attempting to remove a transaction which is not the last one"));
+
+  remove_tx_outputs(tx_id, tx);
+
+  mem_tx mt = std::move(m_txs.back());
+  m_txs.pop_back();
+  m_tx_indices.erase(it);
+  add_undo([this, mt, tx_id]() { m_tx_indices[mt.hash] = tx_id; m_txs.push_back(mt); });
+}
+
+uint64_t BlockchainMemory::add_output(const crypto::hash& tx_hash,
+    const tx_out& tx_output,
+    const uint64_t& local_index,
+    const uint64_t unlock_time,
+    const rct::key *commitment)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (tx_output.target.type() != typeid(txout_to_key))
+    throw0(DB_ERROR("Wrong output type: expected txout_to_key"));
+  if (tx_output.amount == 0 && !commitment)
+    throw0(DB_ERROR("RCT output without commitment"));
+
+  std::vector<mem_amount_output> &amount_outputs = m_output_amounts[tx_output.amount];
+
+  mem_amount_output ao;
+  ao.output_id = m_outputs.size();
+  ao.data.pubkey = boost::get < txout_to_key > (tx_output.target).key;
+  ao.data.unlock_time = unlock_time;
+  ao.data.height = m_blocks.size();
+  ao.data.commitment = tx_output.amount == 0 ? *commitment : rct::zeroCommit(tx_output.amount);
+  const uint64_t amount_index = amount_outputs.size();
+  amount_outputs.push_back(ao);
+
+  m_outputs.push_back({tx_hash, local_index, tx_output.amount, amount_index});
+
+  const uint64_t amount = tx_output.amount;
+  add_undo([this, amount]() {
+    m_outputs.pop_back();
+    std::vector<mem_amount_output> &amount_outputs = m_output_amounts[amount];
+    amount_outputs.pop_back();
+    if (amount_outputs.empty())
+      m_output_amounts.erase(amount);
+  });
+
+  return amount_index;
+}
+
+void BlockchainMemory::add_tx_amount_output_indices(const uint64_t tx_id,
+    const std::vector<uint64_t>& amount_output_indices)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (tx_id >= m_txs.size())
+    throw0(DB_ERROR("Failed to add <tx hash, amount output index array>: tx not in db"));
+  // the tx is removed as a whole on undo, so the indices need no undo of their own
+  m_txs[tx_id].amount_output_indices = amount_output_indices;
+}
+
+void BlockchainMemory::remove_tx_outputs(const uint64_t tx_id, const transaction& tx)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  const std::vector<uint64_t> &amount_output_indices = m_txs[tx_id].amount_output_indices;
+
+  if (amount_output_indices.empty())
+  {
+    if (tx.vout.empty())
+      LOG_PRINT_L2("tx has no outputs, so no output indices");
+    else
+      throw0(DB_ERROR("tx has outputs, but no output indices found"));
+  }
+
+  bool is_pseudo_rct = tx.version >= 2 && tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+  for (size_t i = tx.vout.size(); i-- > 0;)
+  {
+    uint64_t amount = is_pseudo_rct ? 0 : tx.vout[i].amount;
+    remove_output(amount, amount_output_indices[i]);
+  }
+}
+
+void BlockchainMemory::remove_output(const uint64_t amount, const uint64_t& out_index)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  auto it = m_output_amounts.find(amount);
+  if (it == m_output_amounts.end() || out_index >= it->second.size())
+    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+  // outputs are only ever removed when popping blocks, so from the end
+  if (out_index + 1 != it->second.size() || it->second.back().output_id + 1 != m_outputs.size())
+    throw0(DB_ERROR(std::string("Error deleting output index ").append(boost::lexical_cast<std::string>(out_index)).append(": not the last output").c_str()));
+
+  const mem_amount_output ao = it->second.back();
+  const mem_output o = m_outputs.back();
+  it->second.pop_back();
+  if (it->second.empty())
+    m_output_amounts.erase(it);
+  m_outputs.pop_back();
+  add_undo([this, amount, ao, o]() { m_output_amounts[amount].push_back(ao); m_outputs.push_back(o); });
+}
+
+void BlockchainMemory::add_spent_key(const crypto::key_image& k_image)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (!m_spent_keys.insert(k_image).second)
+    throw1(KEY_IMAGE_EXISTS("Attempting to add spent key image that's already in the db"));
+  add_undo([this, k_image]() { m_spent_keys.erase(k_image); });
+}
+
+void BlockchainMemory::remove_spent_key(const crypto::key_image& k_image)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  check_open();
+
+  if (m_spent_keys.erase(k_image))
+    add_undo([this, k_image]() { m_spent_keys.insert(k_image); });
+}
+
+void BlockchainMemory::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t &meta)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  const crypto::hash txid = get_transaction_hash(tx);
+  if (m_txpool.find(txid) != m_txpool.end())
+    throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
+  m_txpool[txid] = std::make_pair(meta, tx_to_blob(tx));
+  std::vector<crypto::key_image> key_images;
+  for (const txin_v &in: tx.vin)
+    if (in.type() == typeid(txin_to_key))
+      key_images.push_back(boost::get<txin_to_key>(in).k_image);
+  if (key_images.size() == tx.vin.size())
+    m_txpool_key_images[txid] = std::move(key_images);
+  add_undo([this, txid]() { m_txpool.erase(txid); m_txpool_key_images.erase(txid); });
+}
+
+void BlockchainMemory::update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_txpool.find(txid);
+  if (it == m_txpool.end())
+    throw1(DB_ERROR("Error finding txpool tx meta to update"));
+  const txpool_tx_meta_t old_meta = it->second.first;
+  it->second.first = meta;
+  add_undo([this, txid, old_meta]() { m_txpool[txid].first = old_meta; });
+}
+
+uint64_t BlockchainMemory::get_txpool_tx_count() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return m_txpool.size();
+}
+
+bool BlockchainMemory::txpool_has_tx(const crypto::hash& txid) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return m_txpool.find(txid) != m_txpool.end();
+}
+
+void BlockchainMemory::remove_txpool_tx(const crypto::hash& txid)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_txpool.find(txid);
+  if (it == m_txpool.end())
+    return;
+  const std::pair<txpool_tx_meta_t, cryptonote::blobdata> entry = std::move(it->second);
+  m_txpool.erase(it);
+  std::vector<crypto::key_image> key_images;
+  auto ki = m_txpool_key_images.find(txid);
+  if (ki != m_txpool_key_images.end())
+  {
+    key_images = std::move(ki->second);
+    m_txpool_key_images.erase(ki);
+  }
+  add_undo([this, txid, entry, key_images]() { m_txpool[txid] = entry; m_txpool_key_images[txid] = key_images; });
+}
+
+txpool_tx_meta_t BlockchainMemory::get_txpool_tx_meta(const crypto::hash& txid) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_txpool.find(txid);
+  if (it == m_txpool.end())
+    throw1(DB_ERROR("Error finding txpool tx meta"));
+  return it->second.first;
+}
+
+bool BlockchainMemory::get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_txpool.find(txid);
+  if (it == m_txpool.end())
+    return false;
+  bd = it->second.second;
+  return true;
+}
+
+cryptonote::blobdata BlockchainMemory::get_txpool_tx_blob(const crypto::hash& txid) const
+{
+  cryptonote::blobdata bd;
+  if (!get_txpool_tx_blob(txid, bd))
+    throw1(DB_ERROR("Tx not found in txpool: "));
+  return bd;
+}
+
+bool BlockchainMemory::get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_txpool_key_images.find(txid);
+  if (it == m_txpool_key_images.end())
+    return false;
+  key_images = it->second;
+  return true;
+}
+
+bool BlockchainMemory::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const auto &e: m_txpool)
+  {
+    if (!f(e.first, e.second.first, include_blob ? &e.second.second : NULL))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::block_exists(const crypto::hash& h, uint64_t *height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_block_heights.find(h);
+  if (it == m_block_heights.end())
+  {
+    LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  if (height)
+    *height = it->second;
+  return true;
+}
+
+cryptonote::blobdata BlockchainMemory::get_block_blob(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return get_block_blob_from_height(get_block_height(h));
+}
+
+uint64_t BlockchainMemory::get_block_height(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_block_heights.find(h);
+  if (it == m_block_heights.end())
+    throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
+  return it->second;
+}
+
+block_header BlockchainMemory::get_block_header(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  // block_header object is automatically cast from block object
+  return get_block(h);
+}
+
+cryptonote::blobdata BlockchainMemory::get_block_blob_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+  return m_blocks[height].blob;
+}
+
+uint64_t BlockchainMemory::get_block_timestamp(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
+  return m_blocks[height].timestamp;
+}
+
+uint64_t BlockchainMemory::get_top_block_timestamp() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  // if no blocks, return 0
+  if (m_blocks.empty())
+    return 0;
+
+  return m_blocks.back().timestamp;
+}
+
+size_t BlockchainMemory::get_block_size(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+  return m_blocks[height].size;
+}
+
+difficulty_type BlockchainMemory::get_block_cumulative_difficulty(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__ << "  height: " << height);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
+  return m_blocks[height].diff;
+}
+
+difficulty_type BlockchainMemory::get_block_difficulty(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  difficulty_type diff1 = 0;
+  difficulty_type diff2 = 0;
+
+  diff1 = get_block_cumulative_difficulty(height);
+  if (height != 0)
+  {
+    diff2 = get_block_cumulative_difficulty(height - 1);
+  }
+
+  return diff1 - diff2;
+}
+
+uint64_t BlockchainMemory::get_block_already_generated_coins(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+  return m_blocks[height].coins;
+}
+
+crypto::hash BlockchainMemory::get_block_hash_from_height(const uint64_t& height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_blocks.size())
+    throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
+  return m_blocks[height].hash;
+}
+
+std::vector<block> BlockchainMemory::get_blocks_range(const uint64_t& h1, const uint64_t& h2) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+  std::vector<block> v;
+
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    v.push_back(get_block_from_height(height));
+  }
+
+  return v;
+}
+
+std::vector<crypto::hash> BlockchainMemory::get_hashes_range(const uint64_t& h1, const uint64_t& h2) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+  std::vector<crypto::hash> v;
+
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    v.push_back(get_block_hash_from_height(height));
+  }
+
+  return v;
+}
+
+crypto::hash BlockchainMemory::top_block_hash() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (m_blocks.empty())
+    return null_hash;
+  return m_blocks.back().hash;
+}
+
+block BlockchainMemory::get_top_block() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (!m_blocks.empty())
+  {
+    return get_block_from_height(m_blocks.size() - 1);
+  }
+
+  block b;
+  return b;
+}
+
+uint64_t BlockchainMemory::height() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return m_blocks.size();
+}
+
+bool BlockchainMemory::tx_exists(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (m_tx_indices.find(h) == m_tx_indices.end())
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_tx_indices.find(h);
+  if (it == m_tx_indices.end())
+  {
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
+  }
+  tx_id = it->second;
+  return true;
+}
+
+const mem_tx &BlockchainMemory::get_tx_entry(const crypto::hash& h) const
+{
+  auto it = m_tx_indices.find(h);
+  if (it == m_tx_indices.end())
+    throw1(TX_DNE(std::string("tx data with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+  return m_txs[it->second];
+}
+
+uint64_t BlockchainMemory::get_tx_unlock_time(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return get_tx_entry(h).unlock_time;
+}
+
+bool BlockchainMemory::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_tx_indices.find(h);
+  if (it == m_tx_indices.end())
+    return false;
+  const mem_tx &mt = m_txs[it->second];
+  // a pruned tx can't be given out as a whole
+  if (mt.pruned)
+    return false;
+  bd = mt.blob;
+  return true;
+}
+
+bool BlockchainMemory::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_tx_indices.find(h);
+  if (it == m_tx_indices.end())
+    return false;
+  const mem_tx &mt = m_txs[it->second];
+  if (mt.pruned)
+  {
+    bd = mt.blob;
+  }
+  else
+  {
+    if (!get_pruned_transaction_blob(mt.blob, bd))
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+  }
+  return true;
+}
+
+uint64_t BlockchainMemory::get_tx_count() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return m_txs.size();
+}
+
+std::vector<transaction> BlockchainMemory::get_tx_list(const std::vector<crypto::hash>& hlist) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+  std::vector<transaction> v;
+
+  for (auto& h : hlist)
+  {
+    v.push_back(get_tx(h));
+  }
+
+  return v;
+}
+
+uint64_t BlockchainMemory::get_tx_block_height(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return get_tx_entry(h).block_id;
+}
+
+uint64_t BlockchainMemory::get_num_outputs(const uint64_t& amount) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_output_amounts.find(amount);
+  if (it == m_output_amounts.end())
+    return 0;
+  return it->second.size();
+}
+
+output_data_t BlockchainMemory::get_output_key(const uint64_t &global_index) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (global_index >= m_outputs.size())
+    throw1(OUTPUT_DNE("output with given index not in db"));
+  const mem_output &o = m_outputs[global_index];
+  return m_output_amounts.find(o.amount)->second[o.amount_index].data;
+}
+
+output_data_t BlockchainMemory::get_output_key(const uint64_t& amount, const uint64_t& index)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  auto it = m_output_amounts.find(amount);
+  if (it == m_output_amounts.end() || index >= it->second.size())
+    throw1(OUTPUT_DNE("Attempting to get output pubkey by index, but key does not exist"));
+  return it->second[index].data;
+}
+
+void BlockchainMemory::get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  TIME_MEASURE_START(db3);
+  check_open();
+  outputs.clear();
+
+  auto it = m_output_amounts.find(amount);
+  const size_t num_outputs = it == m_output_amounts.end() ? 0 : it->second.size();
+  for (const uint64_t &index : offsets)
+  {
+    if (index >= num_outputs)
+    {
+      if (allow_partial)
+      {
+        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
+        break;
+      }
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(index) + ", count " + boost::lexical_cast<std::string>(num_outputs) + "), but key does not exist").c_str()));
+    }
+    outputs.push_back(it->second[index].data);
+  }
+
+  TIME_MEASURE_FINISH(db3);
+  LOG_PRINT_L3("db3: " << db3);
+}
+
+tx_out_index BlockchainMemory::get_output_tx_and_index_from_global(const uint64_t& output_id) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (output_id >= m_outputs.size())
+    throw1(OUTPUT_DNE("output with given index not in db"));
+  const mem_output &o = m_outputs[output_id];
+  return tx_out_index(o.tx_hash, o.local_index);
+}
+
+tx_out_index BlockchainMemory::get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  std::vector < uint64_t > offsets;
+  std::vector<tx_out_index> indices;
+  offsets.push_back(index);
+  get_output_tx_and_index(amount, offsets, indices);
+  if (!indices.size())
+    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+
+  return indices[0];
+}
+
+void BlockchainMemory::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+  indices.clear();
+
+  auto it = m_output_amounts.find(amount);
+  for (const uint64_t &index : offsets)
+  {
+    if (it == m_output_amounts.end() || index >= it->second.size())
+      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
+    const mem_output &o = m_outputs[it->second[index].output_id];
+    indices.push_back(tx_out_index(o.tx_hash, o.local_index));
+  }
+}
+
+std::vector<uint64_t> BlockchainMemory::get_tx_amount_output_indices(const uint64_t tx_id) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (tx_id >= m_txs.size())
+    throw0(DB_ERROR("DB error attempting to get data for tx_outputs[tx_index]"));
+  return m_txs[tx_id].amount_output_indices;
+}
+
+bool BlockchainMemory::has_key_image(const crypto::key_image& img) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  return m_spent_keys.find(img) != m_spent_keys.end();
+}
+
+bool BlockchainMemory::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const crypto::key_image &k_image: m_spent_keys)
+  {
+    if (!f(k_image))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (uint64_t height = h1; height < m_blocks.size(); ++height)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(m_blocks[height].blob, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    if (!f(height, m_blocks[height].hash, b))
+      return false;
+    if (height >= h2)
+      break;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const mem_tx &mt: m_txs)
+  {
+    transaction tx;
+    bool r = mt.pruned ? parse_and_validate_tx_base_from_blob(mt.blob, tx) : parse_and_validate_tx_from_blob(mt.blob, tx);
+    if (!r)
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    if (!f(mt.hash, tx))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const auto &e: m_output_amounts)
+  {
+    for (const mem_amount_output &ao: e.second)
+    {
+      const mem_output &o = m_outputs[ao.output_id];
+      if (!f(e.first, o.tx_hash, o.local_index))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_blocks_range_parallel(uint64_t h1, uint64_t h2, std::function<bool(uint64_t height, const crypto::hash &hash, const cryptonote::blobdata *blob, const cryptonote::block *blk)> f, iteration_detail detail, unsigned num_threads) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (uint64_t height = h1; height <= h2 && height < m_blocks.size(); ++height)
+  {
+    block b;
+    if (detail == iterate_parsed && !parse_and_validate_block_from_blob(m_blocks[height].blob, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    if (!f(height, m_blocks[height].hash, detail != iterate_keys ? &m_blocks[height].blob : NULL, detail == iterate_parsed ? &b : NULL))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_transactions_parallel(std::function<bool(uint64_t height, const crypto::hash &tx_hash, const cryptonote::blobdata *blob, const cryptonote::transaction *tx)> f, iteration_detail detail, unsigned num_threads) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const mem_tx &mt: m_txs)
+  {
+    transaction tx;
+    if (detail == iterate_parsed)
+    {
+      bool r = mt.pruned ? parse_and_validate_tx_base_from_blob(mt.blob, tx) : parse_and_validate_tx_from_blob(mt.blob, tx);
+      if (!r)
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+      if (mt.pruned)
+      {
+        tx.hash = mt.hash;
+        tx.set_hash_valid(true);
+      }
+    }
+    if (!f(mt.block_id, mt.hash, detail != iterate_keys ? &mt.blob : NULL, detail == iterate_parsed ? &tx : NULL))
+      return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::for_all_outputs_parallel(std::function<bool(uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data)> f, unsigned num_threads) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  for (const auto &e: m_output_amounts)
+  {
+    for (size_t i = 0; i < e.second.size(); ++i)
+    {
+      if (!f(e.first, i, e.second[i].output_id, e.second[i].data))
+        return false;
+    }
+  }
+  return true;
+}
+
+void BlockchainMemory::set_batch_transactions(bool batch_transactions)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  if ((batch_transactions) && (m_batch_transactions))
+  {
+    LOG_PRINT_L0("WARNING: batch transaction mode already enabled, but asked to enable batch mode");
+  }
+  m_batch_transactions = batch_transactions;
+  LOG_PRINT_L3("batch transactions " << (m_batch_transactions ? "enabled" : "disabled"));
+}
+
+// there is nothing to commit in memory, so a batch only needs to let block
+// txns nest inside it
+bool BlockchainMemory::batch_start(uint64_t batch_num_blocks)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (m_batch_active)
+    return false;
+  if (m_write_txn)
+    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
+  check_open();
+
+  m_writer = boost::this_thread::get_id();
+  m_batch_active = true;
+  LOG_PRINT_L3("batch transaction: begin");
+  return true;
+}
+
+void BlockchainMemory::batch_stop()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+
+  m_batch_active = false;
+  LOG_PRINT_L3("batch transaction: end");
+}
+
+void BlockchainMemory::block_txn_start(bool readonly)
+{
+  // reads are serialized by m_lock, so there is no read txn to set up
+  if (readonly)
+    return;
+
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (! m_batch_active && m_write_txn)
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ")+__FUNCTION__).c_str()));
+  if (m_batch_active && m_writer != boost::this_thread::get_id())
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when batch txn already exists in ")+__FUNCTION__).c_str()));
+  if (m_write_txn)
+    return;
+
+  m_writer = boost::this_thread::get_id();
+  m_undo.clear();
+  m_write_txn = true;
+}
+
+void BlockchainMemory::block_txn_stop()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    m_undo.clear();
+    m_write_txn = false;
+  }
+}
+
+void BlockchainMemory::block_txn_abort()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    m_write_txn = false;
+    for (auto i = m_undo.rbegin(); i != m_undo.rend(); ++i)
+      (*i)();
+    m_undo.clear();
+  }
+}
+
+uint64_t BlockchainMemory::add_block(const block& blk, const size_t& block_size, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
+    const std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+  uint64_t m_height = height();
+
+  try
+  {
+    BlockchainDB::add_block(blk, block_size, cumulative_difficulty, coins_generated, txs);
+  }
+  catch (DB_ERROR_TXN_START& e)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    block_txn_abort();
+    throw;
+  }
+
+  return ++m_height;
+}
+
+void BlockchainMemory::pop_block(block& blk, std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  block_txn_start(false);
+
+  try
+  {
+    BlockchainDB::pop_block(blk, txs);
+    block_txn_stop();
+  }
+  catch (...)
+  {
+    block_txn_abort();
+    throw;
+  }
+}
+
+std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainMemory::get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram;
+
+  if (amounts.empty())
+  {
+    for (const auto &e: m_output_amounts)
+      histogram[e.first] = std::make_tuple(e.second.size(), 0, 0);
+  }
+  else
+  {
+    for (const auto &amount: amounts)
+      histogram[amount] = std::make_tuple(get_num_outputs(amount), 0, 0);
+  }
+
+  if (unlocked || recent_cutoff > 0) {
+    const uint64_t blockchain_height = height();
+    for (std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>::iterator i = histogram.begin(); i != histogram.end(); ++i) {
+      uint64_t amount = i->first;
+      uint64_t num_elems = std::get<0>(i->second);
+      while (num_elems > 0) {
+        const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
+        const uint64_t height = get_tx_block_height(toi.first);
+        if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
+          break;
+        --num_elems;
+      }
+      // modifying second does not invalidate the iterator
+      std::get<1>(i->second) = num_elems;
+
+      if (recent_cutoff > 0)
+      {
+        uint64_t recent = 0;
+        while (num_elems > 0) {
+          const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
+          const uint64_t height = get_tx_block_height(toi.first);
+          const uint64_t ts = get_block_timestamp(height);
+          if (ts < recent_cutoff)
+            break;
+          --num_elems;
+          ++recent;
+        }
+        // modifying second does not invalidate the iterator
+        std::get<2>(i->second) = recent;
+      }
+    }
+  }
+
+  return histogram;
+}
+
+void BlockchainMemory::check_hard_fork_info()
+{
+}
+
+void BlockchainMemory::drop_hard_fork_info()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  m_hf_versions.clear();
+}
+
+void BlockchainMemory::set_hard_fork_version(uint64_t height, uint8_t version)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  const size_t old_size = m_hf_versions.size();
+  if (height >= old_size)
+  {
+    m_hf_versions.resize(height + 1, 0);
+    add_undo([this, old_size]() { m_hf_versions.resize(old_size); });
+  }
+  else
+  {
+    const uint8_t old_version = m_hf_versions[height];
+    add_undo([this, height, old_version]() { m_hf_versions[height] = old_version; });
+  }
+  m_hf_versions[height] = version;
+}
+
+uint8_t BlockchainMemory::get_hard_fork_version(uint64_t height) const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (height >= m_hf_versions.size())
+    throw0(DB_ERROR(std::string("Error attempting to retrieve a hard fork version at height ").append(boost::lexical_cast<std::string>(height)).append(" from the db").c_str()));
+  return m_hf_versions[height];
+}
+
+bool BlockchainMemory::is_read_only() const
+{
+  return false;
+}
+
+uint32_t BlockchainMemory::get_pruning_seed() const
+{
+  return m_pruning_seed;
+}
+
+void BlockchainMemory::prune_block_txs(uint64_t block_height)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  block b;
+  if (!parse_and_validate_block_from_blob(m_blocks[block_height].blob, b))
+    throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+  // the miner tx has nothing prunable
+  for (const crypto::hash &tx_hash : b.tx_hashes)
+  {
+    auto it = m_tx_indices.find(tx_hash);
+    if (it == m_tx_indices.end())
+      throw0(DB_ERROR(std::string("Failed to get tx index to prune for ").append(epee::string_tools::pod_to_hex(tx_hash)).c_str()));
+    const uint64_t tx_id = it->second;
+    mem_tx &mt = m_txs[tx_id];
+    if (mt.pruned)
+      continue;
+
+    blobdata pruned;
+    if (!get_pruned_transaction_blob(mt.blob, pruned))
+      throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    if (pruned.size() == mt.blob.size())
+      continue;
+
+    std::swap(mt.blob, pruned);
+    mt.pruned = true;
+    add_undo([this, tx_id, pruned]() { m_txs[tx_id].blob = pruned; m_txs[tx_id].pruned = false; });
+  }
+}
+
+bool BlockchainMemory::prune_blockchain(uint32_t pruning_seed)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  CRITICAL_REGION_LOCAL(m_lock);
+  check_open();
+
+  if (pruning_seed > CRYPTONOTE_PRUNING_STRIPES)
+  {
+    MERROR("Invalid pruning stripe " << pruning_seed << ", must be between 1 and " << CRYPTONOTE_PRUNING_STRIPES);
+    return false;
+  }
+  if (m_pruning_seed && pruning_seed && pruning_seed != m_pruning_seed)
+  {
+    MERROR("Database is already pruned, keeping pruning stripe " << m_pruning_seed);
+    return false;
+  }
+  if (m_write_txn)
+    throw0(DB_ERROR("Attempting to prune the database with a write transaction in progress"));
+
+  if (m_pruning_seed)
+    pruning_seed = m_pruning_seed;
+  else if (!pruning_seed)
+    pruning_seed = crypto::rand<uint32_t>() % CRYPTONOTE_PRUNING_STRIPES + 1;
+
+  const uint64_t blockchain_height = m_blocks.size();
+  const uint64_t prune_to = blockchain_height > m_pruning_tip_blocks ? blockchain_height - m_pruning_tip_blocks : 0;
+
+  MGINFO("Pruning blockchain up to height " << prune_to << ", keeping pruning stripe " << pruning_seed);
+  m_pruning_seed = pruning_seed;
+  for (; m_pruned_height < prune_to; ++m_pruned_height)
+  {
+    if (get_pruning_stripe(m_pruned_height) != pruning_seed)
+      prune_block_txs(m_pruned_height);
+  }
+
+  return true;
+}
+
+bool BlockchainMemory::get_blob_compression() const
+{
+  return false;
+}
+
+bool BlockchainMemory::set_blob_compression(bool enable)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  // there is no disk space to save
+  if (enable)
+  {
+    MERROR("Blob compression is not supported by the memory db");
+    return false;
+  }
+  return true;
+}
+
+bool BlockchainMemory::copy_compacted(const std::string &folder)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+  MERROR("Compaction is not supported by the memory db");
+  return false;
+}
+
+}  // namespace cryptonote
@@ -0,0 +1,310 @@
+// Copyright (c) 2014-2017, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "blockchain_db/blockchain_db.h"
+#include "cryptonote_protocol/blobdatatype.h" // for type blobdata
+#include "ringct/rctTypes.h"
+#include <boost/thread/thread.hpp>
+
+namespace cryptonote
+{
+
+struct mem_block
+{
+  cryptonote::blobdata blob;
+  crypto::hash hash;
+  uint64_t timestamp;
+  uint64_t coins;
+  uint64_t size;
+  difficulty_type diff;
+};
+
+struct mem_tx
+{
+  crypto::hash hash;
+  cryptonote::blobdata blob; // only the unprunable part if pruned
+  uint64_t unlock_time;
+  uint64_t block_id;
+  std::vector<uint64_t> amount_output_indices;
+  bool pruned;
+};
+
+struct mem_output
+{
+  crypto::hash tx_hash;
+  uint64_t local_index;
+  uint64_t amount;
+  uint64_t amount_index;
+};
+
+struct mem_amount_output
+{
+  uint64_t output_id;
+  output_data_t data;
+};
+
+/**
+ * @brief A BlockchainDB which keeps everything in memory
+ *
+ * Nothing is written to disk, and the contents are lost when the db is
+ * closed. This is meant for tests and benchmarks, where it avoids the disk
+ * and the page cache, and a fresh chain is wanted for each run.
+ *
+ * Block-level write transactions keep an undo log so an aborted block leaves
+ * no trace. Batch transactions have nothing to commit, so they only track
+ * whether a batch is active.
+ */
+class BlockchainMemory : public BlockchainDB
+{
+public:
+  BlockchainMemory(bool batch_transactions=false);
+  ~BlockchainMemory();
+
+  virtual void open(const std::string& filename, const int db_flags=0);
+
+  virtual void close();
+
+  virtual void sync();
+
+  virtual void safesyncmode(const bool onoff);
+
+  virtual void reset();
+
+  virtual std::vector<std::string> get_filenames() const;
+
+  virtual std::string get_db_name() const;
+
+  virtual bool lock();
+
+  virtual void unlock();
+
+  virtual bool block_exists(const crypto::hash& h, uint64_t *height = NULL) const;
+
+  virtual uint64_t get_block_height(const crypto::hash& h) const;
+
+  virtual block_header get_block_header(const crypto::hash& h) const;
+
+  virtual cryptonote::blobdata get_block_blob(const crypto::hash& h) const;
+
+  virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
+
+  virtual uint64_t get_block_timestamp(const uint64_t& height) const;
+
+  virtual uint64_t get_top_block_timestamp() const;
+
+  virtual size_t get_block_size(const uint64_t& height) const;
+
+  virtual difficulty_type get_block_cumulative_difficulty(const uint64_t& height) const;
+
+  virtual difficulty_type get_block_difficulty(const uint64_t& height) const;
+
+  virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const;
+
+  virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const;
+
+  virtual std::vector<block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const;
+
+  virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const;
+
+  virtual crypto::hash top_block_hash() const;
+
+  virtual block get_top_block() const;
+
+  virtual uint64_t height() const;
+
+  virtual bool tx_exists(const crypto::hash& h) const;
+  virtual bool tx_exists(const crypto::hash& h, uint64_t& tx_index) const;
+
+  virtual uint64_t get_tx_unlock_time(const crypto::hash& h) const;
+
+  virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+
+  virtual uint64_t get_tx_count() const;
+
+  virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
+
+  virtual uint64_t get_tx_block_height(const crypto::hash& h) const;
+
+  virtual uint64_t get_num_outputs(const uint64_t& amount) const;
+
+  virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index);
+  virtual output_data_t get_output_key(const uint64_t& global_index) const;
+  virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false);
+
+  virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
+
+  virtual tx_out_index get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const;
+  virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const;
+
+  virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const;
+
+  virtual bool has_key_image(const crypto::key_image& img) const;
+
+  virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& meta);
+  virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
+  virtual uint64_t get_txpool_tx_count() const;
+  virtual bool txpool_has_tx(const crypto::hash &txid) const;
+  virtual void remove_txpool_tx(const crypto::hash& txid);
+  virtual txpool_tx_meta_t get_txpool_tx_meta(const crypto::hash& txid) const;
+  virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const;
+  virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
+  virtual bool get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const;
+  virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false) const;
+
+  virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
+  virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
+  virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const;
+  virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const;
+
+  // these run on the calling thread, as there are no read txns to spread
+  // over threads, and the lock is held throughout
+  virtual bool for_blocks_range_parallel(uint64_t h1, uint64_t h2, std::function<bool(uint64_t height, const crypto::hash &hash, const cryptonote::blobdata *blob, const cryptonote::block *blk)> f, iteration_detail detail, unsigned num_threads = 0) const;
+  virtual bool for_all_transactions_parallel(std::function<bool(uint64_t height, const crypto::hash &tx_hash, const cryptonote::blobdata *blob, const cryptonote::transaction *tx)> f, iteration_detail detail, unsigned num_threads = 0) const;
+  virtual bool for_all_outputs_parallel(std::function<bool(uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data)> f, unsigned num_threads = 0) const;
+
+  virtual uint64_t add_block( const block& blk
+                            , const size_t& block_size
+                            , const difficulty_type& cumulative_difficulty
+                            , const uint64_t& coins_generated
+                            , const std::vector<transaction>& txs
+                            );
+
+  virtual void set_batch_transactions(bool batch_transactions);
+  virtual bool batch_start(uint64_t batch_num_blocks=0);
+  virtual void batch_stop();
+
+  virtual void block_txn_start(bool readonly);
+  virtual void block_txn_stop();
+  virtual void block_txn_abort();
+
+  virtual void pop_block(block& blk, std::vector<transaction>& txs);
+
+  virtual bool can_thread_bulk_indices() const { return true; }
+
+  virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const;
+
+  virtual bool is_read_only() const;
+
+  virtual uint32_t get_pruning_seed() const;
+
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0);
+
+  virtual bool get_blob_compression() const;
+
+  virtual bool set_blob_compression(bool enable);
+
+  virtual bool copy_compacted(const std::string &folder);
+
+private:
+  virtual void add_block( const block& blk
+                , const size_t& block_size
+                , const difficulty_type& cumulative_difficulty
+                , const uint64_t& coins_generated
+                , const crypto::hash& block_hash
+                );
+
+  virtual void remove_block();
+
+  virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash);
+
+  virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx);
+
+  virtual uint64_t add_output(const crypto::hash& tx_hash,
+      const tx_out& tx_output,
+      const uint64_t& local_index,
+      const uint64_t unlock_time,
+      const rct::key *commitment
+      );
+
+  virtual void add_tx_amount_output_indices(const uint64_t tx_id,
+      const std::vector<uint64_t>& amount_output_indices
+      );
+
+  void remove_tx_outputs(const uint64_t tx_id, const transaction& tx);
+
+  void remove_output(const uint64_t amount, const uint64_t& out_index);
+
+  virtual void add_spent_key(const crypto::key_image& k_image);
+
+  virtual void remove_spent_key(const crypto::key_image& k_image);
+
+  // Hard fork
+  virtual void set_hard_fork_version(uint64_t height, uint8_t version);
+  virtual uint8_t get_hard_fork_version(uint64_t height) const;
+  virtual void check_hard_fork_info();
+  virtual void drop_hard_fork_info();
+
+  void check_open() const;
+
+  const mem_tx &get_tx_entry(const crypto::hash& h) const;
+
+  // replace the txes of the block at the given height with their unprunable part
+  void prune_block_txs(uint64_t block_height);
+
+  // records how to revert a change, if a block-level write txn is active
+  void add_undo(std::function<void()> f);
+
+  void clear();
+
+  std::vector<mem_block> m_blocks;
+  std::unordered_map<crypto::hash, uint64_t> m_block_heights;
+
+  std::vector<mem_tx> m_txs;
+  std::unordered_map<crypto::hash, uint64_t> m_tx_indices;
+
+  std::vector<mem_output> m_outputs;
+  std::map<uint64_t, std::vector<mem_amount_output>> m_output_amounts;
+
+  std::unordered_set<crypto::key_image> m_spent_keys;
+
+  std::unordered_map<crypto::hash, std::pair<txpool_tx_meta_t, cryptonote::blobdata>> m_txpool;
+  std::unordered_map<crypto::hash, std::vector<crypto::key_image>> m_txpool_key_images;
+
+  std::vector<uint8_t> m_hf_versions;
+
+  uint32_t m_pruning_seed; // stripe kept in full, or 0 if not pruned
+  uint64_t m_pruned_height; // height below which blocks outside the stripe are pruned
+
+  mutable epee::critical_section m_lock;
+  boost::thread::id m_writer;
+  std::vector<std::function<void()>> m_undo;
+  bool m_write_txn; // whether a block-level write txn is active
+
+  bool m_batch_transactions; // support for batch transactions
+  bool m_batch_active; // whether batch transaction is in progress
+};
+
+}  // namespace cryptonote
@@ -54,6 +54,7 @@ int main(int argc, char* argv[])
   uint32_t log_level = 0;
   uint64_t block_stop = 0;
   bool blocks_dat = false;
+  bool indexed = false;
 
   tools::sanitize_locale();
 
@@ -75,6 +76,7 @@ int main(int argc, char* argv[])
     "database", available_dbs.c_str(), default_db_type
   };
   const command_line::arg_descriptor<bool> arg_blocks_dat = {"blocksdat", "Output in blocks.dat format", blocks_dat};
+  const command_line::arg_descriptor<bool> arg_indexed = {"indexed", "Output in indexed, compressed bootstrap format", indexed};
 
 
   command_line::add_arg(desc_cmd_sett, command_line::arg_data_dir, default_data_path.string());
@@ -85,6 +87,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
   command_line::add_arg(desc_cmd_sett, arg_blocks_dat);
+  command_line::add_arg(desc_cmd_sett, arg_indexed);
 
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
@@ -119,6 +122,12 @@ int main(int argc, char* argv[])
 
   bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
   bool opt_blocks_dat = command_line::get_arg(vm, arg_blocks_dat);
+  bool opt_indexed = command_line::get_arg(vm, arg_indexed);
+  if (opt_blocks_dat && opt_indexed)
+  {
+    std::cerr << "blocksdat and indexed cannot be used together" << std::endl;
+    return 1;
+  }
 
   std::string m_config_folder;
 
@@ -190,7 +199,7 @@ int main(int argc, char* argv[])
   else
   {
     BootstrapFile bootstrap;
-    r = bootstrap.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
+    r = bootstrap.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop, opt_indexed);
   }
   CHECK_AND_ASSERT_MES(r, false, "Failed to export blockchain raw data");
   LOG_PRINT_L0("Blockchain raw data exported OK");
@@ -29,10 +29,16 @@
 #include <atomic>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "misc_log_ex.h"
+#include "profile_tools.h"
+#include "common/thread_group.h"
+#include "common/task_region.h"
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -135,14 +141,11 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
     core.get_blockchain_storage().get_db().batch_start();
 
   int quit = 0;
-  block popped_block;
+  std::vector<block> popped_blocks;
   std::vector<transaction> popped_txs;
-  for (int i=0; i < num_blocks; ++i)
-  {
-    // simple_core.m_storage.pop_block_from_blockchain() is private, so call directly through db
-    core.get_blockchain_storage().get_db().pop_block(popped_block, popped_txs);
-    quit = 1;
-  }
+  // simple_core.m_storage.pop_blocks_from_blockchain() is private, so call directly through db
+  core.get_blockchain_storage().get_db().pop_blocks(num_blocks, popped_blocks, popped_txs);
+  quit = 1;
 
 
   if (use_batch)
@@ -162,6 +165,94 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
+// blocks/second of each stage of the import, reported at each flush
+struct import_stats
+{
+  std::atomic<uint64_t> read_blocks;
+  std::atomic<uint64_t> read_ms;
+  uint64_t tx_blocks;
+  uint64_t tx_ms;
+  uint64_t block_blocks;
+  uint64_t block_ms;
+} stats;
+
+double blocks_per_second(uint64_t blocks, uint64_t ms)
+{
+  return ms ? blocks * 1000.0 / ms : 0.0;
+}
+
+void print_stats()
+{
+  MINFO("blocks/s:  read " << blocks_per_second(stats.read_blocks, stats.read_ms)
+      << "  txes " << blocks_per_second(stats.tx_blocks, stats.tx_ms)
+      << "  blocks " << blocks_per_second(stats.block_blocks, stats.block_ms));
+}
+
+// blocks read and decoded ahead of the importer, in height order
+struct read_chunk_entry
+{
+  uint64_t first_height;
+  std::vector<bootstrap::block_package> blocks;
+};
+
+class read_chunk_queue
+{
+public:
+  read_chunk_queue(uint64_t max_blocks): m_max_blocks(max_blocks), m_blocks(0), m_done(false), m_stop(false) {}
+
+  // returns false once the importer has stopped
+  bool push(read_chunk_entry &&chunk)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_blocks >= m_max_blocks && !m_stop)
+      m_cond.wait(lock);
+    if (m_stop)
+      return false;
+    m_blocks += chunk.blocks.size();
+    m_chunks.push_back(std::move(chunk));
+    m_cond.notify_all();
+    return true;
+  }
+
+  // returns false once the reader is done and everything was popped
+  bool pop(read_chunk_entry &chunk)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_chunks.empty() && !m_done)
+      m_cond.wait(lock);
+    if (m_chunks.empty())
+      return false;
+    chunk = std::move(m_chunks.front());
+    m_chunks.pop_front();
+    m_blocks -= chunk.blocks.size();
+    m_cond.notify_all();
+    return true;
+  }
+
+  void set_done()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_done = true;
+    m_cond.notify_all();
+  }
+
+  void stop()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_stop = true;
+    m_cond.notify_all();
+  }
+
+private:
+  boost::mutex m_mutex;
+  boost::condition_variable m_cond;
+  std::deque<read_chunk_entry> m_chunks;
+  const uint64_t m_max_blocks;
+  uint64_t m_blocks;
+  bool m_done;
+  bool m_stop;
+};
+
 int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks, bool force)
 {
   if (blocks.empty())
@@ -169,26 +260,37 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
   if (!force && blocks.size() < db_batch_size)
     return 0;
 
+  // this computes the PoW of the blocks in parallel
   core.prepare_handle_incoming_blocks(blocks);
 
+  // the txes of all the blocks are checked together, so their semantics are
+  // checked in parallel. They are kept by block, so their inputs are only
+  // checked as their block is added.
+  TIME_MEASURE_START(tx_time);
+  std::list<blobdata> tx_blobs;
   for(const block_complete_entry& block_entry: blocks)
+    tx_blobs.insert(tx_blobs.end(), block_entry.txs.begin(), block_entry.txs.end());
+  std::vector<tx_verification_context> tvcs;
+  core.handle_incoming_txs(tx_blobs, tvcs, true, true, false);
+  auto tx_blob = tx_blobs.begin();
+  for (const tx_verification_context &tvc: tvcs)
   {
-    // process transactions
-    for(auto& tx_blob: block_entry.txs)
+    if(tvc.m_verifivation_failed)
     {
-      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      core.handle_incoming_tx(tx_blob, tvc, true, true, false);
-      if(tvc.m_verifivation_failed)
-      {
-        MERROR("transaction verification failed, tx_id = "
-            << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)));
-        core.cleanup_handle_incoming_blocks();
-        return 1;
-      }
+      MERROR("transaction verification failed, tx_id = "
+          << epee::string_tools::pod_to_hex(get_blob_hash(*tx_blob)));
+      core.cleanup_handle_incoming_blocks();
+      return 1;
     }
+    ++tx_blob;
+  }
+  TIME_MEASURE_FINISH(tx_time);
+  stats.tx_blocks += blocks.size();
+  stats.tx_ms += tx_time;
 
-    // process block
-
+  TIME_MEASURE_START(block_time);
+  for(const block_complete_entry& block_entry: blocks)
+  {
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
     core.handle_incoming_block(block_entry.block, bvc, false); // <--- process block
@@ -210,98 +312,90 @@ int check_flush(cryptonote::core &core, std::list<block_complete_entry> &blocks,
   } // each download block
   if (!core.cleanup_handle_incoming_blocks())
     return 1;
+  TIME_MEASURE_FINISH(block_time);
+  stats.block_blocks += blocks.size();
+  stats.block_ms += block_time;
+
+  std::cout << refresh_string;
+  print_stats();
 
   blocks.clear();
   return 0;
 }
 
-int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
+// adds a block read from the bootstrap file, or queues it to be verified
+int add_block_package(cryptonote::core &core, const bootstrap::block_package &bp, uint64_t height, std::list<block_complete_entry> &blocks, bool use_batch)
 {
-  // Reset stats, in case we're using newly created db, accumulating stats
-  // from addition of genesis block.
-  // This aligns internal db counts with importer counts.
-  core.get_blockchain_storage().get_db().reset_stats();
-
-  boost::filesystem::path fs_import_file_path(import_file_path);
-  boost::system::error_code ec;
-  if (!boost::filesystem::exists(fs_import_file_path, ec))
+  if (opt_verify)
   {
-    MFATAL("bootstrap file not found: " << fs_import_file_path);
-    return false;
+    cryptonote::blobdata block;
+    cryptonote::block_to_blob(bp.block, block);
+    std::list<cryptonote::blobdata> txs;
+    for (const auto &tx: bp.txs)
+    {
+      txs.push_back(cryptonote::blobdata());
+      cryptonote::tx_to_blob(tx, txs.back());
+    }
+    blocks.push_back({block, txs});
+    return check_flush(core, blocks, false);
   }
 
-  BootstrapFile bootstrap;
-  // BootstrapFile bootstrap(import_file_path);
-  uint64_t total_source_blocks = bootstrap.count_blocks(import_file_path);
-  MINFO("bootstrap file last block number: " << total_source_blocks-1 << " (zero-based height)  total blocks: " << total_source_blocks);
-
-  std::cout << ENDL;
-  std::cout << "Preparing to read blocks..." << ENDL;
-  std::cout << ENDL;
-
-  std::ifstream import_file;
-  import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
+  // add_block() adds the coinbase tx itself, so only the others are passed
+  TIME_MEASURE_START(block_time);
+  try
+  {
+    core.get_blockchain_storage().get_db().add_block(bp.block, bp.block_size, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << refresh_string;
+    MFATAL("Error adding block to blockchain: " << e.what());
+    return 1;
+  }
+  TIME_MEASURE_FINISH(block_time);
+  ++stats.block_blocks;
+  stats.block_ms += block_time;
 
-  uint64_t h = 0;
-  uint64_t num_imported = 0;
-  if (import_file.fail())
+  if (use_batch)
   {
-    MFATAL("import_file.open() fail");
-    return false;
+    if (height % db_batch_size == 0)
+    {
+      std::cout << refresh_string;
+      // zero-based height
+      std::cout << ENDL << "[- batch commit at height " << height << " -]" << ENDL;
+      core.get_blockchain_storage().get_db().batch_stop();
+      core.get_blockchain_storage().get_db().batch_start(db_batch_size);
+      std::cout << ENDL;
+      core.get_blockchain_storage().get_db().show_stats();
+      print_stats();
+    }
   }
+  return 0;
+}
 
+// reads the legacy format, one block per chunk, from the start of the file
+bool read_legacy_chunks(BootstrapFile& bootstrap, std::ifstream& import_file, uint64_t start_height, uint64_t block_stop, read_chunk_queue& queue)
+{
   // 4 byte magic + (currently) 1024 byte header structures
   bootstrap.seek_to_first_chunk(import_file);
 
   std::string str1;
   char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
-  block b;
-  transaction tx;
-  int quit = 0;
+  std::vector<char> buffer_block(BUFFER_SIZE);
   uint64_t bytes_read = 0;
+  uint64_t h = 0;
 
-  uint64_t start_height = 1;
-  if (opt_resume)
-    start_height = core.get_blockchain_storage().get_current_blockchain_height();
-
-  // Note that a new blockchain will start with block number 0 (total blocks: 1)
-  // due to genesis block being added at initialization.
-
-  if (! block_stop)
-  {
-    block_stop = total_source_blocks - 1;
-  }
-
-  // These are what we'll try to use, and they don't have to be a determination
-  // from source and destination blockchains, but those are the defaults.
-  MINFO("start block: " << start_height << "  stop block: " <<
-      block_stop);
-
-  bool use_batch = opt_batch && !opt_verify;
-
-  if (use_batch)
-    core.get_blockchain_storage().get_db().batch_start(db_batch_size);
-
-  MINFO("Reading blockchain from bootstrap file...");
-  std::cout << ENDL;
-
-  std::list<block_complete_entry> blocks;
-
-  // Within the loop, we skip to start_height before we start adding.
   // TODO: Not a bottleneck, but we can use what's done in count_blocks() and
   // only do the chunk size reads, skipping the chunk content reads until we're
   // at start_height.
-  while (! quit)
+  while (h <= block_stop)
   {
+    TIME_MEASURE_START(read_time);
     uint32_t chunk_size;
     import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
     if (! import_file) {
-      std::cout << refresh_string;
       MINFO("End of file reached");
-      quit = 1;
-      break;
+      return true;
     }
     bytes_read += sizeof(chunk_size);
 
@@ -323,163 +417,226 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     }
     else if (chunk_size == 0) {
       MFATAL("ERROR: chunk_size == 0");
-      return 2;
+      return false;
     }
-    import_file.read(buffer_block, chunk_size);
+    import_file.read(buffer_block.data(), chunk_size);
     if (! import_file) {
       if (import_file.eof())
       {
-        std::cout << refresh_string;
         MINFO("End of file reached - file was truncated");
-        quit = 1;
-        break;
+        return true;
       }
       else
       {
         MFATAL("ERROR: unexpected end of file: bytes read before error: "
             << import_file.gcount() << " of chunk_size " << chunk_size);
-        return 2;
+        return false;
       }
     }
     bytes_read += chunk_size;
     MDEBUG("Total bytes read: " << bytes_read);
 
+    // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
     if (h + NUM_BLOCKS_PER_CHUNK < start_height + 1)
     {
       h += NUM_BLOCKS_PER_CHUNK;
       continue;
     }
-    if (h > block_stop)
+
+    read_chunk_entry chunk;
+    chunk.first_height = h;
+    chunk.blocks.resize(1);
+    str1.assign(buffer_block.data(), chunk_size);
+    if (! ::serialization::parse_binary(str1, chunk.blocks.front()))
+      throw std::runtime_error("Error in deserialization of chunk");
+    h += NUM_BLOCKS_PER_CHUNK;
+    TIME_MEASURE_FINISH(read_time);
+    ++stats.read_blocks;
+    stats.read_ms += read_time;
+
+    if (!queue.push(std::move(chunk)))
+      return true;
+  }
+  MINFO("Specified block number reached - stopping.  block: " << block_stop);
+  return true;
+}
+
+// The chunk index lets this start reading at the chunk holding start_height,
+// and stop at the one holding block_stop. Chunks are decoded in parallel, a
+// few at a time, each with its own stream.
+bool read_indexed_chunks(BootstrapFile& bootstrap, const std::string& import_file_path, const bootstrap::chunk_index& index, uint64_t start_height, uint64_t block_stop, read_chunk_queue& queue)
+{
+  tools::thread_group tpool(tools::thread_group::optimal());
+  const size_t chunks_per_round = tpool.count() + 1;
+
+  auto chunk = std::lower_bound(index.chunks.begin(), index.chunks.end(), start_height,
+      [](const bootstrap::chunk_info &ci, uint64_t height) { return ci.block_last < height; });
+  while (chunk != index.chunks.end() && chunk->block_first <= block_stop)
+  {
+    TIME_MEASURE_START(read_time);
+    std::vector<const bootstrap::chunk_info*> round;
+    for (; chunk != index.chunks.end() && chunk->block_first <= block_stop && round.size() < chunks_per_round; ++chunk)
+      round.push_back(&*chunk);
+
+    std::vector<read_chunk_entry> entries(round.size());
+    std::unique_ptr<bool[]> ok(new bool[round.size()]);
+    tools::task_region(tpool, [&] (tools::task_region_handle& region) {
+      for (size_t i = 0; i < round.size(); ++i)
+      {
+        region.run([&, i] {
+          std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+          entries[i].first_height = round[i]->block_first;
+          ok[i] = !import_file.fail() && bootstrap.read_chunk(import_file, *round[i], entries[i].blocks);
+        });
+      }
+    });
+    TIME_MEASURE_FINISH(read_time);
+    stats.read_ms += read_time;
+
+    for (size_t i = 0; i < round.size(); ++i)
     {
-      std::cout << refresh_string << "block " << h-1
-        << " / " << block_stop
-        << std::flush;
-      std::cout << ENDL << ENDL;
-      MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
+      if (!ok[i])
+      {
+        MFATAL("Error reading chunk for blocks " << round[i]->block_first << "-" << round[i]->block_last);
+        return false;
+      }
+      // only keep the blocks in the requested range
+      read_chunk_entry &entry = entries[i];
+      const uint64_t last = std::min(round[i]->block_last, block_stop);
+      if (last < round[i]->block_last)
+        entry.blocks.resize(last - entry.first_height + 1);
+      if (entry.first_height < start_height)
+      {
+        entry.blocks.erase(entry.blocks.begin(), entry.blocks.begin() + (start_height - entry.first_height));
+        entry.first_height = start_height;
+      }
+      stats.read_blocks += entry.blocks.size();
+      if (!queue.push(std::move(entry)))
+        return true;
     }
+  }
+  return true;
+}
+
+// A reader thread reads and decodes blocks ahead, while this thread verifies
+// and adds them in order.
+int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
+{
+  // Reset stats, in case we're using newly created db, accumulating stats
+  // from addition of genesis block.
+  // This aligns internal db counts with importer counts.
+  core.get_blockchain_storage().get_db().reset_stats();
+
+  boost::filesystem::path fs_import_file_path(import_file_path);
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(fs_import_file_path, ec))
+  {
+    MFATAL("bootstrap file not found: " << fs_import_file_path);
+    return false;
+  }
+
+  BootstrapFile bootstrap;
+  // BootstrapFile bootstrap(import_file_path);
+  uint64_t total_source_blocks = bootstrap.count_blocks(import_file_path);
+  MINFO("bootstrap file last block number: " << total_source_blocks-1 << " (zero-based height)  total blocks: " << total_source_blocks);
+
+  std::cout << ENDL;
+  std::cout << "Preparing to read blocks..." << ENDL;
+  std::cout << ENDL;
+
+  std::ifstream import_file;
+  import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
+
+  uint64_t h = 0;
+  uint64_t num_imported = 0;
+  if (import_file.fail())
+  {
+    MFATAL("import_file.open() fail");
+    return false;
+  }
+
+  bootstrap::chunk_index index;
+  const bool indexed = bootstrap.read_chunk_index(import_file, index);
+  import_file.seekg(0);
+
+  int quit = 0;
+
+  uint64_t start_height = 1;
+  if (opt_resume)
+    start_height = core.get_blockchain_storage().get_current_blockchain_height();
+
+  // Note that a new blockchain will start with block number 0 (total blocks: 1)
+  // due to genesis block being added at initialization.
+
+  if (! block_stop || block_stop >= total_source_blocks)
+  {
+    block_stop = total_source_blocks - 1;
+  }
+
+  // These are what we'll try to use, and they don't have to be a determination
+  // from source and destination blockchains, but those are the defaults.
+  MINFO("start block: " << start_height << "  stop block: " <<
+      block_stop);
 
+  bool use_batch = opt_batch && !opt_verify;
+
+  if (use_batch)
+    core.get_blockchain_storage().get_db().batch_start(db_batch_size);
+
+  MINFO("Reading blockchain from " << (indexed ? "indexed " : "") << "bootstrap file...");
+  std::cout << ENDL;
+
+  // enough to fill the next batch while the current one is verified
+  read_chunk_queue queue(std::max<uint64_t>(db_batch_size, NUM_BLOCKS_PER_INDEXED_CHUNK));
+  std::atomic<bool> read_ok(true);
+  boost::thread reader([&]() {
     try
     {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      if (! ::serialization::parse_binary(str1, bp))
-        throw std::runtime_error("Error in deserialization of chunk");
-
-      int display_interval = 1000;
-      int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
-      {
-        ++h;
-        if ((h-1) % display_interval == 0)
-        {
-          std::cout << refresh_string;
-          MDEBUG("loading block number " << h-1);
-        }
-        else
-        {
-          MDEBUG("loading block number " << h-1);
-        }
-        b = bp.block;
-        MDEBUG("block prev_id: " << b.prev_id << ENDL);
-
-        if ((h-1) % progress_interval == 0)
-        {
-          std::cout << refresh_string << "block " << h-1
-            << " / " << block_stop
-            << std::flush;
-        }
-
-        if (opt_verify)
-        {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::list<cryptonote::blobdata> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back(cryptonote::blobdata());
-            cryptonote::tx_to_blob(tx, txs.back());
-          }
-          blocks.push_back({block, txs});
-          int ret = check_flush(core, blocks, false);
-          if (ret)
-          {
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-        }
-        else
-        {
-          std::vector<transaction> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
-          // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (transaction tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-
-          size_t block_size;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-
-          block_size = bp.block_size;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-
-          try
-          {
-            core.get_blockchain_storage().get_db().add_block(b, block_size, cumulative_difficulty, coins_generated, txs);
-          }
-          catch (const std::exception& e)
-          {
-            std::cout << refresh_string;
-            MFATAL("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-
-          if (use_batch)
-          {
-            if ((h-1) % db_batch_size == 0)
-            {
-              std::cout << refresh_string;
-              // zero-based height
-              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-              core.get_blockchain_storage().get_db().batch_stop();
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size);
-              std::cout << ENDL;
-              core.get_blockchain_storage().get_db().show_stats();
-            }
-          }
-        }
-        ++num_imported;
-      }
+      if (indexed)
+        read_ok = read_indexed_chunks(bootstrap, import_file_path, index, start_height, block_stop, queue);
+      else
+        read_ok = read_legacy_chunks(bootstrap, import_file, start_height, block_stop, queue);
     }
     catch (const std::exception& e)
     {
-      std::cout << refresh_string;
-      MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
+      MFATAL("exception while reading from file: " << e.what());
+      read_ok = false;
     }
-  } // while
+    queue.set_done();
+  });
 
+  std::list<block_complete_entry> blocks;
+  read_chunk_entry chunk;
+  const int progress_interval = 10;
+  while (!quit && queue.pop(chunk))
+  {
+    for (size_t i = 0; i < chunk.blocks.size(); ++i)
+    {
+      const uint64_t height = chunk.first_height + i;
+      MDEBUG("loading block number " << height);
+      if (height % progress_interval == 0)
+      {
+        std::cout << refresh_string << "block " << height
+          << " / " << block_stop
+          << std::flush;
+      }
+
+      if (add_block_package(core, chunk.blocks[i], height, blocks, use_batch))
+      {
+        quit = 2; // make sure we don't commit partial block data
+        break;
+      }
+      ++num_imported;
+      h = height + 1;
+    }
+  }
+  queue.stop();
+  reader.join();
   import_file.close();
+  if (!read_ok)
+    quit = 2;
 
-  if (opt_verify)
+  if (opt_verify && quit < 2)
   {
     int ret = check_flush(core, blocks, true);
     if (ret)
@@ -499,14 +656,16 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     }
   }
 
+  std::cout << refresh_string;
   core.get_blockchain_storage().get_db().show_stats();
+  print_stats();
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
     // TODO: if there was an error, the last added block is probably at zero-based height h-2
     MINFO("Finished at block: " << h-1 << "  total blocks: " << h);
 
   std::cout << ENDL;
-  return 0;
+  return quit > 1 ? 2 : 0;
 }
 
 int main(int argc, char* argv[])
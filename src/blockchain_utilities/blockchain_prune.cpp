@@ -0,0 +1,193 @@
+// Copyright (c) 2014-2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/command_line.h"
+#include "common/util.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/db_types.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  std::string default_db_type = "lmdb";
+
+  std::string available_dbs = cryptonote::blockchain_db_types(", ");
+  available_dbs = "available: " + available_dbs;
+
+  uint32_t log_level = 0;
+
+  tools::sanitize_locale();
+
+  boost::filesystem::path default_data_path {tools::get_default_data_dir()};
+  boost::filesystem::path default_testnet_data_path {default_data_path / "testnet"};
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint32_t> arg_pruning_stripe = {"pruning-stripe", "Stripe of blocks to keep in full, from 1 to 8, or 0 to pick one at random", 0};
+  const command_line::arg_descriptor<bool>     arg_no_compact = {"no-compact", "Do not compact the database after pruning, which needs free disk space for a copy of the pruned database. The pruned space is then only reused for new blocks, the database file does not shrink", false};
+  const command_line::arg_descriptor<bool>     arg_testnet_on = {
+    "testnet"
+      , "Run on testnet."
+      , false
+  };
+  const command_line::arg_descriptor<std::string> arg_database = {
+    "database", available_dbs.c_str(), default_db_type
+  };
+
+  command_line::add_arg(desc_cmd_sett, command_line::arg_data_dir, default_data_path.string());
+  command_line::add_arg(desc_cmd_sett, command_line::arg_testnet_data_dir, default_testnet_data_path.string());
+  command_line::add_arg(desc_cmd_sett, arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_database);
+  command_line::add_arg(desc_cmd_sett, arg_pruning_stripe);
+  command_line::add_arg(desc_cmd_sett, arg_no_compact);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("intense-blockchain-prune.log"), true);
+  if (!vm["log-level"].defaulted())
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  LOG_PRINT_L0("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
+  uint32_t pruning_stripe = command_line::get_arg(vm, arg_pruning_stripe);
+  bool opt_no_compact = command_line::get_arg(vm, arg_no_compact);
+  if (pruning_stripe > CRYPTONOTE_PRUNING_STRIPES)
+  {
+    std::cerr << "Invalid pruning stripe: " << pruning_stripe << std::endl;
+    return 1;
+  }
+
+  auto data_dir_arg = opt_testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir;
+  std::string m_config_folder = command_line::get_arg(vm, data_dir_arg);
+
+  std::string db_type = command_line::get_arg(vm, arg_database);
+  if (!cryptonote::blockchain_valid_db_type(db_type))
+  {
+    std::cerr << "Invalid database type: " << db_type << std::endl;
+    return 1;
+  }
+
+  // pruning works on the stored txes directly, so there is no need to go
+  // through Blockchain here
+  BlockchainDB* db = new_db(db_type);
+  if (db == NULL)
+  {
+    LOG_ERROR("Attempted to use non-existent database type: " << db_type);
+    throw std::runtime_error("Attempting to use non-existent database type");
+  }
+  LOG_PRINT_L0("database: " << db_type);
+
+  boost::filesystem::path folder(m_config_folder);
+  folder /= db->get_db_name();
+  const std::string filename = folder.string();
+
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, 0);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+  if (!db->m_open)
+  {
+    LOG_PRINT_L0("Failed to open database");
+    return 1;
+  }
+
+  r = db->prune_blockchain(pruning_stripe);
+
+  // the pruned space stays in the database file until it is compacted
+  const boost::filesystem::path compact_folder = folder / "compact";
+  bool compacted = false;
+  if (r && !opt_no_compact)
+  {
+    boost::filesystem::remove_all(compact_folder);
+    boost::filesystem::create_directory(compact_folder);
+    LOG_PRINT_L0("Writing a compacted copy of the database to " << compact_folder.string() << " ...");
+    compacted = db->copy_compacted(compact_folder.string());
+    if (!compacted)
+      boost::filesystem::remove_all(compact_folder);
+  }
+  db->close();
+  delete db;
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to prune blockchain");
+
+  if (compacted)
+  {
+    for (boost::filesystem::directory_iterator i(compact_folder), end; i != end; ++i)
+      boost::filesystem::rename(i->path(), folder / i->path().filename());
+    boost::filesystem::remove_all(compact_folder);
+    LOG_PRINT_L0("Blockchain pruned and compacted OK");
+  }
+  else
+  {
+    LOG_PRINT_L0("Blockchain pruned OK, but not compacted: the database file keeps its size, and the pruned space is reused for new blocks");
+  }
+  return 0;
+
+  CATCH_ENTRY("Pruning error", 1);
+}
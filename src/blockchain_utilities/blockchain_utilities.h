@@ -36,5 +36,9 @@
 #define BUFFER_SIZE 2000000
 #define CHUNK_SIZE_WARNING_THRESHOLD 500000
 #define NUM_BLOCKS_PER_CHUNK 1
+#define NUM_BLOCKS_PER_INDEXED_CHUNK 1000
+#define INDEXED_CHUNK_TARGET_SIZE 8000000
+// a chunk is flushed once past the target, so the last block may overshoot it
+#define MAX_INDEXED_CHUNK_SIZE (INDEXED_CHUNK_TARGET_SIZE + BUFFER_SIZE)
 #define BLOCKCHAIN_RAW "blockchain.raw"
 
@@ -0,0 +1,578 @@
+// Copyright (c) 2014-2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "profile_tools.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/difficulty.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/db_types.h"
+#include "ringct/rctSigs.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+// workers take this many blocks at a time, so the heavier recent blocks
+// get spread over all threads
+#define BLOCKS_PER_SHARD 256
+
+// past this, errors are only counted
+#define MAX_LOGGED_ERRORS 100
+
+#define PROGRESS_INTERVAL_SECONDS 10
+
+namespace
+{
+
+const uint64_t UNKNOWN_TX_INDEX = std::numeric_limits<uint64_t>::max();
+
+struct verify_state
+{
+  BlockchainDB *db;
+  uint64_t height;
+  bool verify_pow;
+  bool verify_signatures;
+
+  std::atomic<uint64_t> next_shard;
+  std::atomic<uint64_t> blocks_done;
+  std::atomic<uint64_t> errors;
+
+  // the tx index and tx count of each block, tx indices must follow the
+  // chain order, which is checked once all shards are done
+  std::vector<uint64_t> first_tx_index;
+  std::vector<uint64_t> tx_count;
+
+  // guards the totals below, added to once per shard
+  boost::mutex totals_lock;
+  std::map<uint64_t, uint64_t> outputs_per_amount;
+  uint64_t inputs;
+};
+
+// totals for a single shard
+struct shard_totals
+{
+  std::map<uint64_t, uint64_t> outputs_per_amount;
+  uint64_t inputs = 0;
+};
+
+void report(verify_state &state, uint64_t height, const std::string &message)
+{
+  if (++state.errors <= MAX_LOGGED_ERRORS)
+    MERROR("Block " << height << ": " << message);
+}
+
+#define REPORT(height, x) do { std::stringstream ss; ss << x; report(state, height, ss.str()); } while(0)
+
+bool verify_tx_signatures(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &rings)
+{
+  if (rings.empty() || rings.size() != tx.vin.size())
+    return false;
+
+  if (tx.version == 1)
+  {
+    if (tx.signatures.size() != tx.vin.size())
+      return false;
+    for (size_t n = 0; n < tx.vin.size(); ++n)
+    {
+      std::vector<const crypto::public_key *> keys;
+      for (const rct::ctkey &key: rings[n])
+        keys.push_back(&(const crypto::public_key&)key.dest);
+      if (tx.signatures[n].size() != keys.size())
+        return false;
+      if (!crypto::check_ring_signature(tx_prefix_hash, boost::get<txin_to_key>(tx.vin[n]).k_image, keys, tx.signatures[n].data()))
+        return false;
+    }
+    return true;
+  }
+
+  // rebuild what the signatures do not store, as Blockchain::expand_transaction_2 does
+  rct::rctSig &rv = tx.rct_signatures;
+  if (rv.outPk.size() != tx.vout.size())
+    return false;
+  for (size_t n = 0; n < tx.vout.size(); ++n)
+    rv.outPk[n].dest = rct::pk2rct(boost::get<txout_to_key>(tx.vout[n].target).key);
+  rv.message = rct::hash2rct(tx_prefix_hash);
+  if (rv.type == rct::RCTTypeFull)
+  {
+    rv.mixRing.clear();
+    rv.mixRing.resize(rings[0].size());
+    for (size_t n = 0; n < rings.size(); ++n)
+    {
+      if (rings[n].size() != rings[0].size())
+        return false;
+      for (size_t m = 0; m < rings[n].size(); ++m)
+        rv.mixRing[m].push_back(rings[n][m]);
+    }
+    if (rv.p.MGs.size() != 1)
+      return false;
+    rv.p.MGs[0].II.resize(tx.vin.size());
+    for (size_t n = 0; n < tx.vin.size(); ++n)
+      rv.p.MGs[0].II[n] = rct::ki2rct(boost::get<txin_to_key>(tx.vin[n]).k_image);
+    return rct::verRct(rv);
+  }
+  if (rv.type == rct::RCTTypeSimple)
+  {
+    rv.mixRing = rings;
+    if (rv.p.MGs.size() != tx.vin.size())
+      return false;
+    for (size_t n = 0; n < tx.vin.size(); ++n)
+    {
+      rv.p.MGs[n].II.resize(1);
+      rv.p.MGs[n].II[0] = rct::ki2rct(boost::get<txin_to_key>(tx.vin[n]).k_image);
+    }
+    return rct::verRctSimple(rv);
+  }
+  return false;
+}
+
+void verify_tx(verify_state &state, uint64_t height, const crypto::hash &tx_hash, uint64_t expected_tx_index, bool miner_tx, shard_totals &totals)
+{
+  BlockchainDB &db = *state.db;
+
+  uint64_t tx_index;
+  if (!db.tx_exists(tx_hash, tx_index))
+  {
+    REPORT(height, "tx " << tx_hash << " is not in the tx index");
+    return;
+  }
+  if (expected_tx_index != UNKNOWN_TX_INDEX && tx_index != expected_tx_index)
+    REPORT(height, "tx " << tx_hash << " has index " << tx_index << ", expected " << expected_tx_index);
+  if (db.get_tx_block_height(tx_hash) != height)
+    REPORT(height, "tx " << tx_hash << " is indexed at block " << db.get_tx_block_height(tx_hash));
+
+  // only a pruned database may lack the prunable data
+  transaction tx;
+  crypto::hash tx_prefix_hash = null_hash;
+  cryptonote::blobdata blob;
+  bool pruned = false;
+  if (db.get_tx_blob(tx_hash, blob))
+  {
+    crypto::hash computed_hash;
+    if (!parse_and_validate_tx_from_blob(blob, tx, computed_hash, tx_prefix_hash))
+    {
+      REPORT(height, "failed to parse tx " << tx_hash);
+      return;
+    }
+    if (computed_hash != tx_hash)
+      REPORT(height, "tx " << tx_hash << " is stored with the blob of tx " << computed_hash);
+  }
+  else if (db.get_pruning_seed() && db.get_pruned_tx_blob(tx_hash, blob))
+  {
+    if (!parse_and_validate_tx_base_from_blob(blob, tx))
+    {
+      REPORT(height, "failed to parse pruned tx " << tx_hash);
+      return;
+    }
+    pruned = true;
+  }
+  else
+  {
+    REPORT(height, "tx " << tx_hash << " has no blob");
+    return;
+  }
+
+  if (db.get_tx_unlock_time(tx_hash) != tx.unlock_time)
+    REPORT(height, "tx " << tx_hash << " has a mismatched unlock time");
+
+  // each output must be where its amount output index says, and nowhere else,
+  // which the per amount counts check once all shards are done
+  const std::vector<uint64_t> amount_output_indices = db.get_tx_amount_output_indices(tx_index);
+  if (amount_output_indices.size() != tx.vout.size())
+  {
+    REPORT(height, "tx " << tx_hash << " has " << amount_output_indices.size() << " amount output indices for " << tx.vout.size() << " outputs");
+  }
+  else
+  {
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      const tx_out &out = tx.vout[i];
+      if (out.target.type() != typeid(txout_to_key))
+      {
+        REPORT(height, "tx " << tx_hash << " has an unsupported output type");
+        continue;
+      }
+
+      // see BlockchainDB::add_transaction
+      uint64_t amount = out.amount;
+      rct::key commitment = rct::zero();
+      if (tx.version > 1)
+      {
+        amount = 0;
+        if (miner_tx)
+          commitment = rct::zeroCommit(out.amount);
+        else if (i < tx.rct_signatures.outPk.size())
+          commitment = tx.rct_signatures.outPk[i].mask;
+        else
+          REPORT(height, "tx " << tx_hash << " has fewer commitments than outputs");
+      }
+      ++totals.outputs_per_amount[amount];
+
+      const tx_out_index toi = db.get_output_tx_and_index(amount, amount_output_indices[i]);
+      if (toi.first != tx_hash || toi.second != i)
+        REPORT(height, "output " << i << " of tx " << tx_hash << " is indexed as output " << toi.second << " of tx " << toi.first);
+
+      const output_data_t od = db.get_output_key(amount, amount_output_indices[i]);
+      if (od.pubkey != boost::get<txout_to_key>(out.target).key)
+        REPORT(height, "output " << i << " of tx " << tx_hash << " has a mismatched key");
+      if (od.unlock_time != tx.unlock_time || od.height != height)
+        REPORT(height, "output " << i << " of tx " << tx_hash << " has a mismatched unlock time or height");
+      if (tx.version > 1 && !(od.commitment == commitment))
+        REPORT(height, "output " << i << " of tx " << tx_hash << " has a mismatched commitment");
+    }
+  }
+
+  // inputs must be spent, and their ring members must exist in older blocks
+  std::vector<std::vector<rct::ctkey>> rings;
+  for (const txin_v &in: tx.vin)
+  {
+    if (in.type() == typeid(txin_gen))
+    {
+      if (!miner_tx)
+        REPORT(height, "tx " << tx_hash << " has a coinbase input");
+      continue;
+    }
+    if (in.type() != typeid(txin_to_key))
+    {
+      REPORT(height, "tx " << tx_hash << " has an unsupported input type");
+      return;
+    }
+    const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+    ++totals.inputs;
+    if (!db.has_key_image(in_to_key.k_image))
+      REPORT(height, "key image " << in_to_key.k_image << " of tx " << tx_hash << " is not spent");
+
+    std::vector<output_data_t> outputs;
+    db.get_output_key(in_to_key.amount, relative_output_offsets_to_absolute(in_to_key.key_offsets), outputs);
+    rings.emplace_back();
+    for (const output_data_t &od: outputs)
+    {
+      if (od.height >= height)
+        REPORT(height, "tx " << tx_hash << " uses a ring member from block " << od.height);
+      rings.back().push_back({rct::pk2rct(od.pubkey), od.commitment});
+    }
+  }
+
+  if (state.verify_signatures && !miner_tx && !pruned && !verify_tx_signatures(tx, tx_prefix_hash, rings))
+    REPORT(height, "tx " << tx_hash << " has invalid signatures");
+}
+
+void verify_block(verify_state &state, uint64_t height, shard_totals &totals)
+{
+  BlockchainDB &db = *state.db;
+
+  block b;
+  if (!parse_and_validate_block_from_blob(db.get_block_blob_from_height(height), b))
+  {
+    REPORT(height, "failed to parse block");
+    return;
+  }
+
+  const crypto::hash hash = get_block_hash(b);
+  if (db.get_block_hash_from_height(height) != hash)
+    REPORT(height, "block " << hash << " is stored with hash " << db.get_block_hash_from_height(height));
+  uint64_t indexed_height;
+  if (!db.block_exists(hash, &indexed_height))
+    REPORT(height, "block " << hash << " is not in the block index");
+  else if (indexed_height != height)
+    REPORT(height, "block " << hash << " is indexed at height " << indexed_height);
+  if (height > 0 && b.prev_id != db.get_block_hash_from_height(height - 1))
+    REPORT(height, "block " << hash << " does not follow the previous block");
+  if (db.get_block_timestamp(height) != b.timestamp)
+    REPORT(height, "block " << hash << " has a mismatched timestamp");
+
+  const uint8_t hf_version = db.get_hard_fork_version(height);
+  if (hf_version != b.major_version)
+    REPORT(height, "block " << hash << " has version " << (unsigned)b.major_version << ", but hard fork version " << (unsigned)hf_version);
+  if (height > 0 && hf_version < db.get_hard_fork_version(height - 1))
+    REPORT(height, "hard fork version went down to " << (unsigned)hf_version);
+
+  if (state.verify_pow && !check_hash(get_block_longhash(b, height), db.get_block_difficulty(height)))
+    REPORT(height, "block " << hash << " does not have enough proof of work");
+
+  std::vector<crypto::hash> tx_hashes;
+  tx_hashes.reserve(b.tx_hashes.size() + 1);
+  tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+  tx_hashes.insert(tx_hashes.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+
+  uint64_t first_tx_index;
+  if (!db.tx_exists(tx_hashes[0], first_tx_index))
+    first_tx_index = UNKNOWN_TX_INDEX;
+  state.first_tx_index[height] = first_tx_index;
+  state.tx_count[height] = tx_hashes.size();
+
+  for (size_t i = 0; i < tx_hashes.size(); ++i)
+    verify_tx(state, height, tx_hashes[i], first_tx_index == UNKNOWN_TX_INDEX ? UNKNOWN_TX_INDEX : first_tx_index + i, i == 0, totals);
+}
+
+void verify_shards(verify_state &state)
+{
+  shard_totals totals;
+  while (true)
+  {
+    const uint64_t start = state.next_shard++ * BLOCKS_PER_SHARD;
+    if (start >= state.height)
+      break;
+    const uint64_t end = std::min(start + BLOCKS_PER_SHARD, state.height);
+    for (uint64_t height = start; height < end; ++height)
+    {
+      try
+      {
+        verify_block(state, height, totals);
+      }
+      catch (const std::exception &e)
+      {
+        REPORT(height, "error reading the database: " << e.what());
+      }
+      ++state.blocks_done;
+    }
+  }
+
+  boost::unique_lock<boost::mutex> lock(state.totals_lock);
+  for (const auto &i: totals.outputs_per_amount)
+    state.outputs_per_amount[i.first] += i.second;
+  state.inputs += totals.inputs;
+}
+
+// checks which need all blocks done, in chain order
+void verify_totals(verify_state &state)
+{
+  BlockchainDB &db = *state.db;
+
+  uint64_t expected_tx_index = 0;
+  for (uint64_t height = 0; height < state.height; ++height)
+  {
+    if (state.first_tx_index[height] == UNKNOWN_TX_INDEX)
+    {
+      expected_tx_index = UNKNOWN_TX_INDEX;
+      continue;
+    }
+    if (expected_tx_index != UNKNOWN_TX_INDEX && state.first_tx_index[height] != expected_tx_index)
+      REPORT(height, "txes start at index " << state.first_tx_index[height] << ", expected " << expected_tx_index);
+    expected_tx_index = state.first_tx_index[height] + state.tx_count[height];
+  }
+  if (expected_tx_index != UNKNOWN_TX_INDEX && expected_tx_index != db.get_tx_count())
+    REPORT(state.height - 1, "the database has " << db.get_tx_count() << " txes, the blocks have " << expected_tx_index);
+
+  uint64_t key_images = 0;
+  db.for_all_key_images([&key_images](const crypto::key_image &k_image) { ++key_images; return true; });
+  if (key_images != state.inputs)
+    REPORT(state.height - 1, "the database has " << key_images << " spent key images, the blocks have " << state.inputs << " inputs");
+
+  const auto histogram = db.get_output_histogram(std::vector<uint64_t>(), false, 0);
+  for (const auto &i: histogram)
+  {
+    const auto counted = state.outputs_per_amount.find(i.first);
+    const uint64_t outputs = counted == state.outputs_per_amount.end() ? 0 : counted->second;
+    if (std::get<0>(i.second) != outputs)
+      REPORT(state.height - 1, "the database has " << std::get<0>(i.second) << " outputs of amount " << print_money(i.first) << ", the blocks have " << outputs);
+  }
+  for (const auto &i: state.outputs_per_amount)
+    if (histogram.find(i.first) == histogram.end())
+      REPORT(state.height - 1, "the database has no outputs of amount " << print_money(i.first) << ", the blocks have " << i.second);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  std::string default_db_type = "lmdb";
+
+  std::string available_dbs = cryptonote::blockchain_db_types(", ");
+  available_dbs = "available: " + available_dbs;
+
+  uint32_t log_level = 0;
+
+  tools::sanitize_locale();
+
+  boost::filesystem::path default_data_path {tools::get_default_data_dir()};
+  boost::filesystem::path default_testnet_data_path {default_data_path / "testnet"};
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint32_t> arg_threads = {"threads", "Number of threads to verify with, or 0 for all cores", 0};
+  const command_line::arg_descriptor<bool>     arg_verify_pow = {"verify-pow", "Also verify the proof of work of each block", false};
+  const command_line::arg_descriptor<bool>     arg_verify_signatures = {"verify-signatures", "Also verify the signatures of each transaction", false};
+  const command_line::arg_descriptor<bool>     arg_testnet_on = {
+    "testnet"
+      , "Run on testnet."
+      , false
+  };
+  const command_line::arg_descriptor<std::string> arg_database = {
+    "database", available_dbs.c_str(), default_db_type
+  };
+
+  command_line::add_arg(desc_cmd_sett, command_line::arg_data_dir, default_data_path.string());
+  command_line::add_arg(desc_cmd_sett, command_line::arg_testnet_data_dir, default_testnet_data_path.string());
+  command_line::add_arg(desc_cmd_sett, arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_database);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
+  command_line::add_arg(desc_cmd_sett, arg_verify_pow);
+  command_line::add_arg(desc_cmd_sett, arg_verify_signatures);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("intense-blockchain-verify.log"), true);
+  if (!vm["log-level"].defaulted())
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  LOG_PRINT_L0("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, arg_testnet_on);
+  uint32_t threads = command_line::get_arg(vm, arg_threads);
+  if (threads == 0)
+    threads = tools::get_max_concurrency();
+
+  auto data_dir_arg = opt_testnet ? command_line::arg_testnet_data_dir : command_line::arg_data_dir;
+  std::string m_config_folder = command_line::get_arg(vm, data_dir_arg);
+
+  std::string db_type = command_line::get_arg(vm, arg_database);
+  if (!cryptonote::blockchain_valid_db_type(db_type))
+  {
+    std::cerr << "Invalid database type: " << db_type << std::endl;
+    return 1;
+  }
+
+  // everything is checked against the stored data only, so there is no need
+  // to go through Blockchain here
+  BlockchainDB* db = new_db(db_type);
+  if (db == NULL)
+  {
+    LOG_ERROR("Attempted to use non-existent database type: " << db_type);
+    throw std::runtime_error("Attempting to use non-existent database type");
+  }
+  LOG_PRINT_L0("database: " << db_type);
+
+  boost::filesystem::path folder(m_config_folder);
+  folder /= db->get_db_name();
+  const std::string filename = folder.string();
+
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+  if (!db->m_open)
+  {
+    LOG_PRINT_L0("Failed to open database");
+    return 1;
+  }
+
+  verify_state state;
+  state.db = db;
+  state.height = db->height();
+  state.verify_pow = command_line::get_arg(vm, arg_verify_pow);
+  state.verify_signatures = command_line::get_arg(vm, arg_verify_signatures);
+  state.next_shard = 0;
+  state.blocks_done = 0;
+  state.errors = 0;
+  state.first_tx_index.resize(state.height, UNKNOWN_TX_INDEX);
+  state.tx_count.resize(state.height, 0);
+  state.inputs = 0;
+
+  LOG_PRINT_L0("Verifying " << state.height << " blocks with " << threads << " threads");
+  TIME_MEASURE_START(t);
+  std::atomic<uint32_t> running(threads);
+  boost::thread_group workers;
+  for (uint32_t n = 0; n < threads; ++n)
+    workers.create_thread([&state, &running]() { verify_shards(state); --running; });
+  while (running > 0)
+  {
+    for (int s = 0; s < PROGRESS_INTERVAL_SECONDS && running > 0; ++s)
+      boost::this_thread::sleep_for(boost::chrono::seconds(1));
+    if (running > 0)
+      LOG_PRINT_L0("Verified " << state.blocks_done << "/" << state.height << " blocks, " << state.errors << " errors so far");
+  }
+  workers.join_all();
+
+  if (state.height > 0)
+  {
+    try
+    {
+      verify_totals(state);
+    }
+    catch (const std::exception &e)
+    {
+      REPORT(state.height - 1, "error reading the database: " << e.what());
+    }
+  }
+  TIME_MEASURE_FINISH(t);
+
+  db->close();
+  delete db;
+
+  if (state.errors > 0)
+  {
+    LOG_PRINT_L0("Blockchain database is NOT consistent, " << state.errors << " errors found in " << t / 1000 << " seconds");
+    return 1;
+  }
+  LOG_PRINT_L0("Blockchain database is consistent, verified in " << t / 1000 << " seconds");
+  return 0;
+
+  CATCH_ENTRY("Verification error", 1);
+}
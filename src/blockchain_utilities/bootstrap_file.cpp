@@ -29,9 +29,15 @@
 #include "bootstrap_serialization.h"
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
 #include "serialization/json_utils.h" // dump_json()
+#include "common/varint.h"
+#include "crypto/hash.h"
 
 #include "bootstrap_file.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
 
@@ -47,6 +53,11 @@ namespace
   const uint32_t blockchain_raw_magic = 0x28721586;
   const uint32_t header_size = 1024;
 
+  // echo Monero bootstrap chunk index | sha1sum
+  const uint32_t chunk_index_magic = 0xb2ef3e5b;
+  // chunk index position and magic
+  const uint64_t chunk_index_footer_size = sizeof(uint64_t) + sizeof(uint32_t);
+
   std::string refresh_string = "\r                                    \r";
 }
 
@@ -88,6 +99,14 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
   }
   else
   {
+    std::ifstream import_file(file_path.string(), std::ios_base::binary | std::ifstream::in);
+    bootstrap::chunk_index index;
+    if (read_chunk_index(import_file, index))
+    {
+      MFATAL("existing file is in the indexed format, cannot append to it: " << file_path);
+      return false;
+    }
+    import_file.close();
     num_blocks = count_blocks(file_path.string());
     MDEBUG("appending to existing file with height: " << num_blocks-1 << "  total blocks: " << num_blocks);
   }
@@ -111,8 +130,81 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
   return true;
 }
 
+bool BootstrapFile::open_indexed_writer(const boost::filesystem::path& file_path)
+{
+  const boost::filesystem::path dir_path = file_path.parent_path();
+  if (!dir_path.empty())
+  {
+    if (boost::filesystem::exists(dir_path))
+    {
+      if (!boost::filesystem::is_directory(dir_path))
+      {
+        MFATAL("export directory path is a file: " << dir_path);
+        return false;
+      }
+    }
+    else
+    {
+      if (!boost::filesystem::create_directory(dir_path))
+      {
+        MFATAL("Failed to create directory " << dir_path);
+        return false;
+      }
+    }
+  }
+
+  m_raw_data_file = new std::ofstream();
+  m_index.chunks.clear();
+  m_chunk_blocks = 0;
+
+  bool do_initialize_file = false;
+  if (! boost::filesystem::exists(file_path))
+  {
+    MDEBUG("creating file");
+    do_initialize_file = true;
+    m_height = 0;
+  }
+  else
+  {
+    std::ifstream import_file(file_path.string(), std::ios_base::binary | std::ifstream::in);
+    if (!read_chunk_index(import_file, m_index))
+    {
+      MFATAL("existing file is not in the indexed format, cannot append to it: " << file_path);
+      return false;
+    }
+    import_file.close();
+
+    // the index is written again after the new chunks
+    uint64_t index_offset = sizeof(blockchain_raw_magic) + header_size;
+    m_height = 0;
+    if (!m_index.chunks.empty())
+    {
+      index_offset = m_index.chunks.back().offset + m_index.chunks.back().size;
+      m_height = m_index.chunks.back().block_last + 1;
+    }
+    boost::filesystem::resize_file(file_path, index_offset);
+    MDEBUG("appending to existing indexed file with height: " << m_height-1 << "  total blocks: " << m_height);
+  }
+
+  if (do_initialize_file)
+    m_raw_data_file->open(file_path.string(), std::ios_base::binary | std::ios_base::out | std::ios::trunc);
+  else
+    m_raw_data_file->open(file_path.string(), std::ios_base::binary | std::ios_base::out | std::ios::app | std::ios::ate);
+
+  if (m_raw_data_file->fail())
+    return false;
+
+  m_output_stream = new boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>(m_buffer);
+  if (m_output_stream == nullptr)
+    return false;
+
+  if (do_initialize_file)
+    initialize_file(1);
+
+  return true;
+}
 
-bool BootstrapFile::initialize_file()
+bool BootstrapFile::initialize_file(uint8_t major_version)
 {
   const uint32_t file_magic = blockchain_raw_magic;
 
@@ -124,8 +216,8 @@ bool BootstrapFile::initialize_file()
   *m_raw_data_file << blob;
 
   bootstrap::file_info bfi;
-  bfi.major_version = 0;
-  bfi.minor_version = 1;
+  bfi.major_version = major_version;
+  bfi.minor_version = major_version ? 0 : 1;
   bfi.header_size = header_size;
 
   bootstrap::blocks_info bbi;
@@ -208,6 +300,95 @@ void BootstrapFile::flush_chunk()
   MDEBUG("flushed chunk:  chunk_size: " << chunk_size);
 }
 
+void BootstrapFile::flush_indexed_chunk()
+{
+  m_output_stream->flush();
+  if (m_chunk_blocks == 0)
+    return;
+
+  // same layout as a serialized bootstrap::block_chunk
+  std::string raw;
+  tools::write_varint(std::back_inserter(raw), m_chunk_blocks);
+  raw.append(m_buffer.begin(), m_buffer.end());
+
+  bootstrap::chunk_info ci;
+  ci.block_first = m_index.chunks.empty() ? m_height : m_index.chunks.back().block_last + 1;
+  ci.block_last = ci.block_first + m_chunk_blocks - 1;
+  ci.raw_size = raw.size();
+  ci.compression = bootstrap::chunk_compression_none;
+  if (ci.raw_size > MAX_INDEXED_CHUNK_SIZE)
+  {
+    MFATAL("Chunk for blocks " << ci.block_first << "-" << ci.block_last << " is too large: " << ci.raw_size << " > " << MAX_INDEXED_CHUNK_SIZE);
+    throw std::runtime_error("Error writing chunk");
+  }
+
+  std::string stored;
+#ifdef HAVE_ZLIB
+  uLongf compressed_size = compressBound(raw.size());
+  stored.resize(compressed_size);
+  if (compress2((Bytef*)&stored[0], &compressed_size, (const Bytef*)raw.data(), raw.size(), Z_BEST_COMPRESSION) == Z_OK
+      && compressed_size < raw.size())
+  {
+    stored.resize(compressed_size);
+    ci.compression = bootstrap::chunk_compression_zlib;
+  }
+#endif
+  if (ci.compression == bootstrap::chunk_compression_none)
+    stored = std::move(raw);
+
+  ci.size = stored.size();
+  ci.hash = crypto::cn_fast_hash(stored.data(), stored.size());
+
+  // size prefix as in the legacy format, so the chunks can still be walked without the index
+  std::string blob;
+  if (! ::serialization::dump_binary(ci.size, blob))
+  {
+    throw std::runtime_error("Error in serialization of chunk size");
+  }
+  *m_raw_data_file << blob;
+  ci.offset = m_raw_data_file->tellp();
+  *m_raw_data_file << stored;
+  m_raw_data_file->flush();
+  if (m_raw_data_file->fail())
+  {
+    MFATAL("Error writing chunk:  height: " << ci.block_last << "  chunk_size: " << ci.size);
+    throw std::runtime_error("Error writing chunk");
+  }
+  m_index.chunks.push_back(ci);
+
+  if (m_max_chunk < ci.size)
+  {
+    m_max_chunk = ci.size;
+  }
+
+  m_buffer.clear();
+  delete m_output_stream;
+  m_output_stream = new boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>(m_buffer);
+  m_chunk_blocks = 0;
+  MDEBUG("flushed indexed chunk:  blocks " << ci.block_first << "-" << ci.block_last << "  raw size: " << ci.raw_size << "  stored size: " << ci.size);
+}
+
+bool BootstrapFile::write_chunk_index()
+{
+  uint64_t index_offset = m_raw_data_file->tellp();
+  *m_raw_data_file << t_serializable_object_to_blob(m_index);
+
+  std::string blob;
+  if (! ::serialization::dump_binary(index_offset, blob))
+  {
+    throw std::runtime_error("Error in serialization of chunk index position");
+  }
+  *m_raw_data_file << blob;
+  uint32_t index_magic = chunk_index_magic;
+  if (! ::serialization::dump_binary(index_magic, blob))
+  {
+    throw std::runtime_error("Error in serialization of chunk index magic");
+  }
+  *m_raw_data_file << blob;
+  m_raw_data_file->flush();
+  return !m_raw_data_file->fail();
+}
+
 void BootstrapFile::write_block(block& block)
 {
   bootstrap::block_package bp;
@@ -262,15 +443,15 @@ bool BootstrapFile::close()
 }
 
 
-bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop)
+bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop, bool indexed)
 {
   uint64_t num_blocks_written = 0;
   m_max_chunk = 0;
   m_blockchain_storage = _blockchain_storage;
   m_tx_pool = _tx_pool;
   uint64_t progress_interval = 100;
-  MINFO("Storing blocks raw data...");
-  if (!BootstrapFile::open_writer(output_file))
+  MINFO("Storing blocks raw data" << (indexed ? " in indexed format..." : "..."));
+  if (!(indexed ? open_indexed_writer(output_file) : open_writer(output_file)))
   {
     MFATAL("failed to open raw file for write");
     return false;
@@ -299,7 +480,16 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
     crypto::hash hash = m_blockchain_storage->get_block_id_by_height(m_cur_height);
     m_blockchain_storage->get_block_by_hash(hash, b);
     write_block(b);
-    if (m_cur_height % NUM_BLOCKS_PER_CHUNK == 0) {
+    if (indexed)
+    {
+      ++m_chunk_blocks;
+      if (m_chunk_blocks >= NUM_BLOCKS_PER_INDEXED_CHUNK || m_buffer.size() >= INDEXED_CHUNK_TARGET_SIZE)
+      {
+        num_blocks_written += m_chunk_blocks;
+        flush_indexed_chunk();
+      }
+    }
+    else if (m_cur_height % NUM_BLOCKS_PER_CHUNK == 0) {
       flush_chunk();
       num_blocks_written += NUM_BLOCKS_PER_CHUNK;
     }
@@ -308,8 +498,18 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
       std::cout << "block " << m_cur_height << "/" << block_stop << std::flush;
     }
   }
+  if (indexed)
+  {
+    num_blocks_written += m_chunk_blocks;
+    flush_indexed_chunk();
+    if (!write_chunk_index())
+    {
+      MFATAL("Error writing chunk index");
+      return false;
+    }
+  }
   // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-  if (m_cur_height % NUM_BLOCKS_PER_CHUNK != 0)
+  else if (m_cur_height % NUM_BLOCKS_PER_CHUNK != 0)
   {
     flush_chunk();
   }
@@ -366,6 +566,7 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
   if (! ::serialization::parse_binary(str1, bfi))
     throw std::runtime_error("Error in deserialization of bootstrap::file_info");
   MINFO("bootstrap file v" << unsigned(bfi.major_version) << "." << unsigned(bfi.minor_version));
+  m_file_version = bfi.major_version;
   MINFO("bootstrap magic size: " << sizeof(file_magic));
   MINFO("bootstrap header size: " << bfi.header_size);
 
@@ -375,6 +576,109 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
   return full_header_size;
 }
 
+bool BootstrapFile::read_chunk_index(std::ifstream& import_file, bootstrap::chunk_index& index)
+{
+  import_file.seekg(0);
+  seek_to_first_chunk(import_file);
+  if (m_file_version < 1)
+    return false;
+
+  import_file.seekg(0, std::ios_base::end);
+  const uint64_t file_size = import_file.tellg();
+  uint64_t index_offset = 0;
+  uint32_t index_magic = 0;
+  std::string str1;
+  char buf1[chunk_index_footer_size];
+  if (file_size >= chunk_index_footer_size)
+  {
+    import_file.seekg(file_size - chunk_index_footer_size);
+    import_file.read(buf1, chunk_index_footer_size);
+    if (! import_file)
+      throw std::runtime_error("Error reading expected number of bytes");
+    str1.assign(buf1, sizeof(index_offset));
+    if (! ::serialization::parse_binary(str1, index_offset))
+      throw std::runtime_error("Error in deserialization of chunk index position");
+    str1.assign(buf1 + sizeof(index_offset), sizeof(index_magic));
+    if (! ::serialization::parse_binary(str1, index_magic))
+      throw std::runtime_error("Error in deserialization of chunk index magic");
+  }
+  if (index_magic != chunk_index_magic || index_offset > file_size - chunk_index_footer_size)
+  {
+    MFATAL("bootstrap file has no chunk index, it was probably not fully written");
+    throw std::runtime_error("Aborting");
+  }
+
+  str1.resize(file_size - chunk_index_footer_size - index_offset);
+  import_file.seekg(index_offset);
+  import_file.read(&str1[0], str1.size());
+  if (! import_file)
+    throw std::runtime_error("Error reading expected number of bytes");
+  if (! ::serialization::parse_binary(str1, index))
+    throw std::runtime_error("Error in deserialization of chunk index");
+  MINFO("bootstrap chunk index: " << index.chunks.size() << " chunks");
+
+  return true;
+}
+
+bool BootstrapFile::read_chunk(std::ifstream& import_file, const bootstrap::chunk_info& chunk, std::vector<bootstrap::block_package>& blocks)
+{
+  // sizes come from the file, check them before allocating
+  if (chunk.size > MAX_INDEXED_CHUNK_SIZE || chunk.raw_size > MAX_INDEXED_CHUNK_SIZE)
+  {
+    MERROR("Chunk for blocks " << chunk.block_first << "-" << chunk.block_last << " is too large: " << chunk.size << " bytes, " << chunk.raw_size << " uncompressed");
+    return false;
+  }
+  std::string stored(chunk.size, 0);
+  import_file.seekg(chunk.offset);
+  import_file.read(&stored[0], chunk.size);
+  if (! import_file)
+  {
+    MERROR("Error reading chunk for blocks " << chunk.block_first << "-" << chunk.block_last);
+    return false;
+  }
+  if (crypto::cn_fast_hash(stored.data(), stored.size()) != chunk.hash)
+  {
+    MERROR("Checksum mismatch in chunk for blocks " << chunk.block_first << "-" << chunk.block_last);
+    return false;
+  }
+
+  std::string raw;
+  switch (chunk.compression)
+  {
+    case bootstrap::chunk_compression_none:
+      raw = std::move(stored);
+      break;
+    case bootstrap::chunk_compression_zlib:
+    {
+#ifdef HAVE_ZLIB
+      raw.resize(chunk.raw_size);
+      uLongf raw_size = chunk.raw_size;
+      if (uncompress((Bytef*)&raw[0], &raw_size, (const Bytef*)stored.data(), stored.size()) != Z_OK || raw_size != chunk.raw_size)
+      {
+        MERROR("Error decompressing chunk for blocks " << chunk.block_first << "-" << chunk.block_last);
+        return false;
+      }
+      break;
+#else
+      MERROR("Chunk is compressed with zlib, which this build does not support");
+      return false;
+#endif
+    }
+    default:
+      MERROR("Unknown compression " << unsigned(chunk.compression) << " in chunk for blocks " << chunk.block_first << "-" << chunk.block_last);
+      return false;
+  }
+
+  bootstrap::block_chunk bc;
+  if (! ::serialization::parse_binary(raw, bc) || bc.blocks.size() != chunk.block_last - chunk.block_first + 1)
+  {
+    MERROR("Error in deserialization of chunk for blocks " << chunk.block_first << "-" << chunk.block_last);
+    return false;
+  }
+  blocks = std::move(bc.blocks);
+  return true;
+}
+
 uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
 {
   boost::filesystem::path raw_file_path(import_file_path);
@@ -394,6 +698,16 @@ uint64_t BootstrapFile::count_blocks(const std::string& import_file_path)
     throw std::runtime_error("Aborting");
   }
 
+  bootstrap::chunk_index index;
+  if (read_chunk_index(import_file, index))
+  {
+    h = index.chunks.empty() ? 0 : index.chunks.back().block_last + 1;
+    import_file.close();
+    std::cout << "Number of blocks: " << h << ENDL;
+    return h;
+  }
+  import_file.seekg(0);
+
   uint64_t full_header_size; // 4 byte magic + length of header structures
   full_header_size = seek_to_first_chunk(import_file);
 
@@ -47,6 +47,7 @@
 #include "version.h"
 
 #include "blockchain_utilities.h"
+#include "bootstrap_serialization.h"
 
 
 using namespace cryptonote;
@@ -59,8 +60,12 @@ public:
   uint64_t count_blocks(const std::string& dir_path);
   uint64_t seek_to_first_chunk(std::ifstream& import_file);
 
+  // indexed format: returns false for a legacy file
+  bool read_chunk_index(std::ifstream& import_file, bootstrap::chunk_index& index);
+  bool read_chunk(std::ifstream& import_file, const bootstrap::chunk_info& chunk, std::vector<bootstrap::block_package>& blocks);
+
   bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
-      boost::filesystem::path& output_file, uint64_t use_block_height=0);
+      boost::filesystem::path& output_file, uint64_t use_block_height=0, bool indexed=false);
 
 protected:
 
@@ -74,14 +79,21 @@ protected:
 
   // open export file for write
   bool open_writer(const boost::filesystem::path& file_path);
-  bool initialize_file();
+  bool open_indexed_writer(const boost::filesystem::path& file_path);
+  bool initialize_file(uint8_t major_version = 0);
   bool close();
   void write_block(block& block);
   void flush_chunk();
+  void flush_indexed_chunk();
+  bool write_chunk_index();
 
 private:
 
   uint64_t m_height;
   uint64_t m_cur_height; // tracks current height during export
   uint32_t m_max_chunk;
+  uint8_t m_file_version; // major version of the file read by seek_to_first_chunk
+
+  uint64_t m_chunk_blocks; // blocks in the indexed chunk being written
+  bootstrap::chunk_index m_index;
 };
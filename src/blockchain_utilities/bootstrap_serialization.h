@@ -83,6 +83,61 @@ namespace cryptonote
       END_SERIALIZE()
     };
 
+    // indexed format (file_info major_version 1)
+
+    enum chunk_compression : uint8_t
+    {
+      chunk_compression_none = 0,
+      chunk_compression_zlib = 1,
+    };
+
+    struct chunk_info
+    {
+      // block heights of the chunk's first and last blocks
+      uint64_t block_first;
+      uint64_t block_last;
+
+      // file position and size of the chunk as stored, after its size prefix
+      uint64_t offset;
+      uint32_t size;
+
+      // size of the chunk's block_chunk blob once decompressed
+      uint32_t raw_size;
+      uint8_t compression;
+
+      // cn_fast_hash of the chunk as stored
+      crypto::hash hash;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(block_first);
+        VARINT_FIELD(block_last);
+        VARINT_FIELD(offset);
+        VARINT_FIELD(size);
+        VARINT_FIELD(raw_size);
+        FIELD(compression);
+        FIELD(hash);
+      END_SERIALIZE()
+    };
+
+    // written after the last chunk, followed by its file position and a magic
+    struct chunk_index
+    {
+      std::vector<chunk_info> chunks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(chunks);
+      END_SERIALIZE()
+    };
+
+    struct block_chunk
+    {
+      std::vector<block_package> blocks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(blocks);
+      END_SERIALIZE()
+    };
+
   }
 
 }
@@ -115,14 +115,34 @@ namespace command_line
   , "How many blocks to sync at once during chain synchronization (0 = adaptive)."
   , 0
   };
+  const command_line::arg_descriptor<size_t> arg_block_sync_requests  = {
+    "block-sync-requests"
+  , "Max number of block span requests in flight to a single peer during chain synchronization, scaled down for slower peers."
+  , BLOCKS_SYNCHRONIZING_MAX_REQUESTS
+  };
   const command_line::arg_descriptor<std::string> arg_check_updates = {
     "check-updates"
   , "Check for new versions of monero: [disabled|notify|download|update]"
   , "notify"
   };
+  const arg_descriptor<size_t> arg_max_txpool_size  = {
+    "max-txpool-size"
+  , "Set maximum txpool size in bytes, the lowest fee per byte transactions are evicted beyond it."
+  , DEFAULT_TXPOOL_MAX_SIZE
+  };
   const arg_descriptor<bool> arg_fluffy_blocks  = {
     "fluffy-blocks"
   , "Relay blocks as fluffy blocks where possible (automatic on testnet)"
   , false
   };
+  const arg_descriptor<bool> arg_headers_first_sync  = {
+    "headers-first-sync"
+  , "Download and verify block headers ahead of block bodies when syncing from peers supporting it"
+  , false
+  };
+  const arg_descriptor<uint64_t> arg_tx_relay_flush_interval  = {
+    "tx-relay-flush-interval"
+  , "Interval in milliseconds at which pending transactions are batched and relayed to peers"
+  , P2P_DEFAULT_TX_RELAY_FLUSH_INTERVAL
+  };
 }
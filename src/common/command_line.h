@@ -216,6 +216,10 @@ namespace command_line
   extern const arg_descriptor<uint64_t> arg_prep_blocks_threads;
   extern const arg_descriptor<uint64_t> arg_show_time_stats;
   extern const arg_descriptor<size_t> arg_block_sync_size;
+  extern const arg_descriptor<size_t> arg_block_sync_requests;
   extern const arg_descriptor<std::string> arg_check_updates;
+  extern const arg_descriptor<size_t> arg_max_txpool_size;
   extern const arg_descriptor<bool> arg_fluffy_blocks;
+  extern const arg_descriptor<bool> arg_headers_first_sync;
+  extern const arg_descriptor<uint64_t> arg_tx_relay_flush_interval;
 }
@@ -30,6 +30,7 @@
 
 #pragma once
 #include <unordered_set>
+#include <deque>
 #include <atomic>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
@@ -40,7 +41,7 @@ namespace cryptonote
   struct cryptonote_connection_context: public epee::net_utils::connection_context_base
   {
     cryptonote_connection_context(): m_state(state_before_handshake), m_remote_blockchain_height(0), m_last_response_height(0),
-        m_last_known_hash(cryptonote::null_hash) {}
+        m_last_known_hash(cryptonote::null_hash), m_pruning_seed(0) {}
 
     enum state
     {
@@ -51,14 +52,26 @@ namespace cryptonote
       state_normal
     };
 
+    struct span_request
+    {
+      crypto::hash first_block;
+      size_t nblocks;
+      boost::posix_time::ptime time; //request time, or when the previous request was answered if later
+    };
+
     state m_state;
     std::list<crypto::hash> m_needed_objects;
     std::unordered_set<crypto::hash> m_requested_objects;
+    std::list<crypto::hash> m_requested_headers;
+    std::deque<span_request> m_requested_spans; //in flight NOTIFY_REQUEST_GET_OBJECTS, oldest first
     uint64_t m_remote_blockchain_height;
     uint64_t m_last_response_height;
     boost::posix_time::ptime m_last_request_time;
     epee::copyable_atomic m_callback_request_count; //in debug purpose: problem with double callback rise
     crypto::hash m_last_known_hash;
+    std::unordered_set<crypto::hash> m_known_txs; //txes this peer sent us or we relayed to it, by blob hash
+    std::deque<crypto::hash> m_known_txs_order; //oldest first, used to bound m_known_txs
+    uint32_t m_pruning_seed; //stripe the peer keeps in full, 0 if not pruned
     //size_t m_score;  TODO: add score calculations
   };
 
@@ -117,6 +117,20 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool get_pruned_transaction_blob(const blobdata& tx_blob, blobdata& pruned_blob)
+  {
+    // the unprunable part comes first in the blob, so it is everything the base parse reads
+    std::stringstream ss;
+    ss << tx_blob;
+    binary_archive<false> ba(ss);
+    transaction tx;
+    bool r = tx.serialize_base(ba);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
+    const std::streamoff pos = ss.tellg();
+    pruned_blob = pos < 0 ? tx_blob : tx_blob.substr(0, pos);
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
   {
     std::stringstream ss;
@@ -99,10 +99,26 @@
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4       100    //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_MAX_REQUESTS               4      //by default, max block span requests in flight to one peer
+#define BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT           10000  //max block headers count in one headers-first request
+#define BLOCK_HEADERS_VERIFIED_MAX_COUNT                100000 //max block headers kept verified ahead of the chain
+#define BLOCK_ENTRY_CACHE_MAX_SIZE                      (64*1024*1024) //max size of block and tx blobs kept ready to send to peers and wallets
+#define BLOCK_TEMPLATE_LONGPOLL_TIMEOUT                 60     //seconds a getblocktemplate long poll waits for a change at most
+#define BLOCK_TEMPLATE_LONGPOLL_POOL_DELAY              5      //seconds a long poll waits before returning on a pool only change
+#define BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING             8      //by default, max long polls waiting at once, each has an rpc thread of its own
+#define BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING_LIMIT       64     //max long polls waiting at once that can be configured
 #define CRYPTONOTE_PROTOCOL_HOP_RELAX_COUNT             3      //value of hop, after which we use only announce of new block
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    86400 //seconds, one day
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
+#define DB_ASYNC_SYNC_INTERVAL                          60     // seconds, async sync mode syncs at least this often
+#define DB_ASYNC_SYNC_MAX_LAG_SECONDS                   300    // an async sync pending longer than this blocks further syncs
+#define DB_ASYNC_SYNC_MAX_LAG_SYNCS                     4      // as do this many syncs worth of blocks committed while one is pending
+#define DEFAULT_TXPOOL_MAX_SIZE                           648000000ull // 3 days at 300000, in bytes
+
+#define CRYPTONOTE_PRUNING_TIP_BLOCKS                   5500   // blocks at the tip a pruned database keeps in full
+#define CRYPTONOTE_PRUNING_STRIPE_SIZE                  4096   // consecutive blocks in a pruning stripe
+#define CRYPTONOTE_PRUNING_STRIPES                      8      // a pruned database keeps one stripe in this many in full
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
 
@@ -124,9 +140,12 @@
 #define P2P_IP_BLOCKTIME                                (60*60*24)  //24 hour
 #define P2P_IP_FAILS_BEFORE_BLOCK                       10
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
+#define P2P_DEFAULT_TX_RELAY_FLUSH_INTERVAL             250         //milliseconds
+#define P2P_MAX_KNOWN_TXS_PER_CONNECTION                8192
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_HEADERS_FIRST                  0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_HEADERS_FIRST)
 
 #define ALLOW_DEBUG_COMMANDS
 
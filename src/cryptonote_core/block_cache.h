@@ -0,0 +1,237 @@
+// Copyright (c) 2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <iterator>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief weighs each entry as one, for a cache bounded by its number of entries
+   */
+  template<typename t_value>
+  struct block_cache_unit_size
+  {
+    size_t operator()(const t_value &value) const { return 1; }
+  };
+
+  /**
+   * @brief bounded LRU cache of data about blocks, by block hash and by height
+   *
+   * Each entry weighs what t_size_of says, and the least recently used ones
+   * are evicted to keep the total under the max size. With t_one_per_height,
+   * an entry replaces any other at its height, as suits main chain data,
+   * otherwise blocks from competing chains may share a height. The cache holds
+   * its own lock, and must be invalidated from the height of any popped block.
+   */
+  template<typename t_value, typename t_size_of = block_cache_unit_size<t_value>, bool t_one_per_height = false>
+  class block_cache
+  {
+  public:
+    block_cache(size_t max_size):
+      m_size(0), m_max_size(max_size), m_hits(0), m_misses(0)
+    {
+    }
+
+    bool get(const crypto::hash &id, t_value &value)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_by_hash.find(id);
+      if (i == m_by_hash.end())
+      {
+        ++m_misses;
+        return false;
+      }
+      value = i->second->value;
+      touch(i->second);
+      ++m_hits;
+      return true;
+    }
+
+    bool get(uint64_t height, t_value &value)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_by_height.find(height);
+      if (i == m_by_height.end())
+      {
+        ++m_misses;
+        return false;
+      }
+      value = i->second->value;
+      touch(i->second);
+      ++m_hits;
+      return true;
+    }
+
+    /**
+     * @brief gets an entry and drops it from the cache, for data used once
+     */
+    bool take(const crypto::hash &id, t_value &value)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_by_hash.find(id);
+      if (i == m_by_hash.end())
+      {
+        ++m_misses;
+        return false;
+      }
+      value = std::move(i->second->value);
+      erase(i->second);
+      ++m_hits;
+      return true;
+    }
+
+    void add(uint64_t height, const crypto::hash &id, const t_value &value)
+    {
+      const size_t size = t_size_of()(value);
+      if (size > m_max_size)
+        return;
+
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_by_hash.find(id);
+      if (i != m_by_hash.end() && i->second->height == height)
+      {
+        touch(i->second);
+        return;
+      }
+      if (i != m_by_hash.end())
+        erase(i->second);
+      if (t_one_per_height)
+      {
+        auto j = m_by_height.lower_bound(height);
+        while (j != m_by_height.end() && j->first == height)
+          erase((j++)->second);
+      }
+
+      m_entries.push_front({height, id, value, size});
+      m_by_hash[id] = m_entries.begin();
+      m_by_height.insert(std::make_pair(height, m_entries.begin()));
+      m_size += size;
+
+      while (m_size > m_max_size)
+        erase(std::prev(m_entries.end()));
+    }
+
+    /**
+     * @brief drops the entries below the given height, which the chain has moved past
+     */
+    void prune(uint64_t height)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      while (!m_by_height.empty() && m_by_height.begin()->first < height)
+        erase(m_by_height.begin()->second);
+    }
+
+    void invalidate(uint64_t height)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      auto i = m_by_height.lower_bound(height);
+      while (i != m_by_height.end())
+        erase((i++)->second);
+    }
+
+    void clear()
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      m_entries.clear();
+      m_by_hash.clear();
+      m_by_height.clear();
+      m_size = 0;
+    }
+
+    size_t get_size() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_size;
+    }
+
+    size_t get_num_entries() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_entries.size();
+    }
+
+    uint64_t get_hits() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_hits;
+    }
+
+    uint64_t get_misses() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_misses;
+    }
+
+  private:
+    struct cached_entry
+    {
+      uint64_t height;
+      crypto::hash id;
+      t_value value;
+      size_t size;
+    };
+    typedef std::list<cached_entry> lru_list;
+
+    void touch(typename lru_list::iterator i)
+    {
+      m_entries.splice(m_entries.begin(), m_entries, i);
+    }
+
+    void erase(typename lru_list::iterator i)
+    {
+      m_by_hash.erase(i->id);
+      auto range = m_by_height.equal_range(i->height);
+      for (auto j = range.first; j != range.second; ++j)
+      {
+        if (j->second == i)
+        {
+          m_by_height.erase(j);
+          break;
+        }
+      }
+      m_size -= i->size;
+      m_entries.erase(i);
+    }
+
+    lru_list m_entries; // most recently used first
+    std::unordered_map<crypto::hash, typename lru_list::iterator> m_by_hash;
+    std::multimap<uint64_t, typename lru_list::iterator> m_by_height;
+    size_t m_size;
+    const size_t m_max_size;
+    uint64_t m_hits;
+    uint64_t m_misses;
+    mutable boost::mutex m_lock;
+  };
+}
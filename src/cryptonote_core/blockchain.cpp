@@ -30,6 +30,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <deque>
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 
@@ -52,6 +53,7 @@
 #include "cryptonote_core.h"
 #include "ringct/rctSigs.h"
 #include "common/perf_timer.h"
+#include "common/task_region.h"
 #if defined(PER_BLOCK_CHECKPOINT)
 #include "blocks/blocks.h"
 #endif
@@ -116,7 +118,9 @@ static const uint64_t testnet_hard_fork_version_1_till = 100;
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_sz_limit(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false)
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false),
+  m_verified_headers(BLOCK_HEADERS_VERIFIED_MAX_COUNT), m_block_entry_cache(BLOCK_ENTRY_CACHE_MAX_SIZE), m_threadpool(tools::thread_group::optimal()),
+  m_async_sync_pending(false), m_async_sync_time(0), m_btc_valid(false), m_btc_base_valid(false)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -324,6 +328,11 @@ bool Blockchain::init(BlockchainDB* db, const bool testnet, const cryptonote::te
   //       taking testnet into account
   if(!m_db->height())
   {
+    if (m_db->is_read_only())
+    {
+      LOG_ERROR("Blockchain not loaded, and the database is read only");
+      return false;
+    }
     MINFO("Blockchain not loaded, generating genesis block.");
     block bl = boost::value_initialized<block>();
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
@@ -417,6 +426,63 @@ bool Blockchain::store_blockchain()
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::reload_db_state()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_tx_pool);
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  // a reorg may have replaced blocks at any height we cached
+  m_timestamps_and_difficulties_height = 0;
+  m_block_entry_cache.clear();
+  m_verified_headers.clear();
+  invalidate_block_template_cache();
+
+  // only reads once the hard fork info is in the db, which the writer ensures
+  m_hardfork->init();
+  update_next_cumulative_size_limit();
+}
+//------------------------------------------------------------------
+void Blockchain::async_store_blockchain()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  try
+  {
+    store_blockchain();
+  }
+  catch (...)
+  {
+    // already reported, and the next sync will try again
+  }
+
+  boost::unique_lock<boost::mutex> lock(m_async_sync_lock);
+  m_async_sync_pending = false;
+  m_async_sync_cond.notify_all();
+}
+//------------------------------------------------------------------
+void Blockchain::queue_async_store_blockchain()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  const uint64_t now = time(NULL);
+  boost::unique_lock<boost::mutex> lock(m_async_sync_lock);
+  if (m_async_sync_pending)
+  {
+    if (m_sync_counter < m_db_blocks_per_sync * DB_ASYNC_SYNC_MAX_LAG_SYNCS && now - m_async_sync_time < DB_ASYNC_SYNC_MAX_LAG_SECONDS)
+      return;
+    MDEBUG("Database sync lagging behind, waiting for it");
+    TIME_MEASURE_START(t);
+    while (m_async_sync_pending)
+      m_async_sync_cond.wait(lock);
+    TIME_MEASURE_FINISH(t);
+    if(m_show_time_stats)
+      MINFO("Waited " << t << " ms for the database sync");
+  }
+  m_async_sync_pending = true;
+  m_async_sync_time = now;
+  m_sync_counter = 0;
+  m_async_service.dispatch(boost::bind(&Blockchain::async_store_blockchain, this));
+}
+//------------------------------------------------------------------
 bool Blockchain::deinit()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -455,69 +521,82 @@ bool Blockchain::deinit()
   return true;
 }
 //------------------------------------------------------------------
-// This function tells BlockchainDB to remove the top block from the
-// blockchain and then returns all transactions (except the miner tx, of course)
-// from it to the tx_pool
-block Blockchain::pop_block_from_blockchain()
+// This function tells BlockchainDB to remove the top blocks from the
+// blockchain in one go, and then returns all transactions (except the miner
+// txes, of course) from them to the tx_pool
+std::list<block> Blockchain::pop_blocks_from_blockchain(uint64_t nblocks)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
+  if (nblocks == 0)
+    return std::list<block>();
+
   m_timestamps_and_difficulties_height = 0;
 
-  block popped_block;
+  std::vector<block> popped_blocks;
   std::vector<transaction> popped_txs;
 
   try
   {
-    m_db->pop_block(popped_block, popped_txs);
+    m_db->pop_blocks(nblocks, popped_blocks, popped_txs);
+    m_block_entry_cache.invalidate(m_db->height());
+    m_verified_headers.invalidate(m_db->height());
+    invalidate_block_template_cache();
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
   catch (const std::exception& e)
   {
-    LOG_ERROR("Error popping block from blockchain: " << e.what());
+    LOG_ERROR("Error popping blocks from blockchain: " << e.what());
     throw;
   }
   catch (...)
   {
-    LOG_ERROR("Error popping block from blockchain, throwing!");
+    LOG_ERROR("Error popping blocks from blockchain, throwing!");
     throw;
   }
 
-  // return transactions from popped block to the tx_pool
+  // FIXME: HardFork
+  // Besides the below, popping a block should also remove the last entry
+  // in hf_versions.
+  //
+  // The txes are returned to the pool based on the version determined after
+  // all blocks are popped, not the one of the block they came from.
+  m_hardfork->reorganize_from_chain_height(m_db->height());
+  uint8_t version = get_current_hard_fork_version();
+
+  // their inputs are checked against the chain they end up on, all at once,
+  // so adding them to the pool one by one does not check them again
+  std::vector<transaction*> txs_to_check;
   for (transaction& tx : popped_txs)
   {
     if (!is_coinbase(tx))
-    {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      txs_to_check.push_back(&tx);
+  }
+  if (!txs_to_check.empty())
+    check_tx_inputs_batch(txs_to_check, m_threadpool);
 
-      // FIXME: HardFork
-      // Besides the below, popping a block should also remove the last entry
-      // in hf_versions.
-      //
-      // FIXME: HardFork
-      // This is not quite correct, as we really want to add the txes
-      // to the pool based on the version determined after all blocks
-      // are popped.
-      uint8_t version = get_current_hard_fork_version();
-
-      // We assume that if they were in a block, the transactions are already
-      // known to the network as a whole. However, if we had mined that block,
-      // that might not be always true. Unlikely though, and always relaying
-      // these again might cause a spike of traffic as many nodes re-relay
-      // all the transactions in a popped block when a reorg happens.
-      bool r = m_tx_pool.add_tx(tx, tvc, true, true, false, version);
-      if (!r)
-      {
-        LOG_ERROR("Error returning transaction to tx_pool");
-      }
+  // return transactions from popped blocks to the tx_pool
+  for (transaction* tx : txs_to_check)
+  {
+    cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+
+    // We assume that if they were in a block, the transactions are already
+    // known to the network as a whole. However, if we had mined that block,
+    // that might not be always true. Unlikely though, and always relaying
+    // these again might cause a spike of traffic as many nodes re-relay
+    // all the transactions in a popped block when a reorg happens.
+    bool r = m_tx_pool.add_tx(*tx, tvc, true, true, false, version);
+    if (!r)
+    {
+      LOG_ERROR("Error returning transaction to tx_pool");
     }
   }
   update_next_cumulative_size_limit();
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
 
-  return popped_block;
+  return std::list<block>(popped_blocks.begin(), popped_blocks.end());
 }
 //------------------------------------------------------------------
 bool Blockchain::reset_and_set_genesis_block(const block& b)
@@ -527,6 +606,9 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
   m_timestamps_and_difficulties_height = 0;
   m_alternative_chains.clear();
   m_db->reset();
+  m_block_entry_cache.clear();
+  m_verified_headers.clear();
+  invalidate_block_template_cache();
   m_hardfork->init();
 
   block_verification_context bvc = boost::value_initialized<block_verification_context>();
@@ -765,10 +847,7 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
   m_timestamps_and_difficulties_height = 0;
 
   // remove blocks from blockchain until we get back to where we should be.
-  while (m_db->height() != rollback_height)
-  {
-    pop_block_from_blockchain();
-  }
+  pop_blocks_from_blockchain(m_db->height() - rollback_height);
 
   // make sure the hard fork object updates its current version
   m_hardfork->reorganize_from_chain_height(rollback_height);
@@ -812,14 +891,8 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 
   // pop blocks from the blockchain until the top block is the parent
   // of the front block of the alt chain.
-  std::list<block> disconnected_chain;
-  while (m_db->top_block_hash() != alt_chain.front()->second.bl.prev_id)
-  {
-    block b = pop_block_from_blockchain();
-    disconnected_chain.push_front(b);
-  }
-
-  auto split_height = m_db->height();
+  const uint64_t split_height = m_db->get_block_height(alt_chain.front()->second.bl.prev_id) + 1;
+  std::list<block> disconnected_chain = pop_blocks_from_blockchain(m_db->height() - split_height);
 
   //connecting new alternative chain
   for(auto alt_ch_iter = alt_chain.begin(); alt_ch_iter != alt_chain.end(); alt_ch_iter++)
@@ -1081,50 +1154,87 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
   LOG_PRINT_L3("Blockchain::" << __func__);
   size_t median_size;
   uint64_t already_generated_coins;
+  uint64_t pool_cookie;
 
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
   height = m_db->height();
+  const crypto::hash top_hash = get_tail_id();
+
+  // the pool cookie is atomic, if it changes just after we read it, we'll
+  // use a slightly old template, as we would have if it had changed just
+  // after the template was built anyway
+  pool_cookie = m_tx_pool.cookie();
+  if (m_btc_valid && m_btc.prev_id == top_hash && m_btc_pool_cookie == pool_cookie
+      && !memcmp(&miner_address, &m_btc_address, sizeof(account_public_address)) && m_btc_nonce == ex_nonce)
+  {
+    MDEBUG("Using cached block template");
+    b = m_btc;
+    b.timestamp = time(NULL);
+    diffic = m_btc_difficulty;
+    height = m_btc_height;
+    expected_reward = m_btc_expected_reward;
+    return true;
+  }
 
-  b.major_version = m_hardfork->get_current_version();
-
-  if (b.major_version == BLOCK_MAJOR_VERSION_2 || b.major_version == BLOCK_MAJOR_VERSION_3) {
-	  b.minor_version = 0;
-	  b.parent_block.major_version = BLOCK_MAJOR_VERSION_1;
-	  b.parent_block.minor_version = 0;
-	  b.parent_block.number_of_transactions = 1;
-	  //create MM tag
-	  tx_extra_merge_mining_tag mm_tag = boost::value_initialized<decltype(mm_tag)>();
-	  if (!append_mm_tag_to_extra(b.parent_block.miner_tx.extra, mm_tag)) {
-		  MERROR("Failed to append merge mining tag to extra of the parent block miner transaction");
-		  return false;
-	  }
+  if (m_btc_base_valid && m_btc_base.prev_id == top_hash)
+  {
+    // only the pool changed, keep what depends on the chain and refill transactions
+    MDEBUG("Updating cached block template: height " << height << ", tail id " << top_hash);
+    b = m_btc_base;
+    b.timestamp = time(NULL);
+    diffic = m_btc_base_difficulty;
+    median_size = m_btc_base_median_size;
+    already_generated_coins = m_btc_base_already_generated_coins;
   }
   else
-	b.minor_version = m_hardfork->get_ideal_version();
+  {
+    b.major_version = m_hardfork->get_current_version();
+
+    if (b.major_version == BLOCK_MAJOR_VERSION_2 || b.major_version == BLOCK_MAJOR_VERSION_3) {
+	    b.minor_version = 0;
+	    b.parent_block.major_version = BLOCK_MAJOR_VERSION_1;
+	    b.parent_block.minor_version = 0;
+	    b.parent_block.number_of_transactions = 1;
+	    //create MM tag
+	    tx_extra_merge_mining_tag mm_tag = boost::value_initialized<decltype(mm_tag)>();
+	    if (!append_mm_tag_to_extra(b.parent_block.miner_tx.extra, mm_tag)) {
+		    MERROR("Failed to append merge mining tag to extra of the parent block miner transaction");
+		    return false;
+	    }
+    }
+    else
+	  b.minor_version = m_hardfork->get_ideal_version();
 
-  b.prev_id = get_tail_id();
-  b.timestamp = time(NULL);
+    b.prev_id = top_hash;
+    b.timestamp = time(NULL);
 
-  MDEBUG("Creating block template: height " << height <<
-	  ", version " << (unsigned)b.major_version << "-" << (unsigned)b.minor_version <<
-	  ", tail id " << b.prev_id);
+    MDEBUG("Creating block template: height " << height <<
+	    ", version " << (unsigned)b.major_version << "-" << (unsigned)b.minor_version <<
+	    ", tail id " << b.prev_id);
 
-  diffic = get_difficulty_for_next_block();
-  CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
+    diffic = get_difficulty_for_next_block();
+    CHECK_AND_ASSERT_MES(diffic, false, "difficulty overhead.");
 
-  //to calculate reward without a penalty, use the full reward zone as the median, or the median size of the last 100 blocks
-  //previously median_size was cumulative limit / 2. ITNS's large blocks every 5 was making the cumulative_size_limit larger 
-  //than this but not accounting for the decreased reward correctly
-  std::vector<size_t> last_blocks_sizes;
-  get_last_n_blocks_sizes(last_blocks_sizes, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-  size_t median_last_blocks = epee::misc_utils::median(last_blocks_sizes);
-  median_size = std::max(median_last_blocks, get_min_block_size(b.major_version));
-  //the reason this is so lengthy is to accommodate for what happens in the future in validate_miner_transaction
-  //using the named constant as a reminder to change this section when we go to v5 and allow a max of (m_current_block_cumul_sz_limit / 2) for all blocks
-  if (b.major_version < BLOCK_MAJOR_VERSION_5)
-	median_size = (median_size > (m_current_block_cumul_sz_limit / 2) ? (m_current_block_cumul_sz_limit / 2) : median_size);
-  
-  already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
+    //to calculate reward without a penalty, use the full reward zone as the median, or the median size of the last 100 blocks
+    //previously median_size was cumulative limit / 2. ITNS's large blocks every 5 was making the cumulative_size_limit larger 
+    //than this but not accounting for the decreased reward correctly
+    std::vector<size_t> last_blocks_sizes;
+    get_last_n_blocks_sizes(last_blocks_sizes, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
+    size_t median_last_blocks = epee::misc_utils::median(last_blocks_sizes);
+    median_size = std::max(median_last_blocks, get_min_block_size(b.major_version));
+    //the reason this is so lengthy is to accommodate for what happens in the future in validate_miner_transaction
+    //using the named constant as a reminder to change this section when we go to v5 and allow a max of (m_current_block_cumul_sz_limit / 2) for all blocks
+    if (b.major_version < BLOCK_MAJOR_VERSION_5)
+	  median_size = (median_size > (m_current_block_cumul_sz_limit / 2) ? (m_current_block_cumul_sz_limit / 2) : median_size);
+
+    already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
+
+    m_btc_base = b;
+    m_btc_base_difficulty = diffic;
+    m_btc_base_median_size = median_size;
+    m_btc_base_already_generated_coins = already_generated_coins;
+    m_btc_base_valid = true;
+  }
 
   CRITICAL_REGION_END();
 
@@ -1258,12 +1368,58 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
     MDEBUG("Creating block template: miner tx size " << coinbase_blob_size <<
         ", cumulative size " << cumulative_size << " is now good");
 #endif
+
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    m_btc = b;
+    m_btc_address = miner_address;
+    m_btc_nonce = ex_nonce;
+    m_btc_difficulty = diffic;
+    m_btc_height = height;
+    m_btc_expected_reward = expected_reward;
+    m_btc_pool_cookie = pool_cookie;
+    m_btc_valid = true;
     return true;
   }
   LOG_ERROR("Failed to create_block_template with " << 10 << " tries");
   return false;
 }
 //------------------------------------------------------------------
+void Blockchain::invalidate_block_template_cache()
+{
+  MDEBUG("Invalidating block template cache");
+  m_btc_valid = false;
+  m_btc_base_valid = false;
+  m_longpoll_cond.notify_all();
+}
+//------------------------------------------------------------------
+std::string Blockchain::get_block_template_longpoll_id() const
+{
+  return epee::string_tools::pod_to_hex(get_tail_id()) + std::to_string(m_tx_pool.cookie());
+}
+//------------------------------------------------------------------
+bool Blockchain::wait_for_block_template_change(const std::string &longpoll_id, uint64_t timeout_ms) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  static const size_t hash_hex_size = sizeof(crypto::hash) * 2;
+  const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  const boost::posix_time::ptime deadline = start + boost::posix_time::milliseconds(timeout_ms);
+  boost::unique_lock<boost::mutex> lock(m_longpoll_mutex);
+  while (!m_cancel)
+  {
+    const std::string current_id = get_block_template_longpoll_id();
+    if (current_id.compare(0, hash_hex_size, longpoll_id, 0, hash_hex_size))
+      return true;
+    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    if (current_id != longpoll_id && now - start >= boost::posix_time::seconds(BLOCK_TEMPLATE_LONGPOLL_POOL_DELAY))
+      return true;
+    if (now >= deadline)
+      return false;
+    // the chain tip wakes us up, pool changes are picked up on the next check
+    m_longpoll_cond.timed_wait(lock, std::min(deadline, now + boost::posix_time::milliseconds(250)));
+  }
+  return false;
+}
+//------------------------------------------------------------------
 // for an alternate chain, get the timestamps from the main chain to complete
 // the needed number of timestamps for the BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW.
 bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vector<uint64_t>& timestamps)
@@ -1530,20 +1686,29 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::list<std::
 //      to use BlockchainDB, as it calls other functions that were,
 //      but it warrants some looking into later.
 //
-//FIXME: This function appears to want to return false if any transactions
-//       that belong with blocks are missing, but not if blocks themselves
-//       are missing.
+// Blocks whose transactions are missing, as on a pruned node, are reported
+// in missed_ids along with the blocks themselves missing.
 bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_db->block_txn_start(true);
   rsp.current_blockchain_height = get_current_blockchain_height();
-  std::list<std::pair<cryptonote::blobdata,block>> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
-
-  for (const auto& bl: blocks)
+  for (const auto& id: arg.blocks)
   {
+    block_complete_entry e;
+    if (m_block_entry_cache.get(id, e))
+    {
+      rsp.blocks.push_back(std::move(e));
+      continue;
+    }
+
+    std::list<std::pair<cryptonote::blobdata,block>> blocks;
+    get_blocks(std::list<crypto::hash>(1, id), blocks, rsp.missed_ids);
+    if (blocks.empty())
+      continue;
+    const auto& bl = blocks.front();
+
     std::list<crypto::hash> missed_tx_ids;
     std::list<cryptonote::blobdata> txs;
 
@@ -1553,26 +1718,30 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
 
     if (missed_tx_ids.size() != 0)
     {
-      LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
-          << " transactions for block with hash: " << get_block_hash(bl.second)
-          << std::endl
-      );
-
-      // append missed transaction hashes to response missed_ids field,
-      // as done below if any standalone transactions were requested
-      // and missed.
-      rsp.missed_ids.splice(rsp.missed_ids.end(), missed_tx_ids);
-	  m_db->block_txn_stop();
-      return false;
+      // a pruned node does not have the txes of blocks outside its stripe,
+      // which peers know from its pruning seed, so only the block is missed
+      const uint64_t height = get_block_height(bl.second);
+      if (has_unpruned_block(height, rsp.current_blockchain_height, m_db->get_pruning_seed()))
+      {
+        LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
+            << " transactions for block with hash: " << id
+            << std::endl
+        );
+      }
+      else
+      {
+        MDEBUG("Block " << id << " at height " << height << " is pruned, reporting it missed");
+      }
+      rsp.missed_ids.push_back(id);
+      continue;
     }
 
-    rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
     //pack block
     e.block = bl.first;
     //pack transactions
-    for (const cryptonote::blobdata& tx: txs)
-      e.txs.push_back(tx);
+    e.txs = std::move(txs);
+    m_block_entry_cache.add(get_block_height(bl.second), id, e);
+    rsp.blocks.push_back(std::move(e));
   }
   //get another transactions, if need
   std::list<cryptonote::blobdata> txs;
@@ -1585,6 +1754,206 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  m_db->block_txn_start(true);
+  rsp.current_blockchain_height = get_current_blockchain_height();
+  for (const auto &id: arg.blocks)
+  {
+    if (rsp.headers.size() >= BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT)
+      break;
+    try
+    {
+      rsp.headers.push_back(m_db->get_block_blob(id));
+    }
+    catch (const BLOCK_DNE& e)
+    {
+      break;
+    }
+  }
+  m_db->block_txn_stop();
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::verify_block_headers(const std::vector<block> &headers, tools::thread_group &threadpool, size_t &num_verified)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  num_verified = 0;
+  if (headers.empty())
+    return true;
+
+  struct header_check
+  {
+    crypto::hash id;
+    verified_header info;
+    bool hash_checked;
+    bool near_fork;
+    bool valid;
+    bool unverifiable;
+  };
+  std::vector<header_check> checks(headers.size());
+
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    const uint64_t db_height = m_db->height();
+    m_verified_headers.prune(db_height);
+
+    // walk back the verified headers we build on, down to the top of the blockchain
+    std::vector<verified_header> skeleton;
+    crypto::hash prev_id = headers.front().prev_id;
+    while (prev_id != m_db->top_block_hash())
+    {
+      verified_header info;
+      if (!m_verified_headers.get(prev_id, info))
+      {
+        MDEBUG("Block headers do not build on our chain, leaving them for full verification");
+        return true;
+      }
+      prev_id = info.prev_id;
+      skeleton.push_back(std::move(info));
+    }
+    uint64_t height = db_height + skeleton.size();
+
+    // the last hard fork, as the difficulty window is resized across it
+    uint8_t version = m_hardfork->get_current_version();
+    uint64_t fork_height = m_hardfork->get_earliest_ideal_height_for_version(version);
+    for (const verified_header &info: boost::adaptors::reverse(skeleton))
+    {
+      if (info.major_version != version)
+        fork_height = info.height;
+      version = info.major_version;
+    }
+
+    // difficulty window preceding the first header, oldest first
+    std::deque<uint64_t> timestamps;
+    std::deque<difficulty_type> difficulties;
+    const uint64_t max_window = DIFFICULTY_BLOCKS_COUNT;
+    for (uint64_t h = std::max<uint64_t>(1, height - std::min(height, max_window)); h < height; ++h)
+    {
+      if (h < db_height)
+      {
+        timestamps.push_back(m_db->get_block_timestamp(h));
+        difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
+      }
+      else
+      {
+        const verified_header &info = skeleton[height - 1 - h];
+        timestamps.push_back(info.timestamp);
+        difficulties.push_back(info.cumulative_difficulty);
+      }
+    }
+
+    for (size_t i = 0; i < headers.size(); ++i, ++height)
+    {
+      const block &b = headers[i];
+      header_check &check = checks[i];
+      check.id = get_block_hash(b);
+      if (i > 0 && b.prev_id != checks[i - 1].id)
+      {
+        MERROR_VER("Block header " << check.id << " does not follow " << checks[i - 1].id);
+        return false;
+      }
+
+      size_t window;
+      if (version >= BLOCK_MAJOR_VERSION_4)
+        window = DIFFICULTY_BLOCKS_COUNT_V3;
+      else if (version == BLOCK_MAJOR_VERSION_3)
+        window = DIFFICULTY_BLOCKS_COUNT_V2;
+      else
+        window = DIFFICULTY_BLOCKS_COUNT;
+      window = std::min(window, timestamps.size());
+      std::vector<uint64_t> window_timestamps(timestamps.end() - window, timestamps.end());
+      std::vector<difficulty_type> window_difficulties(difficulties.end() - window, difficulties.end());
+
+      check.info.prev_id = b.prev_id;
+      check.info.height = height;
+      check.info.timestamp = b.timestamp;
+      check.info.major_version = b.major_version;
+      check.info.difficulty = next_difficulty(version, window_timestamps, window_difficulties);
+      check.info.cumulative_difficulty = (difficulties.empty() ? 0 : difficulties.back()) + check.info.difficulty;
+      check.info.proof_of_work = null_hash;
+      check.valid = check.info.difficulty != 0 && m_checkpoints.check_block(height, check.id);
+      check.hash_checked = false;
+      if (b.major_version != version)
+        fork_height = height;
+      check.near_fork = height - std::min(height, fork_height) <= max_window;
+      check.unverifiable = false;
+#if defined(PER_BLOCK_CHECKPOINT)
+      if (height < m_blocks_hash_check.size())
+      {
+        check.hash_checked = true;
+        check.valid = check.valid && memcmp(&check.id, &m_blocks_hash_check[height], sizeof(check.id)) == 0;
+      }
+#endif
+
+      timestamps.push_back(b.timestamp);
+      difficulties.push_back(check.info.cumulative_difficulty);
+      while (timestamps.size() > max_window)
+      {
+        timestamps.pop_front();
+        difficulties.pop_front();
+      }
+      version = b.major_version;
+    }
+  }
+
+  // the expensive part: slow hashes, spread over all threads
+  TIME_MEASURE_START(t);
+  const size_t nstripes = threadpool.count() + 1;
+  tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
+    for (size_t stripe = 0; stripe < nstripes; ++stripe)
+    {
+      region.run([&, stripe] {
+        slow_hash_allocate_state();
+        for (size_t i = stripe; i < checks.size() && !m_cancel; i += nstripes)
+        {
+          header_check &check = checks[i];
+          if (check.valid && !check.hash_checked)
+          {
+            check.valid = check_proof_of_work(headers[i], check.info.difficulty, check.info.proof_of_work);
+            check.unverifiable = !check.valid && check.near_fork;
+          }
+        }
+        slow_hash_free_state();
+      });
+    }
+  });
+  TIME_MEASURE_FINISH(t);
+  if (m_cancel)
+    return true;
+
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  while (num_verified < checks.size() && checks[num_verified].valid)
+  {
+    m_verified_headers.add(checks[num_verified].info.height, checks[num_verified].id, checks[num_verified].info);
+    ++num_verified;
+  }
+  MDEBUG("Verified " << num_verified << "/" << checks.size() << " block headers from height " << checks.front().info.height << " in " << t << " ms");
+  if (num_verified < checks.size())
+  {
+    const header_check &check = checks[num_verified];
+    if (check.unverifiable)
+    {
+      // the difficulty window straddles a hard fork, our estimate may be off
+      MDEBUG("Block header " << check.id << " at height " << check.info.height << " is too close to a hard fork to verify, leaving it for full verification");
+      return true;
+    }
+    MERROR_VER("Block header " << check.id << " at height " << check.info.height << " failed verification, expected difficulty " << check.info.difficulty);
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::is_block_header_verified(const crypto::hash &id) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  verified_header info;
+  return m_verified_headers.get(id, info);
+}
+//------------------------------------------------------------------
 bool Blockchain::get_alternative_blocks(std::list<block>& blocks) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2097,7 +2466,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 // find split point between ours and foreign blockchain (or start at
 // blockchain height <req_start_block>), and return up to max_count FULL
 // blocks by reference.
-bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2126,12 +2495,42 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
   for(size_t i = start_height; i < total_height && count < max_count && (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
   {
     blocks.resize(blocks.size()+1);
-    blocks.back().first = m_db->get_block_blob_from_height(i);
-    block b;
-    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first, b), false, "internal error, invalid block");
-    std::list<crypto::hash> mis;
-    get_transactions_blobs(b.tx_hashes, blocks.back().second, mis);
-    CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
+    block_complete_entry e;
+    if (pruned || !m_block_entry_cache.get(i, e))
+    {
+      e.block = m_db->get_block_blob_from_height(i);
+      block b;
+      CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(e.block, b), false, "internal error, invalid block");
+      std::list<crypto::hash> mis;
+      if (pruned)
+      {
+        for (const auto &tx_hash: b.tx_hashes)
+        {
+          e.txs.push_back(cryptonote::blobdata());
+          if (!m_db->get_pruned_tx_blob(tx_hash, e.txs.back()))
+            mis.push_back(tx_hash);
+        }
+      }
+      else
+      {
+        get_transactions_blobs(b.tx_hashes, e.txs, mis);
+        if (!mis.empty() && m_db->get_pruning_seed())
+        {
+          cryptonote::blobdata bd;
+          if (m_db->get_pruned_tx_blob(mis.front(), bd))
+          {
+            MDEBUG("Transactions of block " << i << " are pruned, they can only be sent pruned");
+            m_db->block_txn_stop();
+            return false;
+          }
+        }
+      }
+      CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
+      if (!pruned)
+        m_block_entry_cache.add(i, get_block_hash(b), e);
+    }
+    blocks.back().first = std::move(e.block);
+    blocks.back().second = std::move(e.txs);
     size += blocks.back().first.size();
     for (const auto &t: blocks.back().second)
       size += t.size();
@@ -2328,6 +2727,25 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   }
 #endif
 
+  auto checked = m_checked_tx_inputs.find(get_transaction_hash(tx));
+  if (checked != m_checked_tx_inputs.end())
+  {
+    const tx_inputs_check check = checked->second;
+    m_checked_tx_inputs.erase(checked);
+    if (check.top_hash == get_tail_id())
+    {
+      MDEBUG("Using batch input check result for tx " << get_transaction_hash(tx));
+      if (!check.res)
+      {
+        tvc = check.tvc;
+        return false;
+      }
+      max_used_block_height = check.max_used_block_height;
+      max_used_block_id = check.max_used_block_id;
+      return true;
+    }
+  }
+
   TIME_MEASURE_START(a);
   bool res = check_tx_inputs(tx, tvc, &max_used_block_height);
   TIME_MEASURE_FINISH(a);
@@ -2344,6 +2762,150 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::check_tx_inputs_batch(const std::vector<transaction*> &txs, tools::thread_group &threadpool)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  // results from an earlier batch are either used or stale by now
+  m_checked_tx_inputs.clear();
+  if (txs.empty())
+    return;
+
+  const crypto::hash top_hash = get_tail_id();
+  TIME_MEASURE_START(t);
+
+  // a tx spending a key image also spent by an earlier tx of the batch is left
+  // out, to be checked on its own after the earlier one is added to the pool
+  std::vector<transaction*> batch;
+  std::unordered_set<crypto::key_image> key_images;
+  for (transaction *tx: txs)
+  {
+    bool conflict = false;
+    for (const auto &in: tx->vin)
+    {
+      if (in.type() == typeid(txin_to_key) && !key_images.insert(boost::get<txin_to_key>(in).k_image).second)
+        conflict = true;
+    }
+    if (conflict)
+      LOG_PRINT_L2("tx " << get_transaction_hash(*tx) << " spends a key image spent earlier in the batch");
+    else
+      batch.push_back(tx);
+  }
+
+  // read the ring members of the whole batch with one bulk query per amount,
+  // into the scan table where check_tx_inputs looks for them first
+  std::map<uint64_t, std::vector<uint64_t>> offset_map;
+  for (const transaction *tx: batch)
+  {
+    for (const auto &in: tx->vin)
+    {
+      if (in.type() != typeid(txin_to_key))
+        continue;
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+      std::vector<uint64_t> &offsets = offset_map[in_to_key.amount];
+      for (uint64_t offset: relative_output_offsets_to_absolute(in_to_key.key_offsets))
+        offsets.push_back(offset);
+    }
+  }
+  std::map<uint64_t, std::vector<output_data_t>> output_map;
+  for (auto &offsets: offset_map)
+  {
+    std::sort(offsets.second.begin(), offsets.second.end());
+    offsets.second.erase(std::unique(offsets.second.begin(), offsets.second.end()), offsets.second.end());
+    std::vector<output_data_t> &outputs = output_map[offsets.first];
+    try
+    {
+      m_db->get_output_key(offsets.first, offsets.second, outputs, true);
+    }
+    catch (const std::exception &e)
+    {
+      // check_tx_inputs reads them one at a time, and reports any missing
+      MDEBUG("Failed to read ring members with amount " << offsets.first << ": " << e.what());
+      outputs.clear();
+    }
+  }
+
+  // the scan table may hold entries for blocks being added, which are kept
+  std::vector<crypto::hash> scanned;
+  for (const transaction *tx: batch)
+  {
+    const crypto::hash tx_prefix_hash = get_transaction_prefix_hash(*tx);
+    auto its = m_scan_table.find(tx_prefix_hash);
+    if (its != m_scan_table.end())
+      continue;
+    its = m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>()).first;
+    scanned.push_back(tx_prefix_hash);
+    for (const auto &in: tx->vin)
+    {
+      if (in.type() != typeid(txin_to_key))
+        continue;
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+      const std::vector<uint64_t> &offsets = offset_map[in_to_key.amount];
+      const std::vector<output_data_t> &found = output_map[in_to_key.amount];
+      std::vector<output_data_t> outputs;
+      for (uint64_t offset: relative_output_offsets_to_absolute(in_to_key.key_offsets))
+      {
+        const size_t pos = std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+        if (pos >= found.size())
+          break;
+        outputs.push_back(found[pos]);
+      }
+      its->second.emplace(in_to_key.k_image, std::move(outputs));
+    }
+  }
+  TIME_MEASURE_FINISH(t);
+
+  // the expensive part: signatures, one tx per task, each checked inline as
+  // the tasks already use all threads. Tasks do not take the blockchain lock,
+  // this thread holds it for them
+  std::vector<tx_inputs_check> checks(batch.size());
+  TIME_MEASURE_START(t_check);
+  tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+      region.run([&, i] {
+        tx_inputs_check &check = checks[i];
+        try
+        {
+          check.res = check_tx_inputs(*batch[i], check.tvc, &check.max_used_block_height, false);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR_VER("Exception checking tx inputs: " << e.what());
+          check.res = false;
+          check.tvc.m_verifivation_failed = true;
+        }
+      });
+    }
+  });
+  TIME_MEASURE_FINISH(t_check);
+  for (const crypto::hash &tx_prefix_hash: scanned)
+    m_scan_table.erase(tx_prefix_hash);
+
+  const uint64_t height = m_db->height();
+  for (size_t i = 0; i < batch.size(); ++i)
+  {
+    tx_inputs_check &check = checks[i];
+    check.top_hash = top_hash;
+    if (check.res)
+    {
+      if (check.max_used_block_height >= height)
+        continue;
+      check.max_used_block_id = m_db->get_block_hash_from_height(check.max_used_block_height);
+    }
+    m_checked_tx_inputs[get_transaction_hash(*batch[i])] = check;
+  }
+  MDEBUG("Checked inputs of " << batch.size() << "/" << txs.size() << " txes in " << t << " + " << t_check << " ms");
+}
+//------------------------------------------------------------------
+bool Blockchain::has_tx_inputs_check(const crypto::hash &txid) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_checked_tx_inputs.find(txid) != m_checked_tx_inputs.end();
+}
+//------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2480,7 +3042,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, bool threaded)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2561,19 +3123,21 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     }
   }
 
-  auto it = m_check_txin_table.find(tx_prefix_hash);
-  if(it == m_check_txin_table.end())
+  // the table may be used by several threads at once from check_tx_inputs_batch,
+  // references to its values stay valid as it grows
+  std::unordered_map<crypto::key_image, bool> *txin_results_ptr;
   {
-    m_check_txin_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, bool>());
-    it = m_check_txin_table.find(tx_prefix_hash);
-    assert(it != m_check_txin_table.end());
+    boost::lock_guard<boost::mutex> txin_table_lock(m_check_txin_table_lock);
+    txin_results_ptr = &m_check_txin_table[tx_prefix_hash];
   }
+  std::unordered_map<crypto::key_image, bool> &txin_results = *txin_results_ptr;
 
   std::vector<std::vector<rct::ctkey>> pubkeys(tx.vin.size());
   std::vector < uint64_t > results;
   results.resize(tx.vin.size(), 0);
 
-  int threads = tools::get_max_concurrency();
+  // only v1 ring signatures are checked on threads, and not from a worker thread
+  int threads = tx.version == 1 && threaded ? tools::get_max_concurrency() : 1;
 
   boost::asio::io_service ioservice;
   boost::thread_group threadpool;
@@ -2611,7 +3175,8 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     // make sure tx output has key offset(s) (is signed to be used)
     CHECK_AND_ASSERT_MES(in_to_key.key_offsets.size(), false, "empty in_to_key.key_offsets in transaction with id " << get_transaction_hash(tx));
 
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
+    // not have_tx_keyimg_as_spent, which locks, as this may run on several threads for check_tx_inputs_batch
+    if(m_db->has_key_image(in_to_key.k_image))
     {
       MERROR_VER("Key image already spent in blockchain: " << epee::string_tools::pod_to_hex(in_to_key.k_image));
       tvc.m_double_spend = true;
@@ -2624,8 +3189,8 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       CHECK_AND_ASSERT_MES(sig_index < tx.signatures.size(), false, "wrong transaction: not signature entry for input with index= " << sig_index);
 
 #if defined(CACHE_VIN_RESULTS)
-      auto itk = it->second.find(in_to_key.k_image);
-      if(itk != it->second.end())
+      auto itk = txin_results.find(in_to_key.k_image);
+      if(itk != txin_results.end())
       {
         if(!itk->second)
         {
@@ -2644,7 +3209,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     // signature spending it.
     if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height))
     {
-      it->second[in_to_key.k_image] = false;
+      txin_results[in_to_key.k_image] = false;
       MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
       if (pmax_used_block_height) // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
       {
@@ -2667,7 +3232,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         check_ring_signature(tx_prefix_hash, in_to_key.k_image, pubkeys[sig_index], tx.signatures[sig_index], results[sig_index]);
         if (!results[sig_index])
         {
-          it->second[in_to_key.k_image] = false;
+          txin_results[in_to_key.k_image] = false;
           MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
 
           if (pmax_used_block_height)  // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
@@ -2677,7 +3242,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
           return false;
         }
-        it->second[in_to_key.k_image] = true;
+        txin_results[in_to_key.k_image] = true;
       }
     }
 
@@ -2695,7 +3260,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       for (size_t i = 0; i < tx.vin.size(); i++)
       {
         const txin_to_key& in_to_key = boost::get<txin_to_key>(tx.vin[i]);
-        it->second[in_to_key.k_image] = results[i];
+        txin_results[in_to_key.k_image] = results[i];
         if(!failed && !results[i])
           failed = true;
       }
@@ -3171,6 +3736,9 @@ bool Blockchain::handle_block_to_main_chain(const block& bl, const crypto::hash&
   {
     MERROR_VER("Block with id: " << id << std::endl << "has wrong prev_id: " << bl.prev_id << std::endl << "expected: " << get_tail_id());
 leave:
+    // headers verified ahead of this block build on a body that turned out invalid
+    if (bvc.m_verifivation_failed)
+      m_verified_headers.invalidate(m_db->height());
     m_db->block_txn_stop();
     return false;
   }
@@ -3236,6 +3804,18 @@ leave:
   // validate proof_of_work versus difficulty target
   bool precomputed = false;
   bool fast_check = false;
+  bool header_verified = false;
+  {
+    // the PoW may have been checked already, against this same difficulty, by headers-first sync
+    verified_header info;
+    m_verified_headers.prune(m_db->height());
+    if (m_verified_headers.take(id, info))
+    {
+      header_verified = info.difficulty == current_diffic && info.proof_of_work != null_hash;
+      if (header_verified)
+        proof_of_work = info.proof_of_work;
+    }
+  }
 #if defined(PER_BLOCK_CHECKPOINT)
   if (m_db->height() < m_blocks_hash_check.size())
   {
@@ -3256,6 +3836,10 @@ leave:
     {
       precomputed = true;
       proof_of_work = it->second;
+    }
+    else if (header_verified)
+    {
+      precomputed = true;
     }
 	else
 	{
@@ -3464,6 +4048,7 @@ leave:
     {
       LOG_ERROR("Error adding block with hash: " << id << " to blockchain, what = " << e.what());
       bvc.m_verifivation_failed = true;
+      m_verified_headers.invalidate(m_db->height());
       return_tx_to_pool(txs);
       return false;
     }
@@ -3497,6 +4082,7 @@ leave:
 
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
+  invalidate_block_template_cache();
 
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
@@ -3708,14 +4294,15 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
         store_blockchain();
       m_sync_counter = 0;
     }
+    else if (m_db_sync_mode == db_async)
+    {
+      // commits are not synced, so sync on a time basis too
+      if (m_db_blocks_per_sync && (m_sync_counter >= m_db_blocks_per_sync || time(NULL) - m_async_sync_time >= DB_ASYNC_SYNC_INTERVAL))
+        queue_async_store_blockchain();
+    }
     else if (m_db_blocks_per_sync && m_sync_counter >= m_db_blocks_per_sync)
     {
-      if(m_db_sync_mode == db_async)
-      {
-        m_sync_counter = 0;
-        m_async_service.dispatch(boost::bind(&Blockchain::store_blockchain, this));
-      }
-      else if(m_db_sync_mode == db_sync)
+      if(m_db_sync_mode == db_sync)
       {
         store_blockchain();
       }
@@ -4148,6 +4735,11 @@ cryptonote::blobdata Blockchain::get_txpool_tx_blob(const crypto::hash& txid) co
   return m_db->get_txpool_tx_blob(txid);
 }
 
+bool Blockchain::get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const
+{
+  return m_db->get_txpool_tx_key_images(txid, key_images);
+}
+
 bool Blockchain::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob) const
 {
   return m_db->for_all_txpool_txes(f, include_blob);
@@ -4345,4 +4937,5 @@ bool Blockchain::for_all_outputs(std::function<bool(uint64_t amount, const crypt
 
 namespace cryptonote {
 template bool Blockchain::get_transactions(const std::vector<crypto::hash>&, std::list<transaction>&, std::list<crypto::hash>&) const;
+template bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>&, std::list<cryptonote::blobdata>&, std::list<crypto::hash>&) const;
 }
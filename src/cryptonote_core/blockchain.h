@@ -37,6 +37,8 @@
 #include <boost/multi_index/global_fun.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <atomic>
 #include <unordered_map>
 #include <unordered_set>
@@ -45,6 +47,8 @@
 #include "string_tools.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/common_fwd.h"
+#include "common/thread_group.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -54,6 +58,8 @@
 #include "cryptonote_basic/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "block_entry_cache.h"
+#include "verified_header_cache.h"
 
 namespace cryptonote
 {
@@ -331,6 +337,30 @@ namespace cryptonote
      */
     bool create_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce);
 
+    /**
+     * @brief gets an id for the state new block templates are built from
+     *
+     * The id changes when the chain tip changes, or when transactions are
+     * added to or removed from the pool.
+     *
+     * @return the id, to be passed back to wait_for_block_template_change
+     */
+    std::string get_block_template_longpoll_id() const;
+
+    /**
+     * @brief waits until a new block template would differ from the one matching an id
+     *
+     * Returns as soon as the chain tip changes. A pool change only ends the
+     * wait once BLOCK_TEMPLATE_LONGPOLL_POOL_DELAY seconds have passed, so a
+     * busy pool does not keep miners switching work all the time.
+     *
+     * @param longpoll_id the id returned along with the previous template
+     * @param timeout_ms how long to wait at most, in milliseconds
+     *
+     * @return true if the template changed, false on timeout or cancellation
+     */
+    bool wait_for_block_template_change(const std::string &longpoll_id, uint64_t timeout_ms) const;
+
     /**
      * @brief checks if a block is known about with a given hash
      *
@@ -407,10 +437,12 @@ namespace cryptonote
      * @param total_height return-by-reference our current blockchain height
      * @param start_height return-by-reference the height of the first block returned
      * @param max_count the max number of blocks to get
+     * @param pruned return the transactions without their prunable data
      *
-     * @return true if a block found in common or req_start_block specified, else false
+     * @return true if a block found in common or req_start_block specified, else false,
+     *         or if a transaction was pruned from our db and pruned is false
      */
-    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, bool pruned = false) const;
 
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
@@ -426,6 +458,52 @@ namespace cryptonote
      */
     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp);
 
+    /**
+     * @brief retrieves a set of block headers for headers-first sync
+     *
+     * For each requested hash, the block blob (header, miner tx and tx hashes)
+     * is fetched without the block's transactions.  Fetching stops at the first
+     * unknown block, or after BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT blocks.
+     *
+     * @param arg the request
+     * @param rsp return-by-reference the response to fill in
+     *
+     * @return true
+     */
+    bool handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp) const;
+
+    /**
+     * @brief verifies proof of work for a run of block headers ahead of their bodies
+     *
+     * The headers must be consecutive, and the first one must build on either
+     * the top of the blockchain or a previously verified header.  Difficulties
+     * are computed serially along the run, then the PoW hashes are checked in
+     * parallel on the given threadpool.  Headers that do not connect are left
+     * alone, as their bodies will be fully verified when added anyway.
+     *
+     * Verified headers are remembered, so that their PoW does not need to be
+     * computed again when the full block is added to the main chain.  A header
+     * whose difficulty window spans a hard fork may legitimately not match the
+     * difficulty computed here, so a failure there only stops the run, and
+     * that header and the following ones are left for full verification.
+     *
+     * @param headers the consecutive block headers to verify
+     * @param threadpool the threads to spread the PoW checks over
+     * @param num_verified return-by-reference the number of leading headers verified
+     *
+     * @return false if any header fails verification, true otherwise
+     */
+    bool verify_block_headers(const std::vector<block> &headers, tools::thread_group &threadpool, size_t &num_verified);
+
+    /**
+     * @brief checks whether a block header has already been verified ahead of its body
+     *
+     * @param id the hash of the block
+     *
+     * @return true if the header was verified by verify_block_headers, else false
+     */
+    bool is_block_header_verified(const crypto::hash &id) const;
+
     /**
      * @brief gets random outputs to mix with
      *
@@ -497,6 +575,16 @@ namespace cryptonote
      */
     bool store_blockchain();
 
+    /**
+     * @brief drops state cached from the database
+     *
+     * Used when another process writes to the database, as with a read-only
+     * replica: blocks may have been added or popped behind our back, so the
+     * difficulty, size limit, hard fork and block caches are rebuilt from
+     * what is now stored.
+     */
+    void reload_db_state();
+
     /**
      * @brief validates a transaction's inputs
      *
@@ -515,6 +603,32 @@ namespace cryptonote
      */
     bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false);
 
+    /**
+     * @brief checks the inputs of a batch of transactions concurrently
+     *
+     * Runs the checks of check_tx_inputs on each transaction, spread over
+     * the given threads, with the blockchain locked once for the whole
+     * batch. Ring members are read up front with one query per amount, and
+     * transactions spending a key image spent by an earlier one of the batch
+     * are left out. The results are kept until the next batch, and used by
+     * check_tx_inputs on the same transactions if the chain did not change
+     * meanwhile, so they can then be added to the pool one at a time
+     * without checking their inputs again.
+     *
+     * @param txs the transactions to check
+     * @param threadpool the threads to check on
+     */
+    void check_tx_inputs_batch(const std::vector<transaction*> &txs, tools::thread_group &threadpool);
+
+    /**
+     * @brief checks whether a batch input check result is kept for a transaction
+     *
+     * @param txid the transaction hash
+     *
+     * @return true if check_tx_inputs_batch left a result for check_tx_inputs to use
+     */
+    bool has_tx_inputs_check(const crypto::hash &txid) const;
+
     /**
      * @brief get dynamic per kB fee for a given block size
      *
@@ -852,6 +966,16 @@ namespace cryptonote
       return *m_db;
     }
 
+    /**
+     * @brief get the worker threads of the blockchain, shared with the core
+     *
+     * @return a reference to the thread pool
+     */
+    tools::thread_group& get_threadpool()
+    {
+      return m_threadpool;
+    }
+
     /**
      * @brief get a number of outputs of a specific amount
      *
@@ -888,6 +1012,7 @@ namespace cryptonote
     txpool_tx_meta_t get_txpool_tx_meta(const crypto::hash& txid) const;
     bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const;
     cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
+    bool get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const;
     bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false) const;
 
     bool is_within_compiled_block_hash_area(uint64_t height) const;
@@ -937,6 +1062,26 @@ namespace cryptonote
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
+    boost::mutex m_check_txin_table_lock;
+
+    //! result of an input check done ahead of adding a transaction to the pool
+    struct tx_inputs_check
+    {
+      crypto::hash top_hash;
+      bool res;
+      uint64_t max_used_block_height;
+      crypto::hash max_used_block_id;
+      tx_verification_context tvc;
+    };
+
+    //! input check results from check_tx_inputs_batch, by transaction hash
+    std::unordered_map<crypto::hash, tx_inputs_check> m_checked_tx_inputs;
+
+    // block headers verified ahead of their bodies (headers-first sync)
+    mutable verified_header_cache m_verified_headers;
+
+    // block and tx blobs recently sent to peers and wallets, likely to be asked for again
+    mutable block_entry_cache m_block_entry_cache;
 
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<crypto::hash> m_blocks_hash_check;
@@ -957,8 +1102,31 @@ namespace cryptonote
 
     boost::asio::io_service m_async_service;
     boost::thread_group m_async_pool;
+
+    // checks inputs of txes returned to the pool when popping blocks
+    tools::thread_group m_threadpool;
     std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
 
+    // syncs handed to the async thread, at most one at a time
+    boost::mutex m_async_sync_lock;
+    boost::condition_variable m_async_sync_cond;
+    bool m_async_sync_pending;
+    uint64_t m_async_sync_time;
+
+    /**
+     * @brief stores the blockchain on the async thread, then flags the sync done
+     */
+    void async_store_blockchain();
+
+    /**
+     * @brief hands a sync to the async thread, unless one is already pending
+     *
+     * Commits do not wait for syncs, so the database may get ahead of what
+     * is on disk. To bound that, if a sync is pending since too long, or
+     * too many blocks were committed since, this waits for it to finish.
+     */
+    void queue_async_store_blockchain();
+
     // all alternative chains
     blocks_ext_by_hash m_alternative_chains; // crypto::hash -> block_extended_info
 
@@ -975,6 +1143,32 @@ namespace cryptonote
 
     std::atomic<bool> m_cancel;
 
+    // the last block template, reused while the tip, the pool, the address and the nonce do not change
+    block m_btc;
+    account_public_address m_btc_address;
+    blobdata m_btc_nonce;
+    difficulty_type m_btc_difficulty;
+    uint64_t m_btc_height;
+    uint64_t m_btc_expected_reward;
+    uint64_t m_btc_pool_cookie;
+    bool m_btc_valid;
+
+    // the chain dependent parts of a block template, reused while the tip does not change
+    block m_btc_base;
+    difficulty_type m_btc_base_difficulty;
+    size_t m_btc_base_median_size;
+    uint64_t m_btc_base_already_generated_coins;
+    bool m_btc_base_valid;
+
+    // woken up when the chain tip changes, for long polling block templates
+    mutable boost::mutex m_longpoll_mutex;
+    mutable boost::condition_variable m_longpoll_cond;
+
+    /**
+     * @brief invalidates any cached block template, and wakes up long polls
+     */
+    void invalidate_block_template_cache();
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1036,10 +1230,12 @@ namespace cryptonote
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param threaded whether v1 ring signatures may be checked on threads of
+     *        their own, false when already running on a worker thread
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, bool threaded = true);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1056,11 +1252,18 @@ namespace cryptonote
     bool switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain, bool discard_disconnected_chain);
 
     /**
-     * @brief removes the most recent block from the blockchain
+     * @brief removes the most recent blocks from the blockchain
+     *
+     * The blocks are removed by a single BlockchainDB::pop_blocks call.
+     * Their transactions are returned to the tx_pool once all of them are
+     * removed, with their inputs checked in one batch against the resulting
+     * chain and hard fork version.
+     *
+     * @param nblocks the number of blocks to remove
      *
-     * @return the block removed
+     * @return the blocks removed, oldest first
      */
-    block pop_block_from_blockchain();
+    std::list<block> pop_blocks_from_blockchain(uint64_t nblocks);
 
     /**
      * @brief validate and add a new block to the end of the blockchain
@@ -74,8 +74,10 @@ namespace cryptonote
               m_last_dns_checkpoints_update(0),
               m_last_json_checkpoints_update(0),
               m_disable_dns_checkpoints(false),
-              m_threadpool(tools::thread_group::optimal()),
-              m_update_download(0)
+              m_threadpool(m_blockchain_storage.get_threadpool()),
+              m_update_download(0),
+              m_read_only_replica(false),
+              m_replica_top_hash(null_hash)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -160,8 +162,12 @@ namespace cryptonote
     command_line::add_arg(desc, command_line::arg_fast_block_sync);
     command_line::add_arg(desc, command_line::arg_show_time_stats);
     command_line::add_arg(desc, command_line::arg_block_sync_size);
+    command_line::add_arg(desc, command_line::arg_block_sync_requests);
     command_line::add_arg(desc, command_line::arg_check_updates);
+    command_line::add_arg(desc, command_line::arg_max_txpool_size);
     command_line::add_arg(desc, command_line::arg_fluffy_blocks);
+    command_line::add_arg(desc, command_line::arg_headers_first_sync);
+    command_line::add_arg(desc, command_line::arg_tx_relay_flush_interval);
 
     // we now also need some of net_node's options (p2p bind arg, for separate data dir)
     command_line::add_arg(desc, nodetool::arg_testnet_p2p_bind_port, false);
@@ -199,6 +205,8 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, command_line::arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, command_line::arg_test_drop_download_height));
     m_fluffy_blocks_enabled = m_testnet || get_arg(vm, command_line::arg_fluffy_blocks);
+    m_headers_first_sync_enabled = get_arg(vm, command_line::arg_headers_first_sync);
+    m_read_only_replica = get_arg(vm, cryptonote::arg_db_read_only_replica);
 
     if (command_line::get_arg(vm, command_line::arg_test_drop_download) == true)
       test_drop_download();
@@ -388,6 +396,13 @@ namespace cryptonote
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
 
+      // the daemon owning the database does all the writing and syncing
+      if (m_read_only_replica)
+      {
+        db_flags = DBF_RDONLY;
+        sync_mode = db_nosync;
+      }
+
       db->open(filename, db_flags);
       if(!db->m_open)
         return false;
@@ -402,25 +417,46 @@ namespace cryptonote
         blocks_per_sync, sync_mode, fast_sync);
 
     r = m_blockchain_storage.init(db, m_testnet, test_options);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
     r = m_mempool.init();
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
-    // now that we have a valid m_blockchain_storage, we can clean out any
-    // transactions in the pool that do not conform to the current fork
-    m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+    if (m_read_only_replica)
+    {
+      MGINFO("Running as a read-only replica, the blockchain will follow the database at height " << db->height());
+      m_replica_top_hash = db->top_block_hash();
+    }
+    else
+    {
+      // now that we have a valid m_blockchain_storage, we can clean out any
+      // transactions in the pool that do not conform to the current fork
+      m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+
+      // a replica can't prune the shared pool, the primary keeps it in bounds
+      m_mempool.set_txpool_max_size(command_line::get_arg(vm, command_line::arg_max_txpool_size));
+    }
 
     bool show_time_stats = command_line::get_arg(vm, command_line::arg_show_time_stats) != 0;
     m_blockchain_storage.set_show_time_stats(show_time_stats);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
+
+    // also catches up on a prune that was interrupted
+    if ((command_line::get_arg(vm, cryptonote::arg_db_prune) || db->get_pruning_seed()) && !db->is_read_only())
+    {
+      r = db->prune_blockchain();
+      CHECK_AND_ASSERT_MES(r, false, "Failed to prune blockchain");
+    }
 
     block_sync_size = command_line::get_arg(vm, command_line::arg_block_sync_size);
+    block_sync_requests = std::max<size_t>(1, command_line::get_arg(vm, command_line::arg_block_sync_requests));
 
     MGINFO("Loading checkpoints");
 
     // load json & DNS checkpoints, and verify them
     // with respect to what blocks we already have
-    CHECK_AND_ASSERT_MES(update_checkpoints(), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
+    // a replica leaves that to the writer, since a conflict would pop blocks
+    if (!m_read_only_replica)
+      CHECK_AND_ASSERT_MES(update_checkpoints(), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
 
    // DNS versions checking
     if (check_updates_string == "disabled")
@@ -615,10 +651,12 @@ namespace cryptonote
         if(m_mempool.have_tx(results[i].hash))
         {
           LOG_PRINT_L2("tx " << results[i].hash << "already have transaction in tx_pool");
+          results[i].in_txpool = true;
         }
         else if(m_blockchain_storage.have_tx(results[i].hash))
         {
           LOG_PRINT_L2("tx " << results[i].hash << " already have transaction in blockchain");
+          results[i].in_blockchain = true;
         }
         else
         {
@@ -637,6 +675,25 @@ namespace cryptonote
       }
     });
 
+    // check the inputs of the batch concurrently, the pool then adds the txes
+    // one at a time without checking them again. A tx spending a key image
+    // also spent by a pool tx is left for the pool to sort out, the batch
+    // leaves out those conflicting with an earlier tx of the batch itself
+    if (!keeped_by_block)
+    {
+      std::vector<transaction*> to_check;
+      for (size_t i = 0; i < tx_blobs.size(); i++) {
+        if (!results[i].res || results[i].in_txpool || results[i].in_blockchain)
+          continue;
+        if (m_mempool.have_tx_keyimges_as_spent(results[i].tx))
+          LOG_PRINT_L2("tx " << results[i].hash << " spends a key image spent in the pool");
+        else
+          to_check.push_back(&results[i].tx);
+      }
+      if (to_check.size() > 1)
+        m_blockchain_storage.check_tx_inputs_batch(to_check, m_threadpool);
+    }
+
     bool ok = true;
     std::list<blobdata>::const_iterator it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -811,6 +868,16 @@ namespace cryptonote
     return (version >= BLOCK_MAJOR_VERSION_4 ? BLOCKS_SYNCHRONIZING_DEFAULT_COUNT : BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4);
   }
   //-----------------------------------------------------------------------------------------------
+  size_t core::get_block_sync_requests() const
+  {
+    return block_sync_requests;
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint32_t core::get_blockchain_pruning_seed() const
+  {
+    return m_blockchain_storage.get_db().get_pruning_seed();
+  }
+  //-----------------------------------------------------------------------------------------------
   std::pair<uint64_t, uint64_t> core::get_coinbase_tx_sum(const uint64_t start_offset, const size_t count)
   {
     uint64_t emission_amount = 0;
@@ -952,14 +1019,24 @@ namespace cryptonote
     return m_blockchain_storage.create_block_template(b, adr, diffic, height, expected_reward, ex_nonce);
   }
   //-----------------------------------------------------------------------------------------------
+  std::string core::get_block_template_longpoll_id() const
+  {
+    return m_blockchain_storage.get_block_template_longpoll_id();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::wait_for_block_template_change(const std::string &longpoll_id, uint64_t timeout_ms) const
+  {
+    return m_blockchain_storage.wait_for_block_template_change(longpoll_id, timeout_ms);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
   {
     return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, bool pruned) const
   {
-    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, max_count);
+    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, max_count, pruned);
   }
   //-----------------------------------------------------------------------------------------------
   void core::print_blockchain(uint64_t start_index, uint64_t end_index) const
@@ -1222,6 +1299,21 @@ namespace cryptonote
     return m_blockchain_storage.handle_get_objects(arg, rsp);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, cryptonote_connection_context& context)
+  {
+    return m_blockchain_storage.handle_get_block_headers(arg, rsp);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::verify_block_headers(const std::vector<block> &headers, size_t &num_verified)
+  {
+    return m_blockchain_storage.verify_block_headers(headers, m_threadpool, num_verified);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::is_block_header_verified(const crypto::hash &id) const
+  {
+    return m_blockchain_storage.is_block_header_verified(id);
+  }
+  //-----------------------------------------------------------------------------------------------
   crypto::hash core::get_block_id_by_height(uint64_t height) const
   {
     return m_blockchain_storage.get_block_id_by_height(height);
@@ -1245,6 +1337,13 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::on_idle()
   {
+    if (m_read_only_replica)
+    {
+      m_fork_moaner.do_call(boost::bind(&core::check_fork_time, this));
+      m_replica_refresher.do_call(boost::bind(&core::refresh_replica, this));
+      return true;
+    }
+
     if(!m_starter_message_showed)
     {
       MGINFO_YELLOW(ENDL << "**********************************************************************" << ENDL
@@ -1266,6 +1365,29 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::refresh_replica()
+  {
+    try
+    {
+      uint64_t top_height;
+      const crypto::hash top_hash = m_blockchain_storage.get_tail_id(top_height);
+      if (top_hash != m_replica_top_hash)
+      {
+        MINFO("Database top block is now " << top_hash << " at height " << top_height << ", reloading");
+        m_blockchain_storage.reload_db_state();
+        m_replica_top_hash = top_hash;
+      }
+      // the pool can change without changing size, so it is compared by hash
+      if (!m_mempool.sync_with_db())
+        MERROR("Failed to sync the txpool with the database");
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to refresh from the database: " << e.what());
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::check_fork_time()
   {
     HardFork::State state = m_blockchain_storage.get_hard_fork_state();
@@ -90,6 +90,28 @@ namespace cryptonote
      */
      bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context);
 
+     /**
+      * @copydoc Blockchain::handle_get_block_headers
+      *
+      * @note see Blockchain::handle_get_block_headers()
+      * @param context connection context associated with the request
+      */
+     bool handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, cryptonote_connection_context& context);
+
+     /**
+      * @brief verifies proof of work for a run of block headers, using the core's threadpool
+      *
+      * @note see Blockchain::verify_block_headers()
+      */
+     bool verify_block_headers(const std::vector<block> &headers, size_t &num_verified);
+
+     /**
+      * @copydoc Blockchain::is_block_header_verified
+      *
+      * @note see Blockchain::is_block_header_verified()
+      */
+     bool is_block_header_verified(const crypto::hash &id) const;
+
      /**
       * @brief calls various idle routines
       *
@@ -199,6 +221,20 @@ namespace cryptonote
       */
      virtual bool get_block_template(block& b, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce);
 
+     /**
+      * @copydoc Blockchain::get_block_template_longpoll_id
+      *
+      * @note see Blockchain::get_block_template_longpoll_id
+      */
+     std::string get_block_template_longpoll_id() const;
+
+     /**
+      * @copydoc Blockchain::wait_for_block_template_change
+      *
+      * @note see Blockchain::wait_for_block_template_change
+      */
+     bool wait_for_block_template_change(const std::string &longpoll_id, uint64_t timeout_ms) const;
+
      /**
       * @brief called when a transaction is relayed
       */
@@ -498,11 +534,11 @@ namespace cryptonote
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
 
      /**
-      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >&, uint64_t&, uint64_t&, size_t) const
+      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >&, uint64_t&, uint64_t&, size_t, bool) const
       *
-      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<cryptonote::blobdata, std::list<transaction> > >&, uint64_t&, uint64_t&, size_t) const
+      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::list<std::pair<cryptonote::blobdata, std::list<transaction> > >&, uint64_t&, uint64_t&, size_t, bool) const
       */
-     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const;
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, bool pruned = false) const;
 
      /**
       * @brief gets some stats about the daemon
@@ -714,6 +750,20 @@ namespace cryptonote
       */
      size_t get_block_sync_size(uint64_t height) const;
 
+     /**
+      * @brief get the max number of block span requests in flight to one peer
+      *
+      * @return the max number of block span requests in flight to one peer
+      */
+     size_t get_block_sync_requests() const;
+
+     /**
+      * @brief get the pruning seed of the blockchain database
+      *
+      * @return 0 if the database is not pruned, its pruning stripe otherwise
+      */
+     uint32_t get_blockchain_pruning_seed() const;
+
      /**
       * @brief get the sum of coinbase tx amounts between blocks
       *
@@ -735,6 +785,20 @@ namespace cryptonote
       */
      bool fluffy_blocks_enabled() const { return m_fluffy_blocks_enabled; }
 
+     /**
+      * @brief get whether headers-first sync is enabled
+      *
+      * @return whether headers-first sync is enabled
+      */
+     bool headers_first_sync_enabled() const { return m_headers_first_sync_enabled; }
+
+     /**
+      * @brief get whether we serve another daemon's database read only
+      *
+      * @return whether we are a read-only replica
+      */
+     bool is_read_only_replica() const { return m_read_only_replica; }
+
    private:
 
      /**
@@ -894,6 +958,16 @@ namespace cryptonote
       */
      bool check_updates();
 
+     /**
+      * @brief picks up changes made to the database by the daemon owning it
+      *
+      * Reloads the cached blockchain state when the top block changed, and
+      * applies the txpool changes.
+      *
+      * @return true
+      */
+     bool refresh_replica();
+
      bool m_test_drop_download = true; //!< whether or not to drop incoming blocks (for testing)
 
      uint64_t m_test_drop_download_height = 0; //!< height under which to drop incoming blocks, if doing so
@@ -917,6 +991,7 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<60*60*2, true> m_fork_moaner; //!< interval for checking HardFork status
      epee::math_helper::once_a_time_seconds<60*2, false> m_txpool_auto_relayer; //!< interval for checking re-relaying txpool transactions
      epee::math_helper::once_a_time_seconds<60*60*12, true> m_check_updates_interval; //!< interval for checking for new versions
+     epee::math_helper::once_a_time_seconds<1, true> m_replica_refresher; //!< interval for checking for database changes, in replica mode
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -934,13 +1009,14 @@ namespace cryptonote
      bool m_disable_dns_checkpoints;
 
      size_t block_sync_size;
+     size_t block_sync_requests;
 
      time_t start_time;
 
      std::unordered_set<crypto::hash> bad_semantics_txes[2];
      boost::mutex bad_semantics_txes_lock;
 
-     tools::thread_group m_threadpool;
+     tools::thread_group &m_threadpool; //!< the blockchain's worker threads
 
      enum {
        UPDATES_DISABLED,
@@ -954,6 +1030,10 @@ namespace cryptonote
      boost::mutex m_update_mutex;
 
      bool m_fluffy_blocks_enabled;
+     bool m_headers_first_sync_enabled;
+
+     bool m_read_only_replica; //!< are we serving another daemon's database read only?
+     crypto::hash m_replica_top_hash; //!< top block hash when the replica last refreshed
    };
 }
 
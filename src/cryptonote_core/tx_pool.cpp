@@ -42,8 +42,11 @@
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
 #include "misc_language.h"
+#include "profile_tools.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "common/task_region.h"
+#include "common/thread_group.h"
 #include "crypto/hash.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -63,6 +66,7 @@ namespace cryptonote
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
     float const ACCEPT_THRESHOLD = 1.0f;
+    size_t const INIT_PARSE_BATCH_SIZE = 1000; // txes read and parsed at a time when loading a pool without stored key images
 
     // a kind of increasing backoff within min/max bounds
     uint64_t get_relay_delay(time_t now, time_t received)
@@ -99,8 +103,21 @@ namespace cryptonote
     };
   }
   //---------------------------------------------------------------------------------
+  tx_memory_pool::lock_timer::lock_timer(lock_metrics &metrics): m_metrics(metrics), m_start(epee::misc_utils::get_ns_count())
+  {
+  }
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs)
+  tx_memory_pool::lock_timer::~lock_timer()
+  {
+    const uint64_t us = (epee::misc_utils::get_ns_count() - m_start) / 1000;
+    ++m_metrics.count;
+    m_metrics.total_us += us;
+    uint64_t max_us = m_metrics.max_us;
+    while (us > max_us && !m_metrics.max_us.compare_exchange_weak(max_us, us));
+  }
+  //---------------------------------------------------------------------------------
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_txpool_size(0), m_min_fee_per_byte(0), m_num_evicted(0), m_bytes_evicted(0)
   {
 
   }
@@ -109,6 +126,7 @@ namespace cryptonote
   {
     // this should already be called with that lock, but let's make it explicit for clarity
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    lock_timer timer(m_exclusive_lock_metrics);
 
     PERF_TIMER(add_tx);
     if (tx.version == 0)
@@ -172,6 +190,15 @@ namespace cryptonote
       return false;
     }
 
+    // while the pool is full, transactions paying less than the ones evicted are not accepted
+    if (!kept_by_block && fee < m_min_fee_per_byte * blob_size)
+    {
+      LOG_PRINT_L1("transaction fee is too low for the full pool: " << (fee / (double)blob_size) << " per byte, minimum " << m_min_fee_per_byte);
+      tvc.m_verifivation_failed = true;
+      tvc.m_fee_too_low = true;
+      return false;
+    }
+
     size_t tx_size_limit = get_transaction_size_limit(version);
     if (!kept_by_block && blob_size >= tx_size_limit)
     {
@@ -232,9 +259,13 @@ namespace cryptonote
           CRITICAL_REGION_LOCAL1(m_blockchain);
           LockedTXN lock(m_blockchain);
           m_blockchain.add_txpool_tx(tx, meta);
-          if (!insert_key_images(tx, kept_by_block))
+          boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+          std::vector<crypto::key_image> key_images;
+          if (!get_key_images(tx, key_images) || !insert_key_images(id, key_images, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+          add_tx_entry(id, meta, std::move(key_images));
+          ++m_cookie;
         }
         catch (const std::exception &e)
         {
@@ -271,9 +302,13 @@ namespace cryptonote
         LockedTXN lock(m_blockchain);
         m_blockchain.remove_txpool_tx(get_transaction_hash(tx));
         m_blockchain.add_txpool_tx(tx, meta);
-        if (!insert_key_images(tx, kept_by_block))
+        boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+        std::vector<crypto::key_image> key_images;
+        if (!get_key_images(tx, key_images) || !insert_key_images(id, key_images, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+        add_tx_entry(id, meta, std::move(key_images));
+        ++m_cookie;
       }
       catch (const std::exception &e)
       {
@@ -292,6 +327,13 @@ namespace cryptonote
     tvc.m_verifivation_failed = false;
 
     MINFO("Transaction added to pool: txid " << id << " bytes: " << blob_size << " fee/byte: " << (fee / (double)blob_size));
+
+    prune(m_txpool_max_size);
+    if (!have_tx(id))
+    {
+      // evicted straight away, it was the cheapest
+      tvc.m_should_be_relayed = false;
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -305,13 +347,19 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block)
   {
-    for(const auto& in: tx.vin)
+    std::vector<crypto::key_image> key_images;
+    if (!get_key_images(tx, key_images))
+      return false;
+    return insert_key_images(get_transaction_hash(tx), key_images, kept_by_block);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::insert_key_images(const crypto::hash &id, const std::vector<crypto::key_image> &key_images, bool kept_by_block)
+  {
+    for(const crypto::key_image &k_image: key_images)
     {
-      const crypto::hash id = get_transaction_hash(tx);
-      CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
-      std::unordered_set<crypto::hash>& kei_image_set = m_spent_key_images[txin.k_image];
+      std::unordered_set<crypto::hash>& kei_image_set = m_spent_key_images[k_image];
       CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
-                                          << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << txin.k_image << ENDL
+                                          << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << k_image << ENDL
                                           << "tx_id=" << id );
       auto ins_res = kei_image_set.insert(id);
       CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
@@ -319,28 +367,41 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_key_images(const transaction& tx, std::vector<crypto::key_image>& key_images)
+  {
+    key_images.reserve(key_images.size() + tx.vin.size());
+    for(const txin_v& vi: tx.vin)
+    {
+      CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
+      key_images.push_back(txin.k_image);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   //FIXME: Can return early before removal of all of the key images.
   //       At the least, need to make sure that a false return here
   //       is treated properly.  Should probably not return early, however.
   bool tx_memory_pool::remove_transaction_keyimages(const transaction& tx)
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    // ND: Speedup
-    // 1. Move transaction hash calcuation outside of loop. ._.
-    crypto::hash actual_hash = get_transaction_hash(tx);
-    for(const txin_v& vi: tx.vin)
+    std::vector<crypto::key_image> key_images;
+    if (!get_key_images(tx, key_images))
+      return false;
+    return remove_key_images(get_transaction_hash(tx), key_images);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::remove_key_images(const crypto::hash &actual_hash, const std::vector<crypto::key_image> &key_images)
+  {
+    for(const crypto::key_image &k_image: key_images)
     {
-      CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
-      auto it = m_spent_key_images.find(txin.k_image);
-      CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << txin.k_image << ENDL
-                                    << "transaction id = " << get_transaction_hash(tx));
+      auto it = m_spent_key_images.find(k_image);
+      CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << k_image << ENDL
+                                    << "transaction id = " << actual_hash);
       std::unordered_set<crypto::hash>& key_image_set =  it->second;
-      CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << txin.k_image << ENDL
+      CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << k_image << ENDL
         << "transaction id = " << actual_hash);
 
       auto it_in_set = key_image_set.find(actual_hash);
-      CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
+      CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << k_image << ENDL
         << "transaction id = " << actual_hash);
       key_image_set.erase(it_in_set);
       if(!key_image_set.size())
@@ -357,6 +418,7 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
 
     auto sorted_it = find_tx_in_sorted_container(id);
     if (sorted_it == m_txs_by_fee_and_receive_time.end())
@@ -379,7 +441,9 @@ namespace cryptonote
 
       // remove first, in case this throws, so key images aren't removed
       m_blockchain.remove_txpool_tx(id);
+      boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
       remove_transaction_keyimages(tx);
+      remove_tx_entry(id);
     }
     catch (const std::exception &e)
     {
@@ -388,6 +452,7 @@ namespace cryptonote
     }
 
     m_txs_by_fee_and_receive_time.erase(sorted_it);
+    ++m_cookie;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -396,6 +461,117 @@ namespace cryptonote
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_txpool_max_size(size_t bytes)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_txpool_max_size = bytes;
+    prune(m_txpool_max_size);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::prune(size_t bytes)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (m_txpool_size <= bytes)
+      return;
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
+    LockedTXN lock(m_blockchain);
+    bool changed = false;
+    // the sorted container has the highest fee per byte first
+    auto it = m_txs_by_fee_and_receive_time.end();
+    while (m_txpool_size > bytes && it != m_txs_by_fee_and_receive_time.begin())
+    {
+      --it;
+      const crypto::hash txid = it->second;
+      auto entry = m_tx_entries.find(txid);
+      if (entry == m_tx_entries.end() || entry->second.meta.kept_by_block)
+        continue;
+      const uint64_t blob_size = entry->second.meta.blob_size;
+      try
+      {
+        // remove first, so we only remove key images if the tx removal succeeds
+        m_blockchain.remove_txpool_tx(txid);
+        {
+          boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+          remove_key_images(txid, entry->second.key_images);
+          remove_tx_entry(txid);
+        }
+        MINFO("Pruned tx " << txid << " from txpool: size: " << blob_size << ", fee/byte: " << it->first.first);
+        m_min_fee_per_byte = std::max(m_min_fee_per_byte, it->first.first);
+        ++m_num_evicted;
+        m_bytes_evicted += blob_size;
+        it = m_txs_by_fee_and_receive_time.erase(it);
+        changed = true;
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Error while pruning txpool: " << e.what());
+        break;
+      }
+    }
+    if (changed)
+      ++m_cookie;
+    if (m_txpool_size > bytes)
+      MINFO("Pool size after pruning is larger than limit: " << m_txpool_size << "/" << bytes);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_entry(const crypto::hash &txid)
+  {
+    auto entry = m_tx_entries.find(txid);
+    if (entry == m_tx_entries.end())
+      return;
+    account_tx_entry(entry->second.meta, false);
+    m_tx_entries.erase(entry);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_tx_entry(const crypto::hash &txid, const txpool_tx_meta_t &meta, std::vector<crypto::key_image> key_images)
+  {
+    remove_tx_entry(txid);
+    m_tx_entries[txid] = {meta, std::move(key_images)};
+    account_tx_entry(meta, true);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_tx_entry_meta(tx_entry &entry, const txpool_tx_meta_t &meta)
+  {
+    account_tx_entry(entry.meta, false);
+    entry.meta = meta;
+    account_tx_entry(entry.meta, true);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::account_tx_entry(const txpool_tx_meta_t &meta, bool add)
+  {
+    tx_entries_stats &s = m_tx_entries_stats;
+    txpool_histo &h = s.by_receive_time[meta.receive_time];
+    if (add)
+    {
+      m_txpool_size += meta.blob_size;
+      s.fee_total += meta.fee;
+      if (!meta.relayed)
+        s.num_not_relayed++;
+      if (meta.last_failed_height)
+        s.num_failing++;
+      s.blob_sizes.insert(meta.blob_size);
+      h.txs++;
+      h.bytes += meta.blob_size;
+    }
+    else
+    {
+      m_txpool_size -= meta.blob_size;
+      s.fee_total -= meta.fee;
+      if (!meta.relayed)
+        s.num_not_relayed--;
+      if (meta.last_failed_height)
+        s.num_failing--;
+      auto it = s.blob_sizes.find(meta.blob_size);
+      if (it != s.blob_sizes.end())
+        s.blob_sizes.erase(it);
+      h.txs--;
+      h.bytes -= meta.blob_size;
+      if (!h.txs)
+        s.by_receive_time.erase(meta.receive_time);
+    }
+  }
+  //---------------------------------------------------------------------------------
   sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
   {
     return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
@@ -410,6 +586,7 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
     std::unordered_set<crypto::hash> remove;
     m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
       uint64_t tx_age = time(nullptr) - meta.receive_time;
@@ -435,6 +612,7 @@ namespace cryptonote
 
     if (!remove.empty())
     {
+      ++m_cookie;
       LockedTXN lock(m_blockchain);
       for (const crypto::hash &txid: remove)
       {
@@ -451,7 +629,9 @@ namespace cryptonote
           {
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
+            boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
             remove_transaction_keyimages(tx);
+            remove_tx_entry(txid);
           }
         }
         catch (const std::exception &e)
@@ -461,39 +641,54 @@ namespace cryptonote
         }
       }
     }
+
+    // the fee floor set by evictions goes back down once the pool has room again
+    if (m_min_fee_per_byte > 0 && m_txpool_size < m_txpool_max_size / 10 * 9)
+    {
+      m_min_fee_per_byte = m_min_fee_per_byte < 1 ? 0 : m_min_fee_per_byte / 2;
+      MDEBUG("Pool has room again, minimum fee per byte lowered to " << m_min_fee_per_byte);
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_relayable_transactions(std::list<std::pair<crypto::hash, cryptonote::blobdata>> &txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
-    m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *){
-      // 0 fee transactions are never relayed
-      if(meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
+    std::vector<crypto::hash> relayable;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+      lock_timer timer(m_shared_lock_metrics);
+      for (const auto &e: m_tx_entries)
       {
-        // if the tx is older than half the max lifetime, we don't re-relay it, to avoid a problem
-        // mentioned by smooth where nodes would flush txes at slightly different times, causing
-        // flushed txes to be re-added when received from a node which was just about to flush it
-        uint64_t max_age = meta.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
-        if (now - meta.receive_time <= max_age / 2)
+        const txpool_tx_meta_t &meta = e.second.meta;
+        // 0 fee transactions are never relayed
+        if(meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
         {
-          try
-          {
-            cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-            txs.push_back(std::make_pair(txid, bd));
-          }
-          catch (const std::exception &e)
-          {
-            MERROR("Failed to get transaction blob from db");
-            // ignore error
-          }
+          // if the tx is older than half the max lifetime, we don't re-relay it, to avoid a problem
+          // mentioned by smooth where nodes would flush txes at slightly different times, causing
+          // flushed txes to be re-added when received from a node which was just about to flush it
+          uint64_t max_age = meta.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
+          if (now - meta.receive_time <= max_age / 2)
+            relayable.push_back(e.first);
         }
       }
-      return true;
-    });
+    }
+    for (const crypto::hash &txid: relayable)
+    {
+      // the tx may have left the pool since, in which case it is just skipped
+      cryptonote::blobdata bd;
+      try
+      {
+        if (m_blockchain.get_txpool_tx_blob(txid, bd))
+          txs.push_back(std::make_pair(txid, std::move(bd)));
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to get transaction blob from db");
+        // ignore error
+      }
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -501,6 +696,7 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
     const time_t now = time(NULL);
     LockedTXN lock(m_blockchain);
     for (auto it = txs.begin(); it != txs.end(); ++it)
@@ -511,6 +707,15 @@ namespace cryptonote
         meta.relayed = true;
         meta.last_relayed_time = now;
         m_blockchain.update_txpool_tx(it->first, meta);
+        boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+        auto entry = m_tx_entries.find(it->first);
+        if (entry != m_tx_entries.end())
+        {
+          txpool_tx_meta_t updated = entry->second.meta;
+          updated.relayed = true;
+          updated.last_relayed_time = now;
+          update_tx_entry_meta(entry->second, updated);
+        }
       }
       catch (const std::exception &e)
       {
@@ -522,76 +727,73 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count() const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count();
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
+    return m_tx_entries.size();
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::list<transaction>& txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    std::vector<crypto::hash> txids;
+    get_transaction_hashes(txids);
+    for (const crypto::hash &txid: txids)
+    {
+      // the tx may have left the pool since, in which case it is just skipped
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
-      }
-      txs.push_back(tx);
-      return true;
-    }, true);
+      if (get_pool_tx(txid, tx))
+        txs.push_back(std::move(tx));
+    }
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      txs.push_back(txid);
-      return true;
-    });
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
+    txs.reserve(txs.size() + m_tx_entries.size());
+    for (const auto &e: m_tx_entries)
+      txs.push_back(e.first);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
     const uint64_t now = time(NULL);
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    backlog.reserve(backlog.size() + m_tx_entries.size());
+    for (const auto &e: m_tx_entries)
+    {
+      const txpool_tx_meta_t &meta = e.second.meta;
       backlog.push_back({meta.blob_size, meta.fee, meta.receive_time - now});
-      return true;
-    });
+    }
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
     const uint64_t now = time(NULL);
+    const tx_entries_stats &s = m_tx_entries_stats;
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count();
-    m_blockchain.for_all_txpool_txes([&stats, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      stats.bytes_total += meta.blob_size;
-      if (!stats.bytes_min || meta.blob_size < stats.bytes_min)
-        stats.bytes_min = meta.blob_size;
-      if (meta.blob_size > stats.bytes_max)
-        stats.bytes_max = meta.blob_size;
-      if (!meta.relayed)
-        stats.num_not_relayed++;
-      stats.fee_total += meta.fee;
-      if (!stats.oldest || meta.receive_time < stats.oldest)
-        stats.oldest = meta.receive_time;
-      if (meta.receive_time < now - 600)
-        stats.num_10m++;
-      if (meta.last_failed_height)
-        stats.num_failing++;
-      uint64_t age = now - meta.receive_time + (now == meta.receive_time);
-      agebytes[age].txs++;
-      agebytes[age].bytes += meta.blob_size;
-      return true;
-    });
+    stats.txs_total = m_tx_entries.size();
+    stats.bytes_total = m_txpool_size;
+    if (!s.blob_sizes.empty())
+    {
+      stats.bytes_min = *s.blob_sizes.begin();
+      stats.bytes_max = *s.blob_sizes.rbegin();
+    }
+    stats.num_not_relayed = s.num_not_relayed;
+    stats.fee_total = s.fee_total;
+    stats.num_failing = s.num_failing;
+    if (!s.by_receive_time.empty())
+      stats.oldest = s.by_receive_time.begin()->first;
+    for (const auto &r: s.by_receive_time)
+    {
+      if (r.first < now - 600)
+        stats.num_10m += r.second.txs;
+      uint64_t age = now - r.first + (now == r.first);
+      agebytes[age].txs += r.second.txs;
+      agebytes[age].bytes += r.second.bytes;
+    }
     if (stats.txs_total > 1)
     {
       /* looking for 98th percentile */
@@ -634,23 +836,50 @@ namespace cryptonote
         stats.histo[factor].bytes += i2->second.bytes;
       }
     }
+
+    stats.lock_exclusive_count = m_exclusive_lock_metrics.count;
+    stats.lock_exclusive_time_total = m_exclusive_lock_metrics.total_us;
+    stats.lock_exclusive_time_max = m_exclusive_lock_metrics.max_us;
+    stats.lock_shared_count = m_shared_lock_metrics.count;
+    stats.lock_shared_time_total = m_shared_lock_metrics.total_us;
+    stats.lock_shared_time_max = m_shared_lock_metrics.max_us;
+    stats.num_evicted = m_num_evicted;
+    stats.bytes_evicted = m_bytes_evicted;
   }
   //------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      tx_info txi;
-      txi.id_hash = epee::string_tools::pod_to_hex(txid);
-      transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
+    // the transactions are read from the db once the index lock is released
+    std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> entries;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+      lock_timer timer(m_shared_lock_metrics);
+      entries.reserve(m_tx_entries.size());
+      for (const auto &e: m_tx_entries)
+        entries.push_back(std::make_pair(e.first, e.second.meta));
+
+      for (const key_images_container::value_type& kee : m_spent_key_images) {
+        const crypto::key_image& k_image = kee.first;
+        const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
+        spent_key_image_info ki;
+        ki.id_hash = epee::string_tools::pod_to_hex(k_image);
+        for (const crypto::hash& tx_id_hash : kei_image_set)
+        {
+          ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
+        }
+        key_image_infos.push_back(ki);
       }
+    }
+
+    for (const auto &e: entries)
+    {
+      const txpool_tx_meta_t &meta = e.second;
+      transaction tx;
+      if (!get_pool_tx(e.first, tx))
+        continue;
+      tx_info txi;
+      txi.id_hash = epee::string_tools::pod_to_hex(e.first);
       txi.tx_json = obj_to_json_str(tx);
       txi.blob_size = meta.blob_size;
       txi.fee = meta.fee;
@@ -664,27 +893,36 @@ namespace cryptonote
       txi.last_relayed_time = meta.last_relayed_time;
       txi.do_not_relay = meta.do_not_relay;
       tx_infos.push_back(txi);
-      return true;
-    }, true);
-
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      const crypto::key_image& k_image = kee.first;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
-      spent_key_image_info ki;
-      ki.id_hash = epee::string_tools::pod_to_hex(k_image);
-      for (const crypto::hash& tx_id_hash : kei_image_set)
-      {
-        ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
-      }
-      key_image_infos.push_back(ki);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_pool_tx(const crypto::hash &txid, transaction &tx) const
+  {
+    cryptonote::blobdata txblob;
+    try
+    {
+      if (!m_blockchain.get_txpool_tx_blob(txid, txblob))
+        return false;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to get transaction blob from db");
+      return false;
+    }
+    if (!parse_and_validate_tx_from_blob(txblob, tx))
+    {
+      MERROR("Failed to parse tx from txpool");
+      return false;
     }
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, cryptonote::blobdata& txblob) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    if (!have_tx(id))
+      return false;
+    // the blob is only kept in the db, which can be read without the pool lock
     try
     {
       return m_blockchain.get_txpool_tx_blob(id, txblob);
@@ -707,19 +945,19 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_db().txpool_has_tx(id);
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
+    return m_tx_entries.find(id) != m_tx_entries.end();
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
     for(const auto& in: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true);//should never fail
-      if(have_tx_keyimg_as_spent(tokey_in.k_image))
+      if(m_spent_key_images.end() != m_spent_key_images.find(tokey_in.k_image))
          return true;
     }
     return false;
@@ -727,7 +965,8 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+    lock_timer timer(m_shared_lock_metrics);
     return m_spent_key_images.end() != m_spent_key_images.find(key_im);
   }
   //---------------------------------------------------------------------------------
@@ -810,18 +1049,22 @@ namespace cryptonote
   std::string tx_memory_pool::print_pool(bool short_format) const
   {
     std::stringstream ss;
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
-      ss << "id: " << txid << std::endl;
+    std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> entries;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_index_lock);
+      lock_timer timer(m_shared_lock_metrics);
+      entries.reserve(m_tx_entries.size());
+      for (const auto &e: m_tx_entries)
+        entries.push_back(std::make_pair(e.first, e.second.meta));
+    }
+    for (const auto &e: entries)
+    {
+      const txpool_tx_meta_t &meta = e.second;
+      ss << "id: " << e.first << std::endl;
       if (!short_format) {
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(*txblob, tx))
-        {
-          MERROR("Failed to parse tx from txpool");
-          return true; // continue
-        }
-        ss << obj_to_json_str(tx) << std::endl;
+        if (get_pool_tx(e.first, tx))
+          ss << obj_to_json_str(tx) << std::endl;
       }
       ss << "blob_size: " << meta.blob_size << std::endl
         << "fee: " << print_money(meta.fee) << std::endl
@@ -830,8 +1073,7 @@ namespace cryptonote
         << "max_used_block_id: " << meta.max_used_block_id << std::endl
         << "last_failed_height: " << meta.last_failed_height << std::endl
         << "last_failed_id: " << meta.last_failed_id << std::endl;
-      return true;
-    }, !short_format);
+    }
 
     return ss.str();
   }
@@ -845,6 +1087,7 @@ namespace cryptonote
 
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
 
     uint64_t best_coinbase = 0, coinbase = 0;
     total_size = 0;
@@ -861,12 +1104,17 @@ namespace cryptonote
 
     LOG_PRINT_L2("Filling block template, median size " << median_size << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
 
-    LockedTXN lock(m_blockchain);
-
     auto sorted_it = m_txs_by_fee_and_receive_time.begin();
     while (sorted_it != m_txs_by_fee_and_receive_time.end())
     {
-      txpool_tx_meta_t meta = m_blockchain.get_txpool_tx_meta(sorted_it->second);
+      auto entry = m_tx_entries.find(sorted_it->second);
+      if (entry == m_tx_entries.end())
+      {
+        MERROR("Tx " << sorted_it->second << " not found in the txpool index");
+        sorted_it++;
+        continue;
+      }
+      txpool_tx_meta_t meta = entry->second.meta;
       LOG_PRINT_L2("Considering " << sorted_it->second << ", size " << meta.blob_size << ", current block size " << total_size << "/" << max_total_size << ", current coinbase " << print_money(best_coinbase));
 
       // Can not exceed maximum block size
@@ -908,19 +1156,23 @@ namespace cryptonote
         }
       }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
+      // Skip transactions that are not ready to be
+      // included into the blockchain or that are
+      // missing key images.
+      // Readers may be looking at the index entry, so checks work on
+      // copies, and the meta they update is stored back under the lock
       cryptonote::transaction tx;
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
+      if (!get_pool_tx(sorted_it->second, tx))
       {
-        MERROR("Failed to parse tx from txpool");
         sorted_it++;
         continue;
       }
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      if (!is_transaction_ready_to_go(meta, tx))
+      const bool ready = is_transaction_ready_to_go(meta, tx);
+      {
+        boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+        update_tx_entry_meta(entry->second, meta);
+      }
+      if (!ready)
       {
         LOG_PRINT_L2("  not ready to go");
         sorted_it++;
@@ -953,6 +1205,7 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
     size_t tx_size_limit = get_transaction_size_limit(version);
     std::unordered_set<crypto::hash> remove;
 
@@ -985,7 +1238,11 @@ namespace cryptonote
           }
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
-          remove_transaction_keyimages(tx);
+          {
+            boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+            remove_transaction_keyimages(tx);
+            remove_tx_entry(txid);
+          }
           auto sorted_it = find_tx_in_sorted_container(txid);
           if (sorted_it == m_txs_by_fee_and_receive_time.end())
           {
@@ -996,6 +1253,7 @@ namespace cryptonote
             m_txs_by_fee_and_receive_time.erase(sorted_it);
           }
           ++n_removed;
+          ++m_cookie;
         }
         catch (const std::exception &e)
         {
@@ -1011,26 +1269,176 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
 
     m_txs_by_fee_and_receive_time.clear();
     m_spent_key_images.clear();
-    return m_blockchain.for_all_txpool_txes([this](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
-      cryptonote::transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+    m_tx_entries.clear();
+    m_tx_entries_stats = tx_entries_stats();
+    m_txpool_size = 0;
+    ++m_cookie;
+
+    // the sort key comes from the metadata, and the key images are stored
+    // next to it, so the blobs are not needed
+    struct loaded_tx
+    {
+      crypto::hash txid;
+      txpool_tx_meta_t meta;
+      std::vector<crypto::key_image> key_images;
+    };
+    std::vector<loaded_tx> loaded;
+    std::vector<size_t> unparsed;
+    loaded.reserve(m_blockchain.get_txpool_tx_count());
+    if (!m_blockchain.for_all_txpool_txes([this, &loaded, &unparsed](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+      loaded.push_back({txid, meta, std::vector<crypto::key_image>()});
+      if (!m_blockchain.get_txpool_tx_key_images(txid, loaded.back().key_images))
+        unparsed.push_back(loaded.size() - 1);
+      return true;
+    }, false))
+      return false;
+
+    // txes added by an older version have to be parsed, a batch at a time
+    // so their blobs are not all in memory at once
+    if (!unparsed.empty())
+    {
+      TIME_MEASURE_START(t);
+      tools::thread_group threadpool(tools::thread_group::optimal_with_max(std::min(unparsed.size(), INIT_PARSE_BATCH_SIZE)));
+      const size_t nstripes = threadpool.count() + 1;
+      std::vector<cryptonote::blobdata> blobs;
+      std::vector<char> parsed;
+      for (size_t start = 0; start < unparsed.size(); start += INIT_PARSE_BATCH_SIZE)
       {
-        MERROR("Failed to parse tx from txpool");
-        return false;
+        const size_t count = std::min(unparsed.size() - start, INIT_PARSE_BATCH_SIZE);
+        blobs.resize(count);
+        parsed.assign(count, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+          if (!m_blockchain.get_txpool_tx_blob(loaded[unparsed[start + i]].txid, blobs[i]))
+          {
+            MERROR("Failed to get tx blob from txpool");
+            return false;
+          }
+        }
+        tools::task_region(threadpool, [&] (tools::task_region_handle& region) {
+          for (size_t stripe = 0; stripe < nstripes; ++stripe)
+          {
+            region.run([&, stripe] {
+              for (size_t i = stripe; i < count; i += nstripes)
+              {
+                cryptonote::transaction tx;
+                parsed[i] = parse_and_validate_tx_from_blob(blobs[i], tx) && get_key_images(tx, loaded[unparsed[start + i]].key_images);
+              }
+            });
+          }
+        });
+        if (std::find(parsed.begin(), parsed.end(), 0) != parsed.end())
+        {
+          MERROR("Failed to parse tx from txpool");
+          return false;
+        }
       }
-      if (!insert_key_images(tx, meta.kept_by_block))
+      TIME_MEASURE_FINISH(t);
+      MINFO("Parsed " << unparsed.size() << " txpool txes without stored key images in " << t << " ms with " << nstripes << " threads");
+    }
+
+    for (loaded_tx &l: loaded)
+    {
+      if (!insert_key_images(l.txid, l.key_images, l.meta.kept_by_block))
       {
         MFATAL("Failed to insert key images from txpool tx");
         return false;
       }
-      m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), txid);
-      return true;
-    }, true);
+      m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(l.meta.fee / (double)l.meta.blob_size, l.meta.receive_time), l.txid);
+      add_tx_entry(l.txid, l.meta, std::move(l.key_images));
+    }
+    MINFO("Loaded " << loaded.size() << " txes into the pool");
+    return true;
   }
 
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::sync_with_db()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    lock_timer timer(m_exclusive_lock_metrics);
+
+    // the index only changes under m_transactions_lock, so it can be read
+    // without m_index_lock while working out what changed
+    struct added_tx
+    {
+      crypto::hash txid;
+      txpool_tx_meta_t meta;
+      std::vector<crypto::key_image> key_images;
+    };
+    std::vector<added_tx> added;
+    std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> updated;
+    std::unordered_set<crypto::hash> in_db;
+    size_t missing_key_images = 0;
+
+    // metadata and the stored key images only, no blob is read or parsed.
+    // The key images are read in the same snapshot as the metadata, so a
+    // tx the primary stored them for is never missing them here
+    in_db.reserve(m_blockchain.get_txpool_tx_count());
+    if (!m_blockchain.for_all_txpool_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+      in_db.insert(txid);
+      auto entry = m_tx_entries.find(txid);
+      if (entry != m_tx_entries.end())
+      {
+        if (memcmp(&entry->second.meta, &meta, sizeof(txpool_tx_meta_t)))
+          updated.push_back(std::make_pair(txid, meta));
+        return true;
+      }
+      added_tx a{txid, meta, std::vector<crypto::key_image>()};
+      if (m_blockchain.get_txpool_tx_key_images(txid, a.key_images))
+        added.push_back(std::move(a));
+      else
+        ++missing_key_images;
+      return true;
+    }, false))
+      return false;
+    if (missing_key_images)
+      MDEBUG(missing_key_images << " txpool txes have no stored key images, they are left out until the primary stores them");
+
+    std::unordered_set<crypto::hash> removed;
+    for (const auto &e: m_tx_entries)
+      if (in_db.find(e.first) == in_db.end())
+        removed.insert(e.first);
+
+    if (removed.empty() && added.empty() && updated.empty())
+      return true;
+
+    boost::unique_lock<boost::shared_mutex> index_lock(m_index_lock);
+    if (!removed.empty())
+    {
+      for (auto it = m_txs_by_fee_and_receive_time.begin(); it != m_txs_by_fee_and_receive_time.end(); )
+      {
+        if (removed.find(it->second) != removed.end())
+          it = m_txs_by_fee_and_receive_time.erase(it);
+        else
+          ++it;
+      }
+      for (const crypto::hash &txid: removed)
+      {
+        remove_key_images(txid, m_tx_entries[txid].key_images);
+        remove_tx_entry(txid);
+      }
+    }
+    for (const auto &u: updated)
+      update_tx_entry_meta(m_tx_entries[u.first], u.second);
+    for (added_tx &a: added)
+    {
+      if (!insert_key_images(a.txid, a.key_images, a.meta.kept_by_block))
+      {
+        MERROR("Failed to insert key images from txpool tx " << a.txid);
+        continue;
+      }
+      m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(a.meta.fee / (double)a.meta.blob_size, a.meta.receive_time), a.txid);
+      add_tx_entry(a.txid, a.meta, std::move(a.key_images));
+    }
+    ++m_cookie;
+    MDEBUG("Txpool synced with the database: " << added.size() << " added, " << removed.size() << " removed, " << updated.size() << " updated");
+    return true;
+  }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
   {
@@ -32,11 +32,14 @@
 #include "include_base_utils.h"
 
 #include <set>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <atomic>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
@@ -150,6 +153,20 @@ namespace cryptonote
      */
     bool have_tx(const crypto::hash &id) const;
 
+    /**
+     * @brief check if any spent key image in a transaction is in the pool
+     *
+     * Checks if any of the spent key images in a given transaction are present
+     * in any of the transactions in the transaction pool.
+     *
+     * @note see tx_pool::have_tx_keyimg_as_spent
+     *
+     * @param tx the transaction to check spent key images of
+     *
+     * @return true if any spent key images are present in the pool, otherwise false
+     */
+    bool have_tx_keyimges_as_spent(const transaction& tx) const;
+
     /**
      * @brief action to take when notified of a block added to the blockchain
      *
@@ -181,6 +198,13 @@ namespace cryptonote
      */
     void on_idle();
 
+    /**
+     * @brief sets the maximum size of the pool, evicting transactions if needed
+     *
+     * @param bytes the maximum total size of the pool transactions, in bytes
+     */
+    void set_txpool_max_size(size_t bytes);
+
     /**
      * @brief locks the transaction pool
      */
@@ -202,6 +226,17 @@ namespace cryptonote
      */
     bool init();
 
+    /**
+     * @brief brings the pool in line with changes another process made to the database
+     *
+     * Only the differences are applied: transactions gone from the database
+     * are dropped, new ones are read and indexed, and changed metadata is
+     * updated. Used by read-only replicas, which do not own the pool.
+     *
+     * @return false if the database could not be read, otherwise true
+     */
+    bool sync_with_db();
+
     /**
      * @brief attempts to save the transaction pool state to disk
      *
@@ -252,6 +287,10 @@ namespace cryptonote
     /**
      * @brief get a summary statistics of all transaction hashes in the pool
      *
+     * The totals are kept up to date as transactions come and go, and
+     * the age histogram is built from per second aggregates, so this
+     * does not walk the pool transactions.
+     *
      * @param stats return-by-reference the pool statistics
      */
     void get_transaction_stats(struct txpool_stats& stats) const;
@@ -328,6 +367,16 @@ namespace cryptonote
      */
     size_t validate(uint8_t version);
 
+    /**
+     * @brief return the cookie
+     *
+     * The cookie changes whenever transactions are added to or removed
+     * from the pool, so it can tell whether a block template is stale.
+     *
+     * @return the cookie
+     */
+    uint64_t cookie() const { return m_cookie; }
+
 
 #define CURRENT_MEMPOOL_ARCHIVE_VER    11
 #define CURRENT_MEMPOOL_TX_DETAILS_ARCHIVE_VER    12
@@ -375,10 +424,25 @@ namespace cryptonote
     /**
      * @brief insert key images into m_spent_key_images
      *
+     * Must be called with m_index_lock held exclusively.
+     *
      * @return true on success, false on error
      */
     bool insert_key_images(const transaction &tx, bool kept_by_block);
 
+    /**
+     * @brief insert a transaction's key images into m_spent_key_images
+     *
+     * Must be called with m_index_lock held exclusively.
+     *
+     * @param txid the hash of the transaction
+     * @param key_images the key images the transaction spends
+     * @param kept_by_block whether the transaction was kept by a block
+     *
+     * @return true on success, false on error
+     */
+    bool insert_key_images(const crypto::hash &txid, const std::vector<crypto::key_image> &key_images, bool kept_by_block);
+
     /**
      * @brief remove old transactions from the pool
      *
@@ -399,26 +463,13 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image& key_im) const;
 
-    /**
-     * @brief check if any spent key image in a transaction is in the pool
-     *
-     * Checks if any of the spent key images in a given transaction are present
-     * in any of the transactions in the transaction pool.
-     *
-     * @note see tx_pool::have_tx_keyimg_as_spent
-     *
-     * @param tx the transaction to check spent key images of
-     *
-     * @return true if any spent key images are present in the pool, otherwise false
-     */
-    bool have_tx_keyimges_as_spent(const transaction& tx) const;
-
     /**
      * @brief forget a transaction's spent key images
      *
      * Spent key images are stored separately from transactions for
      * convenience/speed, so this is part of the process of removing
      * a transaction from the pool.
+     * Must be called with m_index_lock held exclusively.
      *
      * @param tx the transaction
      *
@@ -426,6 +477,38 @@ namespace cryptonote
      */
     bool remove_transaction_keyimages(const transaction& tx);
 
+    /**
+     * @brief forget a transaction's spent key images, as stored in its index entry
+     *
+     * Must be called with m_index_lock held exclusively.
+     *
+     * @param txid the hash of the transaction
+     * @param key_images the key images the transaction spends
+     *
+     * @return false if any key images to be removed cannot be found, otherwise true
+     */
+    bool remove_key_images(const crypto::hash &txid, const std::vector<crypto::key_image> &key_images);
+
+    /**
+     * @brief get the key images spent by a transaction
+     *
+     * @param tx the transaction
+     * @param key_images return-by-reference the key images, in input order
+     *
+     * @return false if the transaction has an input which is not to key, otherwise true
+     */
+    static bool get_key_images(const transaction& tx, std::vector<crypto::key_image>& key_images);
+
+    /**
+     * @brief read a pool transaction from the database and parse it
+     *
+     * @param txid the hash of the transaction
+     * @param tx return-by-reference the transaction
+     *
+     * @return false if the transaction is not in the pool or fails to parse, otherwise true
+     */
+    bool get_pool_tx(const crypto::hash &txid, transaction &tx) const;
+
     /**
      * @brief check if any of a transaction's spent key images are present in a given set
      *
@@ -485,6 +568,123 @@ private:
     //!< container for transactions organized by fee per size and receive time
     sorted_tx_container m_txs_by_fee_and_receive_time;
 
+    std::atomic<uint64_t> m_cookie; //!< incremented at each change
+
+    //! in memory copy of what the pool indexes for a transaction
+    /*! The database remains the store for the transactions themselves, they
+     *  are read and parsed from it when needed, so the index does not double
+     *  the memory the pool takes. Block template assembly only parses the
+     *  candidates which fit the block.
+     */
+    struct tx_entry
+    {
+      txpool_tx_meta_t meta;
+      std::vector<crypto::key_image> key_images; //!< the key images the transaction spends
+    };
+
+    //! pool transactions, by hash, mirroring the txpool database table
+    std::unordered_map<crypto::hash, tx_entry> m_tx_entries;
+
+    //! aggregates over m_tx_entries, for get_transaction_stats
+    struct tx_entries_stats
+    {
+      tx_entries_stats(): fee_total(0), num_not_relayed(0), num_failing(0) {}
+      uint64_t fee_total;
+      uint32_t num_not_relayed;
+      uint32_t num_failing;
+      std::multiset<uint64_t> blob_sizes;
+      std::map<uint64_t, txpool_histo> by_receive_time; //!< txes and bytes by receive time, in seconds
+    };
+    tx_entries_stats m_tx_entries_stats;
+
+    //! lock for m_tx_entries and m_spent_key_images
+    /*! Changes to the pool are serialized by m_transactions_lock, and only
+     *  take this one exclusively while they update the in memory index.
+     *  Read only queries take it shared, and do not take m_transactions_lock
+     *  nor the blockchain lock, so they do not wait for transactions being
+     *  verified.
+     */
+    mutable boost::shared_mutex m_index_lock;
+
+    //! how many times, and how long, a pool lock was held
+    struct lock_metrics
+    {
+      lock_metrics(): count(0), total_us(0), max_us(0) {}
+      std::atomic<uint64_t> count;
+      std::atomic<uint64_t> total_us;
+      std::atomic<uint64_t> max_us;
+    };
+
+    //! adds its lifetime to a lock_metrics, to be created just after taking the lock
+    class lock_timer
+    {
+    public:
+      lock_timer(lock_metrics &metrics);
+      ~lock_timer();
+    private:
+      lock_metrics &m_metrics;
+      uint64_t m_start;
+    };
+
+    mutable lock_metrics m_exclusive_lock_metrics; //!< for m_transactions_lock
+    mutable lock_metrics m_shared_lock_metrics; //!< for m_index_lock taken shared
+
+    size_t m_txpool_max_size; //!< max total size of the pool transactions, in bytes
+    size_t m_txpool_size; //!< total size of the pool transactions, in bytes
+    double m_min_fee_per_byte; //!< fee per byte floor, raised by evictions while the pool is full
+    std::atomic<uint64_t> m_num_evicted; //!< transactions evicted to keep the pool in its size
+    std::atomic<uint64_t> m_bytes_evicted; //!< total size of the evicted transactions
+
+    /**
+     * @brief evict the lowest fee per byte transactions until the pool fits a size
+     *
+     * Transactions kept by block are not evicted, they are likely there
+     * because a block with them is being added. The fee per byte of an
+     * evicted transaction becomes the minimum for new ones, until the
+     * pool has room again.
+     *
+     * @param bytes the size the pool must fit in
+     */
+    void prune(size_t bytes);
+
+    /**
+     * @brief drop a transaction from the in memory index, and account for its size
+     *
+     * Must be called with m_index_lock held exclusively.
+     *
+     * @param txid the hash of the transaction
+     */
+    void remove_tx_entry(const crypto::hash &txid);
+
+    /**
+     * @brief add a transaction to the in memory index, replacing any previous entry
+     *
+     * Must be called with m_index_lock held exclusively.
+     *
+     * @param txid the hash of the transaction
+     * @param meta the transaction's metadata
+     * @param key_images the key images the transaction spends
+     */
+    void add_tx_entry(const crypto::hash &txid, const txpool_tx_meta_t &meta, std::vector<crypto::key_image> key_images);
+
+    /**
+     * @brief change the metadata of an index entry
+     *
+     * Must be called with m_index_lock held exclusively.
+     *
+     * @param entry the index entry
+     * @param meta the new metadata
+     */
+    void update_tx_entry_meta(tx_entry &entry, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief add or remove a transaction's metadata to or from the index aggregates
+     *
+     * @param meta the transaction's metadata
+     * @param add true to add, false to remove
+     */
+    void account_tx_entry(const txpool_tx_meta_t &meta, bool add);
+
     /**
      * @brief get an iterator to a transaction in the sorted container
      *
@@ -37,6 +37,9 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+#define STEAL_MIN_THIEF_SPEED 0.75f // relative to the fastest peer
+#define STEAL_MAX_VICTIM_SPEED_RATIO 0.5f // relative to the thief
+
 namespace std {
   static_assert(sizeof(size_t) <= sizeof(boost::uuids::uuid), "boost::uuids::uuid too small");
   template<> struct hash<boost::uuids::uuid> {
@@ -54,6 +57,21 @@ void block_queue::add_blocks(uint64_t height, std::list<cryptonote::block_comple
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::list<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
+  if (has_hashes && !hashes.empty() && hashes.size() < bcel.size())
+  {
+    // the tail of this span was taken over by another peer, we only keep what's still ours
+    MDEBUG("Trimming span at " << height << " from " << bcel.size() << " to " << hashes.size() << " blocks");
+    auto i = bcel.begin();
+    std::advance(i, hashes.size());
+    for (auto j = i; j != bcel.end(); ++j)
+    {
+      size_t entry_size = j->block.size();
+      for (const auto &tx: j->txs)
+        entry_size += tx.size();
+      size -= std::min(size, entry_size);
+    }
+    bcel.erase(i, bcel.end());
+  }
   blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
   if (has_hashes)
     set_span_hashes(height, connection_id, hashes);
@@ -180,6 +198,15 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     return std::make_pair(0, 0);
   }
 
+  // slower peers get proportionally smaller spans, so they hold the queue up for less time
+  const float speed = get_speed(connection_id);
+  if (speed < 1.0f)
+  {
+    const uint64_t adapted_max_blocks = std::max<uint64_t>(1, max_blocks * speed + 0.5f);
+    MDEBUG("Relative speed " << speed << " for " << connection_id << ", span size " << adapted_max_blocks << "/" << max_blocks);
+    max_blocks = adapted_max_blocks;
+  }
+
   uint64_t span_start_height = last_block_height - block_hashes.size() + 1;
   std::list<crypto::hash>::const_iterator i = block_hashes.begin();
   while (i != block_hashes.end() && requested(*i))
@@ -247,6 +274,47 @@ std::pair<uint64_t, uint64_t> block_queue::get_next_span_if_scheduled(std::list<
   return std::make_pair(i->start_block_height, i->nblocks);
 }
 
+std::pair<uint64_t, uint64_t> block_queue::steal_span_tail(const boost::uuids::uuid &connection_id, std::list<crypto::hash> &hashes, std::function<bool(const std::pair<uint64_t, uint64_t>&)> can_take, boost::posix_time::ptime time)
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const float speed = get_speed(connection_id);
+  if (speed < STEAL_MIN_THIEF_SPEED)
+    return std::make_pair(0, 0);
+
+  block_map::const_iterator i = blocks.begin();
+  if (i != blocks.end() && is_blockchain_placeholder(*i))
+    ++i;
+  for (; i != blocks.end(); ++i)
+  {
+    if (!i->blocks.empty() || i->connection_id == connection_id || i->nblocks < 2 || i->hashes.size() != i->nblocks)
+      continue;
+    const float victim_speed = get_speed(i->connection_id);
+    if (victim_speed > speed * STEAL_MAX_VICTIM_SPEED_RATIO)
+      continue;
+    const uint64_t keep = i->nblocks / 2;
+    const uint64_t tail_start = i->start_block_height + keep;
+    const uint64_t tail_nblocks = i->nblocks - keep;
+    if (can_take && !can_take(std::make_pair(tail_start, tail_nblocks)))
+      continue;
+
+    // the lagging peer keeps the first half, we take the rest
+    span victim = *i;
+    blocks.erase(i);
+    std::list<crypto::hash>::iterator split = victim.hashes.begin();
+    std::advance(split, keep);
+    hashes.clear();
+    hashes.splice(hashes.end(), victim.hashes, split, victim.hashes.end());
+    victim.nblocks = keep;
+    blocks.insert(victim);
+    MDEBUG("Taking over span tail " << tail_start << " - " << (tail_start + tail_nblocks - 1) << " from " << victim.connection_id
+        << " (speed " << victim_speed << ") for " << connection_id << " (speed " << speed << ")");
+    add_blocks(tail_start, tail_nblocks, connection_id, time);
+    set_span_hashes(tail_start, connection_id, hashes);
+    return std::make_pair(tail_start, tail_nblocks);
+  }
+  return std::make_pair(0, 0);
+}
+
 void block_queue::set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::list<crypto::hash> hashes)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
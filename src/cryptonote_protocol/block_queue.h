@@ -33,6 +33,7 @@
 #include <string>
 #include <list>
 #include <set>
+#include <functional>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/uuid/uuid.hpp>
 
@@ -80,6 +81,7 @@ namespace cryptonote
     bool is_blockchain_placeholder(const span &span) const;
     std::pair<uint64_t, uint64_t> get_start_gap_span() const;
     std::pair<uint64_t, uint64_t> get_next_span_if_scheduled(std::list<crypto::hash> &hashes, boost::uuids::uuid &connection_id, boost::posix_time::ptime &time) const;
+    std::pair<uint64_t, uint64_t> steal_span_tail(const boost::uuids::uuid &connection_id, std::list<crypto::hash> &hashes, std::function<bool(const std::pair<uint64_t, uint64_t>&)> can_take = std::function<bool(const std::pair<uint64_t, uint64_t>&)>(), boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time());
     void set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::list<crypto::hash> hashes);
     bool get_next_span(uint64_t &height, std::list<cryptonote::block_complete_entry> &bcel, boost::uuids::uuid &connection_id, bool filled = true) const;
     bool has_next_span(const boost::uuids::uuid &connection_id, bool &filled) const;
@@ -93,6 +93,8 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_request_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_response_block_headers)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -112,6 +114,8 @@ namespace cryptonote
     const block_queue &get_block_queue() const { return m_block_queue; }
     void stop();
     void on_connection_close(cryptonote_connection_context &context);
+    bool flush_relayed_transactions();
+    uint64_t get_tx_relay_flush_interval() const { return m_tx_relay_flush_interval; }
   private:
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
@@ -122,6 +126,8 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
+    int handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -129,11 +135,18 @@ namespace cryptonote
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
+    size_t get_request_window(const cryptonote_connection_context& context) const;
+    bool take_needed_objects(cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span, NOTIFY_REQUEST_GET_OBJECTS::request &req);
+    void post_request_get_objects(cryptonote_connection_context& context, NOTIFY_REQUEST_GET_OBJECTS::request &req, uint64_t start_height);
+    bool has_unpruned_span(const cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span) const;
+    bool request_block_headers(cryptonote_connection_context& context);
+    bool peer_supports_headers_first(cryptonote_connection_context& context);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     bool should_download_next_span(cryptonote_connection_context& context) const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
+    void add_known_tx(cryptonote_connection_context &context, const crypto::hash &id);
     int try_add_next_blocks(cryptonote_connection_context &context);
 
     t_core& m_core;
@@ -147,6 +160,17 @@ namespace cryptonote
     block_queue m_block_queue;
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
 
+    struct pending_relay_tx
+    {
+      crypto::hash id; //blob hash, as stored in the connections' known tx sets
+      cryptonote::blobdata blob;
+      boost::uuids::uuid source;
+    };
+    boost::mutex m_relay_lock; //guards the pending relay queue and all connections' known tx sets
+    std::vector<pending_relay_tx> m_pending_relay_txs;
+    std::unordered_set<crypto::hash> m_pending_relay_ids;
+    uint64_t m_tx_relay_flush_interval;
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
@@ -37,9 +37,12 @@
 
 #include <boost/interprocess/detail/atomic.hpp>
 #include <list>
+#include <map>
 #include <unordered_map>
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "blockchain_db/blockchain_db.h"
+#include "common/command_line.h"
 #include "profile_tools.h"
 #include "p2p/network_throttle-detail.hpp"
 
@@ -64,7 +67,8 @@ namespace cryptonote
                                                                                                               m_p2p(p_net_layout),
                                                                                                               m_syncronized_connections_count(0),
                                                                                                               m_synchronized(false),
-                                                                                                              m_stopping(false)
+                                                                                                              m_stopping(false),
+                                                                                                              m_tx_relay_flush_interval(P2P_DEFAULT_TX_RELAY_FLUSH_INTERVAL)
 
   {
     if(!m_p2p)
@@ -74,6 +78,10 @@ namespace cryptonote
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
+    if (command_line::has_arg(vm, command_line::arg_tx_relay_flush_interval))
+      m_tx_relay_flush_interval = command_line::get_arg(vm, command_line::arg_tx_relay_flush_interval);
+    if (m_tx_relay_flush_interval == 0)
+      m_tx_relay_flush_interval = 1;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -275,6 +283,7 @@ namespace cryptonote
     }
 
     context.m_remote_blockchain_height = hshd.current_height;
+    context.m_pruning_seed = hshd.pruning_seed;
 
     uint64_t target = m_core.get_target_blockchain_height();
     if (target == 0)
@@ -321,6 +330,7 @@ namespace cryptonote
     hshd.top_version = m_core.get_ideal_hard_fork_version(hshd.current_height);
     hshd.cumulative_difficulty = m_core.get_block_cumulative_difficulty(hshd.current_height);
     hshd.current_height +=1;
+    hshd.pruning_seed = m_core.get_blockchain_pruning_seed();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -773,6 +783,13 @@ namespace cryptonote
       return 1;
     }
 
+    {
+      // the sender has these, whatever we make of them
+      CRITICAL_REGION_LOCAL(m_relay_lock);
+      for(const auto &tx_blob: arg.txs)
+        add_known_tx(context, get_blob_hash(tx_blob));
+    }
+
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
     {
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -880,6 +897,7 @@ namespace cryptonote
     std::vector<crypto::hash> block_hashes;
     block_hashes.reserve(arg.blocks.size());
     const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    boost::posix_time::ptime request_time;
     uint64_t start_height = std::numeric_limits<uint64_t>::max();
     cryptonote::block b;
     for(const block_complete_entry& block_entry: arg.blocks)
@@ -927,13 +945,21 @@ namespace cryptonote
       block_hashes.push_back(block_hash);
     }
 
-    if(context.m_requested_objects.size())
+    // responses come in the order the spans were requested, this one must answer the oldest in full
+    if(context.m_requested_spans.empty() || context.m_requested_spans.front().nblocks != block_hashes.size()
+        || block_hashes.empty() || context.m_requested_spans.front().first_block != block_hashes.front())
     {
       MERROR("returned not all requested objects (context.m_requested_objects.size()="
-        << context.m_requested_objects.size() << "), dropping connection");
+        << context.m_requested_objects.size() << ", " << block_hashes.size() << " blocks for "
+        << (context.m_requested_spans.empty() ? 0 : context.m_requested_spans.front().nblocks) << " requested), dropping connection");
       drop_connection(context, false, false);
       return 1;
     }
+    request_time = context.m_requested_spans.front().time;
+    context.m_requested_spans.pop_front();
+    // the peer only starts on the next span once done with this one
+    if (!context.m_requested_spans.empty() && context.m_requested_spans.front().time < now)
+      context.m_requested_spans.front().time = now;
 
     // get the last parsed block, which should be the highest one
     if(m_core.have_block(cryptonote::get_block_hash(b)))
@@ -949,7 +975,7 @@ namespace cryptonote
           << ", blocks: " << start_height << " - " << (start_height + arg.blocks.size() - 1));
 
       // add that new span to the block queue
-      const boost::posix_time::time_duration dt = now - context.m_last_request_time;
+      const boost::posix_time::time_duration dt = now - request_time;
       const float rate = size * 1e6 / (dt.total_microseconds() + 1);
       MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds()/1e6 << " seconds, " << (rate/1e3) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
       m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, rate, blocks_size);
@@ -1193,6 +1219,12 @@ skip:
         const boost::posix_time::time_duration dt = now - context.m_last_request_time;
         if (dt.total_microseconds() > IDLE_PEER_KICK_TIME)
         {
+          // a late answer to a headers request is dropped, we ask for the chain again instead
+          if (!context.m_requested_headers.empty())
+          {
+            MINFO(context << " block headers request timed out");
+            context.m_requested_headers.clear();
+          }
           MINFO(context << " kicking idle peer");
           ++context.m_callback_request_count;
           m_p2p->request_callback(context);
@@ -1283,6 +1315,69 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  size_t t_cryptonote_protocol_handler<t_core>::get_request_window(const cryptonote_connection_context& context) const
+  {
+    const size_t max_requests = m_core.get_block_sync_requests();
+    if (max_requests <= 1)
+      return 1;
+    // the faster a peer is relative to the others, the more spans we keep in flight with it,
+    // so a fast but distant peer is not held back by the round trip between two spans
+    const float speed = m_block_queue.get_speed(context.m_connection_id);
+    return 1 + (size_t)((max_requests - 1) * speed + 0.5f);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::take_needed_objects(cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span, NOTIFY_REQUEST_GET_OBJECTS::request &req)
+  {
+    const uint64_t first_context_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
+    uint64_t skip = span.first - first_context_block_height;
+    if (skip > context.m_needed_objects.size())
+    {
+      MERROR("ERROR: skip " << skip << ", m_needed_objects " << context.m_needed_objects.size() << ", first_context_block_height" << first_context_block_height);
+      return false;
+    }
+    while (skip--)
+      context.m_needed_objects.pop_front();
+    if (context.m_needed_objects.size() < span.second)
+    {
+      MERROR("ERROR: span " << span.first << "/" << span.second << ", m_needed_objects " << context.m_needed_objects.size());
+      return false;
+    }
+
+    auto it = context.m_needed_objects.begin();
+    for (size_t n = 0; n < span.second; ++n)
+    {
+      req.blocks.push_back(*it);
+      context.m_requested_objects.insert(*it);
+      auto j = it++;
+      context.m_needed_objects.erase(j);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::post_request_get_objects(cryptonote_connection_context& context, NOTIFY_REQUEST_GET_OBJECTS::request &req, uint64_t start_height)
+  {
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    context.m_requested_spans.push_back({req.blocks.front(), req.blocks.size(), context.m_last_request_time});
+    LOG_PRINT_CCONTEXT_L1("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size()
+        << " from " << start_height << ", first hash " << req.blocks.front() << ", " << context.m_requested_spans.size() << " in flight");
+    //epee::net_utils::network_throttle_manager::get_global_throttle_inreq().logger_handle_net("log/dr-monero/net/req-all.data", sec, get_avg_block_size());
+
+    post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::has_unpruned_span(const cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span) const
+  {
+    // a pruned peer only has the txes of the blocks in its stripe, and of those near its tip
+    for (uint64_t height = span.first; height < span.first + span.second; ++height)
+      if (!has_unpruned_block(height, context.m_remote_blockchain_height, context.m_pruning_seed))
+        return false;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span)
   {
     // flush stale spans
@@ -1293,6 +1388,14 @@ skip:
     });
     m_block_queue.flush_stale_spans(live_connections);
 
+    // if we already have as many spans in flight as this peer warrants, its next response will get us back here
+    const size_t request_window = get_request_window(context);
+    if (context.m_requested_spans.size() >= request_window)
+    {
+      MDEBUG(context << " " << context.m_requested_spans.size() << "/" << request_window << " span requests in flight, waiting");
+      return true;
+    }
+
     // if we don't need to get next span, and the block queue is full enough, wait a bit
     bool start_from_current_chain = false;
     if (!force_next_span)
@@ -1318,6 +1421,12 @@ skip:
           break;
         }
 
+        if (!context.m_requested_spans.empty())
+        {
+          LOG_DEBUG_CC(context, "Block queue is " << nblocks << " and " << size << ", waiting for span requests in flight");
+          return true;
+        }
+
         if (first)
         {
           LOG_DEBUG_CC(context, "Block queue is " << nblocks << " and " << size << ", pausing");
@@ -1351,7 +1460,6 @@ skip:
       //we know objects that we need, request this objects
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
-      size_t count = 0;
       const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
       {
@@ -1374,6 +1482,11 @@ skip:
             goto skip;
           }
           MDEBUG(context << " we have the hashes for this gap");
+          if (!has_unpruned_span(context, std::make_pair(span.first, std::min(span.second, (uint64_t)count_limit))))
+          {
+            MDEBUG(context << " peer is pruned (stripe " << context.m_pruning_seed << ") and lacks the gap, leaving it to other peers");
+            span = std::make_pair(0, 0);
+          }
         }
       }
       if (force_next_span)
@@ -1384,6 +1497,11 @@ skip:
           boost::uuids::uuid span_connection_id;
           boost::posix_time::ptime time;
           span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+          if (span.second > 0 && !has_unpruned_span(context, span))
+          {
+            MDEBUG(context << " peer is pruned (stripe " << context.m_pruning_seed << ") and lacks the next span " << span.first << "/" << span.second);
+            span = std::make_pair(0, 0);
+          }
           if (span.second > 0)
           {
             is_next = true;
@@ -1413,6 +1531,12 @@ skip:
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
         span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects);
         MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
+        if (span.second > 0 && !has_unpruned_span(context, span))
+        {
+          MDEBUG(context << " peer is pruned (stripe " << context.m_pruning_seed << ") and lacks span " << span.first << "/" << span.second << ", leaving it to other peers");
+          m_block_queue.remove_span(span.first);
+          span = std::make_pair(0, 0);
+        }
       }
       if (span.second == 0 && !force_next_span)
       {
@@ -1420,14 +1544,26 @@ skip:
         std::list<crypto::hash> hashes;
         boost::uuids::uuid span_connection_id;
         boost::posix_time::ptime time;
-        span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+        span = m_block_queue.steal_span_tail(context.m_connection_id, hashes, [&](const std::pair<uint64_t, uint64_t> &tail) { return has_unpruned_span(context, tail); });
+        if (span.second > 0)
+        {
+          MDEBUG(context << " took over the tail of a lagging span: " << span.first << "/" << span.second);
+        }
+        else
+        {
+          span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+          if (span.second > 0 && !has_unpruned_span(context, span))
+          {
+            MDEBUG(context << " peer is pruned (stripe " << context.m_pruning_seed << ") and lacks the next span " << span.first << "/" << span.second);
+            span = std::make_pair(0, 0);
+          }
+        }
         if (span.second > 0)
         {
           is_next = true;
           for (const auto &hash: hashes)
           {
             req.blocks.push_back(hash);
-            ++count;
             context.m_requested_objects.insert(hash);
             // that's atrocious O(n) wise, but this is rare
             auto i = std::find(context.m_needed_objects.begin(), context.m_needed_objects.end(), hash);
@@ -1439,46 +1575,42 @@ skip:
       MDEBUG(context << " span: " << span.first << "/" << span.second << " (" << span.first << " - " << (span.first + span.second - 1) << ")");
       if (span.second > 0)
       {
-        if (!is_next)
+        if (!is_next && !take_needed_objects(context, span, req))
+          return false;
+
+        post_request_get_objects(context, req, span.first);
+
+        // keep the pipeline to this peer full with the following spans we have hashes for
+        while (!is_next && context.m_requested_spans.size() < request_window && !context.m_needed_objects.empty() && !m_stopping)
         {
-          const uint64_t first_context_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
-          uint64_t skip = span.first - first_context_block_height;
-          if (skip > context.m_needed_objects.size())
+          if (m_block_queue.get_num_filled_spans() >= BLOCK_QUEUE_NBLOCKS_THRESHOLD && m_block_queue.get_data_size() >= BLOCK_QUEUE_SIZE_THRESHOLD)
+            break;
+          const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
+          span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects);
+          if (span.second == 0)
+            break;
+          if (!has_unpruned_span(context, span))
           {
-            MERROR("ERROR: skip " << skip << ", m_needed_objects " << context.m_needed_objects.size() << ", first_context_block_height" << first_context_block_height);
-            return false;
+            m_block_queue.remove_span(span.first);
+            break;
           }
-          while (skip--)
-            context.m_needed_objects.pop_front();
-          if (context.m_needed_objects.size() < span.second)
-          {
-            MERROR("ERROR: span " << span.first << "/" << span.second << ", m_needed_objects " << context.m_needed_objects.size());
+          NOTIFY_REQUEST_GET_OBJECTS::request next_req;
+          if (!take_needed_objects(context, span, next_req))
             return false;
-          }
-
-          auto it = context.m_needed_objects.begin();
-          for (size_t n = 0; n < span.second; ++n)
-          {
-            req.blocks.push_back(*it);
-            ++count;
-            context.m_requested_objects.insert(*it);
-            auto j = it++;
-            context.m_needed_objects.erase(j);
-          }
+          MDEBUG(context << " pipelining span " << span.first << "/" << span.second << ", " << context.m_requested_spans.size() + 1 << "/" << request_window << " in flight");
+          post_request_get_objects(context, next_req, span.first);
         }
-
-        context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
-        LOG_PRINT_CCONTEXT_L1("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size()
-            << "requested blocks count=" << count << " / " << count_limit << " from " << span.first << ", first hash " << req.blocks.front());
-        //epee::net_utils::network_throttle_manager::get_global_throttle_inreq().logger_handle_net("log/dr-monero/net/req-all.data", sec, get_avg_block_size());
-
-        post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
         return true;
       }
     }
 
 skip:
     context.m_needed_objects.clear();
+    if (!context.m_requested_spans.empty())
+    {
+      MDEBUG(context << " waiting for " << context.m_requested_spans.size() << " span requests in flight before asking for more hashes");
+      return true;
+    }
     if(context.m_last_response_height < context.m_remote_blockchain_height-1)
     {//we have to fetch more objects ids, request blockchain entry
 
@@ -1588,6 +1720,19 @@ skip:
       context.m_needed_objects.push_back(bl_id);
     }
 
+    if (arg.total_height > m_core.get_target_blockchain_height())
+      m_core.set_target_blockchain_height(arg.total_height);
+
+    if (m_core.headers_first_sync_enabled() && peer_supports_headers_first(context))
+    {
+      if (!request_block_headers(context))
+      {
+        LOG_ERROR_CCONTEXT("Failed to request block headers, dropping connection");
+        drop_connection(context, false, false);
+      }
+      return 1;
+    }
+
     if (!request_missing_objects(context, false))
     {
       LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
@@ -1595,9 +1740,118 @@ skip:
       return 1;
     }
 
-    if (arg.total_height > m_core.get_target_blockchain_height())
-      m_core.set_target_blockchain_height(arg.total_height);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::peer_supports_headers_first(cryptonote_connection_context& context)
+  {
+    uint32_t peer_support_flags = 0;
+    m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t support_flags)->bool{
+      peer_support_flags = support_flags;
+      return true;
+    });
+    return peer_support_flags & P2P_SUPPORT_FLAG_HEADERS_FIRST;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::request_block_headers(cryptonote_connection_context& context)
+  {
+    // ask for the headers of the first run of blocks we neither have nor have verified yet,
+    // the bodies will be scheduled once those are known to carry valid PoW
+    NOTIFY_REQUEST_BLOCK_HEADERS::request req;
+    for (const auto &id: context.m_needed_objects)
+    {
+      if (req.blocks.size() >= BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT)
+        break;
+      if (m_core.have_block(id) || m_core.is_block_header_verified(id))
+      {
+        if (!req.blocks.empty())
+          break;
+        continue;
+      }
+      req.blocks.push_back(id);
+    }
+
+    if (req.blocks.empty())
+      return request_missing_objects(context, false);
 
+    context.m_requested_headers = req.blocks;
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    LOG_PRINT_CCONTEXT_L1("-->>NOTIFY_REQUEST_BLOCK_HEADERS: blocks.size()=" << req.blocks.size() << ", first hash " << req.blocks.front());
+    post_notify<NOTIFY_REQUEST_BLOCK_HEADERS>(req, context);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_BLOCK_HEADERS (" << arg.blocks.size() << " blocks)");
+    NOTIFY_RESPONSE_BLOCK_HEADERS::request rsp;
+    if(!m_core.handle_get_block_headers(arg, rsp, context))
+    {
+      LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_BLOCK_HEADERS, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_BLOCK_HEADERS: headers.size()=" << rsp.headers.size() << ", rsp.current_blockchain_height=" << rsp.current_blockchain_height);
+    post_notify<NOTIFY_RESPONSE_BLOCK_HEADERS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_BLOCK_HEADERS (" << arg.headers.size() << " headers)");
+    if (context.m_requested_headers.empty() || arg.headers.size() > context.m_requested_headers.size())
+    {
+      LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_BLOCK_HEADERS: " << arg.headers.size() << " headers, "
+          << context.m_requested_headers.size() << " requested, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    std::vector<block> headers(arg.headers.size());
+    auto req_it = context.m_requested_headers.begin();
+    size_t n = 0;
+    for (const auto &blob: arg.headers)
+    {
+      if (m_stopping)
+        return 1;
+
+      block &b = headers[n++];
+      if (!parse_and_validate_block_from_blob(blob, b))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong block header: failed to parse and validate block: "
+          << epee::string_tools::buff_to_hex_nodelimer(blob) << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      if (get_block_hash(b) != *req_it++)
+      {
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_BLOCK_HEADERS: block with id=" << get_block_hash(b)
+          << " wasn't requested, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+    }
+    context.m_requested_headers.clear();
+
+    size_t num_verified = 0;
+    if (!m_core.verify_block_headers(headers, num_verified))
+    {
+      LOG_ERROR_CCONTEXT("Block headers failed verification, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    LOG_DEBUG_CC(context, "verified " << num_verified << "/" << headers.size() << " block headers");
+
+    if (!request_missing_objects(context, false))
+    {
+      LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1649,7 +1903,75 @@ skip:
     // no check for success, so tell core they're relayed unconditionally
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
       m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+
+    // queue them, flush_relayed_transactions sends them in one message per peer
+    CRITICAL_REGION_LOCAL(m_relay_lock);
+    for(auto &tx_blob: arg.txs)
+    {
+      const crypto::hash id = get_blob_hash(tx_blob);
+      if (!m_pending_relay_ids.insert(id).second)
+        continue;
+      m_pending_relay_txs.push_back({id, tx_blob, exclude_context.m_connection_id});
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::flush_relayed_transactions()
+  {
+    std::vector<pending_relay_tx> pending;
+    // peers needing the same subset of the pending txes share a message
+    std::map<std::vector<size_t>, std::list<boost::uuids::uuid>> groups;
+    {
+      CRITICAL_REGION_LOCAL(m_relay_lock);
+      if (m_pending_relay_txs.empty())
+        return true;
+      pending.swap(m_pending_relay_txs);
+      m_pending_relay_ids.clear();
+
+      m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+      {
+        if (!peer_id)
+          return true;
+        std::vector<size_t> needed;
+        for (size_t i = 0; i < pending.size(); ++i)
+        {
+          if (pending[i].source == context.m_connection_id || context.m_known_txs.find(pending[i].id) != context.m_known_txs.end())
+            continue;
+          add_known_tx(context, pending[i].id);
+          needed.push_back(i);
+        }
+        if (!needed.empty())
+          groups[std::move(needed)].push_back(context.m_connection_id);
+        return true;
+      });
+    }
+
+    for (const auto &group: groups)
+    {
+      NOTIFY_NEW_TRANSACTIONS::request arg;
+      for (size_t i: group.first)
+        arg.txs.push_back(pending[i].blob);
+      std::string arg_buff;
+      epee::serialization::store_t_to_binary(arg, arg_buff);
+      MDEBUG("Relaying " << arg.txs.size() << " txes to " << group.second.size() << " peers");
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, arg_buff, group.second);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_known_tx(cryptonote_connection_context &context, const crypto::hash &id)
+  {
+    // caller holds m_relay_lock
+    if (!context.m_known_txs.insert(id).second)
+      return;
+    context.m_known_txs_order.push_back(id);
+    while (context.m_known_txs_order.size() > P2P_MAX_KNOWN_TXS_PER_CONNECTION)
+    {
+      context.m_known_txs.erase(context.m_known_txs_order.front());
+      context.m_known_txs_order.pop_front();
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -175,7 +175,7 @@ void t_daemon::stop_p2p()
   {
     throw std::runtime_error{"Can't send stop signal to a stopped daemon"};
   }
-  mp_internals->p2p.get().send_stop_signal();
+  mp_internals->p2p.stop();
 }
 
 } // namespace daemonize
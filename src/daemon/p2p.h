@@ -30,6 +30,9 @@
 
 #pragma once
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "blockchain_db/blockchain_db.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
 #include "p2p/net_node.h"
 #include "daemon/protocol.h"
@@ -52,13 +55,26 @@ public:
   }
 private:
   t_node_server m_server;
+  // a replica has no network, the core is polled for database changes instead
+  bool m_read_only_replica;
+  bool m_replica_stop;
+  boost::mutex m_replica_mutex;
+  boost::condition_variable m_replica_cond;
 public:
   t_p2p(
       boost::program_options::variables_map const & vm
     , t_protocol & protocol
     )
     : m_server{protocol.get()}
+    , m_read_only_replica{command_line::get_arg(vm, cryptonote::arg_db_read_only_replica)}
+    , m_replica_stop{false}
   {
+    if (m_read_only_replica)
+    {
+      MGINFO("Read-only replica, p2p server disabled");
+      return;
+    }
+
     //initialize objects
     MGINFO("Initializing p2p server...");
     if (!m_server.init(vm))
@@ -75,6 +91,22 @@ public:
 
   void run()
   {
+    if (m_read_only_replica)
+    {
+      MGINFO("Following the database...");
+      while (true)
+      {
+        m_server.get_payload_object().get_core().on_idle();
+        boost::unique_lock<boost::mutex> lock(m_replica_mutex);
+        if (!m_replica_stop)
+          m_replica_cond.wait_for(lock, boost::chrono::seconds(1));
+        if (m_replica_stop)
+          break;
+      }
+      MGINFO("Stopped following the database");
+      return;
+    }
+
     MGINFO("Starting p2p net loop...");
     m_server.run();
     MGINFO("p2p net loop stopped");
@@ -82,11 +114,22 @@ public:
 
   void stop()
   {
+    if (m_read_only_replica)
+    {
+      boost::unique_lock<boost::mutex> lock(m_replica_mutex);
+      m_replica_stop = true;
+      m_replica_cond.notify_all();
+      return;
+    }
     m_server.send_stop_signal();
   }
 
   ~t_p2p()
   {
+    // the p2p state file belongs to the daemon owning the data directory
+    if (m_read_only_replica)
+      return;
+
     MGINFO("Deinitializing p2p...");
     try {
       m_server.deinit();
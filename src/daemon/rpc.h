@@ -61,12 +61,15 @@ public:
       throw std::runtime_error("Failed to initialize core rpc server.");
     }
     MGINFO("Core rpc server initialized OK on port: " << m_server.get_binded_port());
+    // a replica does not run the p2p server, so stopping it would not stop the daemon
+    m_server.set_stop_handler(std::bind(&t_p2p::stop, &p2p));
   }
 
   void run()
   {
     MGINFO("Starting core rpc server...");
-    if (!m_server.run(2, false))
+    // waiting long polls have threads of their own, so they do not hold up other requests
+    if (!m_server.run(2 + m_server.get_max_longpolls(), false))
     {
       throw std::runtime_error("Failed to start core rpc server.");
     }
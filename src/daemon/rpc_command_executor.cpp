@@ -977,7 +977,10 @@ bool t_rpc_command_executor::print_transaction_pool_stats() {
 
   tools::msg_writer() << n_transactions << " tx(es), " << res.pool_stats.bytes_total << " bytes total (min " << res.pool_stats.bytes_min << ", max " << res.pool_stats.bytes_max << ", avg " << avg_bytes << ")" << std::endl
       << "fees " << cryptonote::print_money(res.pool_stats.fee_total) << " (avg " << cryptonote::print_money(n_transactions ? res.pool_stats.fee_total / n_transactions : 0) << " per tx" << ", " << cryptonote::print_money(res.pool_stats.bytes_total ? res.pool_stats.fee_total / res.pool_stats.bytes_total : 0) << " per byte)" << std::endl
-      << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message;
+      << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message << std::endl
+      << res.pool_stats.num_evicted << " evicted to keep the pool size (" << res.pool_stats.bytes_evicted << " bytes)" << std::endl
+      << "pool lock held " << res.pool_stats.lock_exclusive_count << " times (avg " << (res.pool_stats.lock_exclusive_count ? res.pool_stats.lock_exclusive_time_total / res.pool_stats.lock_exclusive_count : 0) << " us, max " << res.pool_stats.lock_exclusive_time_max << " us), "
+      << "shared " << res.pool_stats.lock_shared_count << " times (avg " << (res.pool_stats.lock_shared_count ? res.pool_stats.lock_shared_time_total / res.pool_stats.lock_shared_count : 0) << " us, max " << res.pool_stats.lock_shared_time_max << " us)";
 
   if (n_transactions > 1 && res.pool_stats.histo.size())
   {
@@ -657,6 +657,7 @@ namespace nodetool
 
     m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
     m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
+    m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::flush_relayed_transactions, &m_payload_handler), m_payload_handler.get_tx_relay_flush_interval());
 
     boost::thread::attributes attrs;
     attrs.set_stack_size(THREAD_STACK_SIZE);
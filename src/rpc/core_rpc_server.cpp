@@ -59,6 +59,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_bind_port);
     command_line::add_arg(desc, arg_testnet_rpc_bind_port);
     command_line::add_arg(desc, arg_restricted_rpc);
+    command_line::add_arg(desc, arg_rpc_max_longpolls);
     cryptonote::rpc_args::init_options(desc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -68,6 +69,8 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
+    , m_max_longpolls(0)
+    , m_longpolls(0)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(
@@ -84,6 +87,13 @@ namespace cryptonote
       return false;
 
     m_restricted = command_line::get_arg(vm, arg_restricted_rpc);
+    m_read_only_replica = command_line::get_arg(vm, cryptonote::arg_db_read_only_replica);
+    m_max_longpolls = command_line::get_arg(vm, arg_rpc_max_longpolls);
+    if (m_max_longpolls > BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING_LIMIT)
+    {
+      MWARNING("--" << arg_rpc_max_longpolls.name << " " << m_max_longpolls << " would start as many RPC threads, using " << BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING_LIMIT);
+      m_max_longpolls = BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING_LIMIT;
+    }
 
     boost::optional<epee::net_utils::http::login> http_login{};
     std::string port = command_line::get_arg(vm, p2p_bind_arg);
@@ -107,7 +117,8 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_core_ready()
   {
-    if(!m_p2p.get_payload_object().is_synchronized())
+    // a replica has no p2p, it is as synchronized as the daemon it follows
+    if(!m_read_only_replica && !m_p2p.get_payload_object().is_synchronized())
     {
       return false;
     }
@@ -154,41 +165,27 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
-  static cryptonote::blobdata get_pruned_tx_blob(const cryptonote::blobdata &blobdata)
-  {
-    cryptonote::transaction tx;
-
-    if (!cryptonote::parse_and_validate_tx_from_blob(blobdata, tx))
-    {
-      MERROR("Failed to parse and validate tx from blob");
-      return blobdata;
-    }
-
-    std::stringstream ss;
-    binary_archive<true> ba(ss);
-    bool r = tx.serialize_base(ba);
-    CHECK_AND_ASSERT_MES(r, blobdata, "Failed to serialize rct signatures base");
-    return ss.str();
-  }
-  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
   {
     CHECK_CORE_BUSY();
     std::list<std::pair<cryptonote::blobdata, std::list<cryptonote::blobdata> > > bs;
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    // a pruned node only has the full transactions of some blocks, so pruned ones come straight from the db
+    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, req.prune))
     {
-      res.status = "Failed";
+      if (!req.prune && m_core.get_blockchain_storage().get_db().get_pruning_seed())
+        res.status = "Failed: transactions are pruned on this node, request pruned blocks";
+      else
+        res.status = "Failed";
       return false;
     }
 
-    size_t pruned_size = 0, unpruned_size = 0, ntxes = 0;
+    size_t size = 0, ntxes = 0;
     for(auto& bd: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
       res.blocks.back().block = bd.first;
-      pruned_size += bd.first.size();
-      unpruned_size += bd.first.size();
+      size += bd.first.size();
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
       res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
       block b;
@@ -207,14 +204,10 @@ namespace cryptonote
       ntxes += bd.second.size();
       for (std::list<cryptonote::blobdata>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
       {
-        unpruned_size += i->size();
-        if (req.prune)
-          res.blocks.back().txs.push_back(get_pruned_tx_blob(std::move(*i)));
-        else
-          res.blocks.back().txs.push_back(std::move(*i));
+        size += i->size();
+        res.blocks.back().txs.push_back(std::move(*i));
         i->clear();
         i->shrink_to_fit();
-        pruned_size += res.blocks.back().txs.back().size();
 
         res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
         bool r = m_core.get_tx_outputs_gindexs(b.tx_hashes[txidx++], res.output_indices.back().indices.back().indices);
@@ -226,7 +219,7 @@ namespace cryptonote
       }
     }
 
-    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
+    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes" << (req.prune ? " (pruned)" : "") << ", size " << size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -853,9 +846,16 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res)
   {
-    // FIXME: replace back to original m_p2p.send_stop_signal() after
-    // investigating why that isn't working quite right.
-    m_p2p.send_stop_signal();
+    if (m_stop_handler)
+    {
+      m_stop_handler();
+    }
+    else
+    {
+      // FIXME: replace back to original m_p2p.send_stop_signal() after
+      // investigating why that isn't working quite right.
+      m_p2p.send_stop_signal();
+    }
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -934,6 +934,19 @@ namespace cryptonote
       return false;
     }
 
+    if(!req.longpoll_id.empty())
+    {
+      // the server has a thread for each long poll allowed to wait, past that
+      // the current template is returned at once, and the miner polls again
+      const size_t waiting = ++m_longpolls;
+      epee::misc_utils::auto_scope_leave_caller longpoll_counter = epee::misc_utils::create_scope_leave_handler([this]() { --m_longpolls; });
+      if (waiting <= m_max_longpolls)
+        m_core.wait_for_block_template_change(req.longpoll_id, BLOCK_TEMPLATE_LONGPOLL_TIMEOUT * 1000);
+      else
+        MDEBUG("Too many getblocktemplate long polls waiting, returning the current template");
+    }
+    res.longpoll_id = m_core.get_block_template_longpoll_id();
+
     block b = AUTO_VAL_INIT(b);
     cryptonote::blobdata blob_reserve;
     blob_reserve.resize(req.reserve_size, 0);
@@ -1782,4 +1795,10 @@ namespace cryptonote
     , "Restrict RPC to view only commands"
     , false
     };
+
+  const command_line::arg_descriptor<uint32_t> core_rpc_server::arg_rpc_max_longpolls = {
+      "rpc-max-longpolls"
+    , "Max getblocktemplate long polls waiting at once, each gets an RPC thread, 0 to disable long polling"
+    , BLOCK_TEMPLATE_LONGPOLL_MAX_WAITING
+    };
 }  // namespace cryptonote
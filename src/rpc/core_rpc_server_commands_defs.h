@@ -49,7 +49,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 1
-#define CORE_RPC_VERSION_MINOR 13
+#define CORE_RPC_VERSION_MINOR 16
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -699,10 +699,12 @@ namespace cryptonote
     {
       uint64_t reserve_size;       //max 255 bytes
       std::string wallet_address;
+      std::string longpoll_id;     //if set, wait until the template differs from the one with this id
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(reserve_size)
         KV_SERIALIZE(wallet_address)
+        KV_SERIALIZE(longpoll_id)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -715,6 +717,7 @@ namespace cryptonote
       std::string prev_hash;
       blobdata blocktemplate_blob;
       blobdata blockhashing_blob;
+      std::string longpoll_id;
       std::string status;
 
       BEGIN_KV_SERIALIZE_MAP()
@@ -725,6 +728,7 @@ namespace cryptonote
         KV_SERIALIZE(prev_hash)
         KV_SERIALIZE(blocktemplate_blob)
         KV_SERIALIZE(blockhashing_blob)
+        KV_SERIALIZE(longpoll_id)
         KV_SERIALIZE(status)
       END_KV_SERIALIZE_MAP()
     };
@@ -1122,6 +1126,14 @@ namespace cryptonote
     uint32_t num_not_relayed;
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
+    uint64_t lock_exclusive_count;
+    uint64_t lock_exclusive_time_total;  // microseconds
+    uint64_t lock_exclusive_time_max;    // microseconds
+    uint64_t lock_shared_count;
+    uint64_t lock_shared_time_total;     // microseconds
+    uint64_t lock_shared_time_max;       // microseconds
+    uint64_t num_evicted;
+    uint64_t bytes_evicted;
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1135,6 +1147,14 @@ namespace cryptonote
       KV_SERIALIZE(num_not_relayed)
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE_CONTAINER_POD_AS_BLOB(histo)
+      KV_SERIALIZE(lock_exclusive_count)
+      KV_SERIALIZE(lock_exclusive_time_total)
+      KV_SERIALIZE(lock_exclusive_time_max)
+      KV_SERIALIZE(lock_shared_count)
+      KV_SERIALIZE(lock_shared_time_total)
+      KV_SERIALIZE(lock_shared_time_max)
+      KV_SERIALIZE(num_evicted)
+      KV_SERIALIZE(bytes_evicted)
     END_KV_SERIALIZE_MAP()
   };
 
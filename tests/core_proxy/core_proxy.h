@@ -83,6 +83,10 @@ namespace tests
     bool on_idle(){return true;}
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
     bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool handle_get_block_headers(const cryptonote::NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote::NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool verify_block_headers(const std::vector<cryptonote::block> &headers, size_t &num_verified){num_verified = 0; return true;}
+    bool is_block_header_verified(const crypto::hash &id) const {return false;}
+    bool headers_first_sync_enabled() const {return false;}
     cryptonote::Blockchain &get_blockchain_storage() { throw std::runtime_error("Called invalid member function: please never call get_blockchain_storage on the TESTING class proxy_core."); }
     bool get_test_drop_download() {return true;}
     bool get_test_drop_download_height() {return true;}
@@ -90,6 +94,8 @@ namespace tests
     bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
     uint64_t get_target_blockchain_height() const { return 1; }
     size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    size_t get_block_sync_requests() const { return 1; }
+    uint32_t get_blockchain_pruning_seed() const { return 0; }
     virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
     bool get_testnet() const { return false; }
     bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
@@ -453,9 +453,11 @@ inline bool do_replay_events(std::vector<test_event_entry>& events)
   boost::program_options::options_description desc("Allowed options");
   cryptonote::core::init_options(desc);
   boost::program_options::variables_map vm;
+  // each test replays its own chain, which does not need to outlive it
+  const char *argv[] = {"core_tests", "--db-type=memory"};
   bool r = command_line::handle_error_helper(desc, [&]()
   {
-    boost::program_options::store(boost::program_options::basic_parsed_options<char>(&desc), vm);
+    boost::program_options::store(boost::program_options::parse_command_line(2, argv, desc), vm);
     boost::program_options::notify(vm);
     return true;
   });
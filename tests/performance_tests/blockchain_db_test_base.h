@@ -0,0 +1,151 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "blockchain_db/memory/db_memory.h"
+
+/**
+ * Base for the BlockchainDB benchmarks: opens a fresh db of type T in a
+ * temporary directory and fills it with a synthetic chain of the given
+ * number of blocks. The txes are not valid, but the db does not check
+ * anything beyond what it needs to index them.
+ */
+template<typename T, size_t blocks>
+class blockchain_db_test_base
+{
+public:
+  static const size_t txes_per_block = 4;
+  static const size_t outputs_per_tx = 2;
+  static const size_t num_amounts = 8;
+
+  blockchain_db_test_base(): m_db(new T()), m_hardfork(*m_db, 1, 0)
+  {
+  }
+
+  ~blockchain_db_test_base()
+  {
+    try
+    {
+      m_db->close();
+    }
+    catch (...) { }
+    delete m_db;
+    if (!m_path.empty())
+      boost::filesystem::remove_all(m_path);
+  }
+
+  bool init()
+  {
+    m_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    m_db->open(m_path, DBF_FAST);
+    m_hardfork.init();
+    m_db->set_hard_fork(&m_hardfork);
+
+    m_db->set_batch_transactions(true);
+    m_db->batch_start();
+    for (size_t n = 0; n < blocks; ++n)
+    {
+      cryptonote::block b;
+      std::vector<cryptonote::transaction> txs;
+      make_block(b, txs);
+      m_db->add_block(b, 80000, n + 1, n, txs);
+    }
+    m_db->batch_stop();
+    m_db->set_batch_transactions(false);
+    return true;
+  }
+
+protected:
+  // an output amount, so each amount gets a good number of outputs
+  static uint64_t random_amount()
+  {
+    return (crypto::rand<uint64_t>() % num_amounts + 1) * 1000000;
+  }
+
+  static void add_outputs(cryptonote::transaction &tx, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      cryptonote::txout_to_key tk;
+      tk.key = crypto::rand<crypto::public_key>();
+      tx.vout.push_back({random_amount(), tk});
+    }
+  }
+
+  // a block on top of the current chain, with txes spending new key images
+  void make_block(cryptonote::block &b, std::vector<cryptonote::transaction> &txs)
+  {
+    const uint64_t height = m_db->height();
+
+    b = cryptonote::block();
+    b.major_version = 1;
+    b.minor_version = 1;
+    b.timestamp = height;
+    b.prev_id = m_db->top_block_hash();
+    b.nonce = 0;
+
+    b.miner_tx.version = 1;
+    b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+    b.miner_tx.vin.push_back(cryptonote::txin_gen{height});
+    add_outputs(b.miner_tx, 1);
+
+    txs.clear();
+    for (size_t n = 0; n < txes_per_block; ++n)
+    {
+      cryptonote::transaction tx;
+      tx.version = 1;
+      tx.unlock_time = 0;
+      cryptonote::txin_to_key in;
+      in.amount = random_amount();
+      in.key_offsets.push_back(0);
+      in.k_image = crypto::rand<crypto::key_image>();
+      tx.vin.push_back(in);
+      tx.signatures.push_back(std::vector<crypto::signature>(1));
+      add_outputs(tx, outputs_per_tx);
+      b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+      m_tx_hashes.push_back(b.tx_hashes.back());
+      txs.push_back(tx);
+      m_key_images.push_back(in.k_image);
+    }
+  }
+
+  cryptonote::BlockchainDB *m_db;
+  cryptonote::HardFork m_hardfork;
+  std::string m_path;
+  std::vector<crypto::key_image> m_key_images;
+  std::vector<crypto::hash> m_tx_hashes;
+};
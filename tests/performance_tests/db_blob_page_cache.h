@@ -0,0 +1,140 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "performance_tests.h"
+#include "blockchain_db_test_base.h"
+
+/**
+ * Reads every block and tx blob of a database just dropped from the page
+ * cache. The time per call is the time of the whole cold read, and the
+ * amount of the data file it brings back into the page cache is printed
+ * at the end. LMDB maps the file, so that also counts towards the RSS of
+ * a node doing the same reads.
+ */
+template<typename T, size_t blocks, bool compressed>
+class test_db_blob_page_cache : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  test_db_blob_page_cache(): m_resident(0)
+  {
+  }
+
+  ~test_db_blob_page_cache()
+  {
+    if (!g_csv_output && m_resident)
+      std::cout << "Cold read of " << blocks << (compressed ? " compressed" : " uncompressed") << " blocks: "
+          << m_resident / 1024 << " kB of the data file in the page cache" << std::endl;
+  }
+
+  bool init()
+  {
+    if (!base_class::init() || blocks == 0)
+      return false;
+    if (compressed && !this->m_db->set_blob_compression(true))
+      return false;
+    m_filename = this->m_path + "/data.mdb";
+    return access(m_filename.c_str(), R_OK) == 0;
+  }
+
+  bool test()
+  {
+    // closing syncs the file, so its pages are clean and can be dropped
+    this->m_db->close();
+    if (!evict())
+      return false;
+    this->m_db->open(this->m_path, DBF_FAST);
+
+    for (uint64_t height = 0; height < blocks; ++height)
+    {
+      if (this->m_db->get_block_blob_from_height(height).empty())
+        return false;
+    }
+    for (const crypto::hash &h: this->m_tx_hashes)
+    {
+      cryptonote::blobdata bd;
+      if (!this->m_db->get_tx_blob(h, bd))
+        return false;
+    }
+    m_resident = resident();
+    return m_resident > 0;
+  }
+
+private:
+  bool evict() const
+  {
+    const int fd = open(m_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    const bool r = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return r;
+  }
+
+  // bytes of the data file in the page cache, whoever brought them in
+  size_t resident() const
+  {
+    const int fd = open(m_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      close(fd);
+      return 0;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return 0;
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((st.st_size + page_size - 1) / page_size);
+    size_t n = 0;
+    if (mincore(map, st.st_size, pages.data()) == 0)
+    {
+      for (unsigned char page: pages)
+        n += page & 1;
+    }
+    munmap(map, st.st_size);
+    return n * page_size;
+  }
+
+  std::string m_filename;
+  size_t m_resident;
+};
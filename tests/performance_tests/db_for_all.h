@@ -0,0 +1,139 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+
+#include "blockchain_db_test_base.h"
+
+template<typename T, size_t blocks>
+class test_db_for_all_key_images : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool test()
+  {
+    size_t n = 0;
+    this->m_db->for_all_key_images([&n](const crypto::key_image&) { ++n; return true; });
+    return n == this->m_key_images.size();
+  }
+};
+
+template<typename T, size_t blocks>
+class test_db_for_all_outputs : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool test()
+  {
+    size_t n = 0;
+    this->m_db->for_all_outputs([&n](uint64_t, const crypto::hash&, size_t) { ++n; return true; });
+    return n == blocks * (1 + base_class::txes_per_block * base_class::outputs_per_tx);
+  }
+};
+
+template<typename T, size_t blocks>
+class test_db_for_all_transactions : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool test()
+  {
+    size_t n = 0;
+    this->m_db->for_all_transactions([&n](const crypto::hash&, const cryptonote::transaction&) { ++n; return true; });
+    return n == blocks * (1 + base_class::txes_per_block);
+  }
+};
+
+template<typename T, size_t blocks>
+class test_db_for_blocks_range : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool test()
+  {
+    size_t n = 0;
+    this->m_db->for_blocks_range(0, blocks - 1, [&n](uint64_t, const crypto::hash&, const cryptonote::block&) { ++n; return true; });
+    return n == blocks;
+  }
+};
+
+template<typename T, size_t blocks>
+class test_db_for_all_outputs_parallel : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool test()
+  {
+    std::atomic<size_t> n(0);
+    this->m_db->for_all_outputs_parallel([&n](uint64_t, uint64_t, uint64_t, const cryptonote::output_data_t&) { ++n; return true; });
+    return n == blocks * (1 + base_class::txes_per_block * base_class::outputs_per_tx);
+  }
+};
+
+template<typename T, size_t blocks, cryptonote::iteration_detail detail>
+class test_db_for_all_transactions_parallel : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool test()
+  {
+    std::atomic<size_t> n(0);
+    this->m_db->for_all_transactions_parallel([&n](uint64_t, const crypto::hash&, const cryptonote::blobdata*, const cryptonote::transaction*) { ++n; return true; }, detail);
+    return n == blocks * (1 + base_class::txes_per_block);
+  }
+};
+
+template<typename T, size_t blocks, cryptonote::iteration_detail detail>
+class test_db_for_blocks_range_parallel : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool test()
+  {
+    std::atomic<size_t> n(0);
+    this->m_db->for_blocks_range_parallel(0, blocks - 1, [&n](uint64_t, const crypto::hash&, const cryptonote::blobdata*, const cryptonote::block*) { ++n; return true; }, detail);
+    return n == blocks;
+  }
+};
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "blockchain_db_test_base.h"
+
+template<typename T, size_t blocks, bool compressed>
+class test_db_get_block_blob : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 100000;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool init()
+  {
+    if (!base_class::init() || blocks == 0)
+      return false;
+    return !compressed || this->m_db->set_blob_compression(true);
+  }
+
+  bool test()
+  {
+    const uint64_t height = crypto::rand<uint64_t>() % blocks;
+    cryptonote::blobdata bd = this->m_db->get_block_blob_from_height(height);
+    return !bd.empty();
+  }
+};
+
+template<typename T, size_t blocks, bool compressed>
+class test_db_get_tx_blob : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 100000;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool init()
+  {
+    if (!base_class::init() || blocks == 0)
+      return false;
+    return !compressed || this->m_db->set_blob_compression(true);
+  }
+
+  bool test()
+  {
+    const crypto::hash &h = this->m_tx_hashes[crypto::rand<size_t>() % this->m_tx_hashes.size()];
+    cryptonote::blobdata bd;
+    return this->m_db->get_tx_blob(h, bd) && !bd.empty();
+  }
+};
@@ -0,0 +1,72 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "blockchain_db_test_base.h"
+
+// count is the number of outputs looked up per call: one goes through the
+// single output getter, more through the batched one, as for a ring
+template<typename T, size_t blocks, size_t count>
+class test_db_get_output_key : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = count > 1 ? 1000 : 10000;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool init()
+  {
+    if (!base_class::init())
+      return false;
+
+    m_amount = base_class::random_amount();
+    const uint64_t num_outputs = this->m_db->get_num_outputs(m_amount);
+    if (num_outputs == 0)
+      return false;
+    for (size_t n = 0; n < count; ++n)
+      m_offsets.push_back(crypto::rand<uint64_t>() % num_outputs);
+    return true;
+  }
+
+  bool test()
+  {
+    if (count == 1)
+    {
+      cryptonote::output_data_t data = this->m_db->get_output_key(m_amount, m_offsets[0]);
+      return true;
+    }
+    std::vector<cryptonote::output_data_t> outputs;
+    this->m_db->get_output_key(m_amount, m_offsets, outputs);
+    return outputs.size() == count;
+  }
+
+private:
+  uint64_t m_amount;
+  std::vector<uint64_t> m_offsets;
+};
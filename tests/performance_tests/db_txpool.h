@@ -0,0 +1,73 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "blockchain_db_test_base.h"
+
+// one round trip of a tx through the pool metadata: add, read, update, remove
+template<typename T, size_t blocks>
+class test_db_txpool : public blockchain_db_test_base<T, blocks>
+{
+public:
+  static const size_t loop_count = 1000;
+
+  typedef blockchain_db_test_base<T, blocks> base_class;
+
+  bool init()
+  {
+    if (!base_class::init())
+      return false;
+    cryptonote::block b;
+    std::vector<cryptonote::transaction> txs;
+    this->make_block(b, txs);
+    m_tx = txs[0];
+    m_txid = b.tx_hashes[0];
+    memset(&m_meta, 0, sizeof(m_meta));
+    m_meta.blob_size = cryptonote::get_object_blobsize(m_tx);
+    return true;
+  }
+
+  bool test()
+  {
+    // the pool writes in its own txn, as tx_memory_pool's LockedTXN does
+    this->m_db->block_txn_start(false);
+    this->m_db->add_txpool_tx(m_tx, m_meta);
+    cryptonote::txpool_tx_meta_t meta = this->m_db->get_txpool_tx_meta(m_txid);
+    meta.relayed = true;
+    this->m_db->update_txpool_tx(m_txid, meta);
+    this->m_db->remove_txpool_tx(m_txid);
+    this->m_db->block_txn_stop();
+    return meta.blob_size == m_meta.blob_size;
+  }
+
+private:
+  cryptonote::transaction m_tx;
+  crypto::hash m_txid;
+  cryptonote::txpool_tx_meta_t m_meta;
+};
@@ -45,6 +45,15 @@
 #include "is_out_to_acc.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
+#include "db_add_block.h"
+#ifndef _WIN32
+#include "db_blob_page_cache.h"
+#endif
+#include "db_for_all.h"
+#include "db_get_block_blob.h"
+#include "db_get_output_key.h"
+#include "db_has_key_image.h"
+#include "db_txpool.h"
 
 int main(int argc, char** argv)
 {
@@ -54,6 +63,14 @@ int main(int argc, char** argv)
   mlog_configure(mlog_get_default_log_path("performance_tests.log"), true);
   mlog_set_log_level(0);
 
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--csv"))
+      g_csv_output = true;
+  }
+  if (g_csv_output)
+    std::cout << "test,status,loop_count,elapsed_ms,ns_per_call" << std::endl;
+
   performance_timer timer;
   timer.start();
 
@@ -113,7 +130,44 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(test_cn_fast_hash, 16384);
 
-  std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
+  TEST_PERFORMANCE2(test_db_add_pop_block, cryptonote::BlockchainLMDB, 1000);
+  TEST_PERFORMANCE2(test_db_add_pop_block, cryptonote::BlockchainMemory, 1000);
+  TEST_PERFORMANCE3(test_db_get_output_key, cryptonote::BlockchainLMDB, 1000, 1);
+  TEST_PERFORMANCE3(test_db_get_output_key, cryptonote::BlockchainLMDB, 10000, 1);
+  TEST_PERFORMANCE3(test_db_get_output_key, cryptonote::BlockchainLMDB, 10000, 16);
+  TEST_PERFORMANCE3(test_db_get_output_key, cryptonote::BlockchainMemory, 10000, 1);
+  TEST_PERFORMANCE3(test_db_get_output_key, cryptonote::BlockchainMemory, 10000, 16);
+  TEST_PERFORMANCE2(test_db_has_key_image, cryptonote::BlockchainLMDB, 1000);
+  TEST_PERFORMANCE2(test_db_has_key_image, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE2(test_db_has_key_image, cryptonote::BlockchainMemory, 10000);
+  TEST_PERFORMANCE3(test_db_get_block_blob, cryptonote::BlockchainLMDB, 10000, false);
+  TEST_PERFORMANCE3(test_db_get_block_blob, cryptonote::BlockchainLMDB, 10000, true);
+  TEST_PERFORMANCE3(test_db_get_block_blob, cryptonote::BlockchainMemory, 10000, false);
+  TEST_PERFORMANCE3(test_db_get_tx_blob, cryptonote::BlockchainLMDB, 10000, false);
+  TEST_PERFORMANCE3(test_db_get_tx_blob, cryptonote::BlockchainLMDB, 10000, true);
+  TEST_PERFORMANCE3(test_db_get_tx_blob, cryptonote::BlockchainMemory, 10000, false);
+#ifndef _WIN32
+  TEST_PERFORMANCE3(test_db_blob_page_cache, cryptonote::BlockchainLMDB, 10000, false);
+  TEST_PERFORMANCE3(test_db_blob_page_cache, cryptonote::BlockchainLMDB, 10000, true);
+#endif
+  TEST_PERFORMANCE2(test_db_txpool, cryptonote::BlockchainLMDB, 1000);
+  TEST_PERFORMANCE2(test_db_txpool, cryptonote::BlockchainMemory, 1000);
+  TEST_PERFORMANCE2(test_db_for_all_key_images, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_key_images, cryptonote::BlockchainMemory, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_outputs, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_outputs, cryptonote::BlockchainMemory, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_transactions, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_transactions, cryptonote::BlockchainMemory, 10000);
+  TEST_PERFORMANCE2(test_db_for_blocks_range, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE2(test_db_for_blocks_range, cryptonote::BlockchainMemory, 10000);
+  TEST_PERFORMANCE2(test_db_for_all_outputs_parallel, cryptonote::BlockchainLMDB, 10000);
+  TEST_PERFORMANCE3(test_db_for_all_transactions_parallel, cryptonote::BlockchainLMDB, 10000, cryptonote::iterate_blobs);
+  TEST_PERFORMANCE3(test_db_for_all_transactions_parallel, cryptonote::BlockchainLMDB, 10000, cryptonote::iterate_parsed);
+  TEST_PERFORMANCE3(test_db_for_blocks_range_parallel, cryptonote::BlockchainLMDB, 10000, cryptonote::iterate_keys);
+  TEST_PERFORMANCE3(test_db_for_blocks_range_parallel, cryptonote::BlockchainLMDB, 10000, cryptonote::iterate_parsed);
+
+  if (!g_csv_output)
+    std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
   return 0;
 }
@@ -35,6 +35,9 @@
 
 #include <boost/chrono.hpp>
 
+// when set, each test prints a single CSV line instead of a report
+static bool g_csv_output = false;
+
 class performance_timer
 {
 public:
@@ -80,7 +83,8 @@ public:
     performance_timer timer;
     timer.start();
     warm_up();
-    std::cout << "Warm up: " << timer.elapsed_ms() << " ms" << std::endl;
+    if (!g_csv_output)
+      std::cout << "Warm up: " << timer.elapsed_ms() << " ms" << std::endl;
 
     timer.start();
     for (size_t i = 0; i < T::loop_count; ++i)
@@ -125,7 +129,13 @@ template <typename T>
 void run_test(const char* test_name)
 {
   test_runner<T> runner;
-  if (runner.run())
+  if (g_csv_output)
+  {
+    bool r = runner.run();
+    std::cout << '"' << test_name << "\"," << (r ? "OK" : "FAILED") << "," << T::loop_count << "," << runner.elapsed_time() << ","
+        << (r ? (uint64_t)runner.elapsed_time() * 1000000 / T::loop_count : 0) << std::endl;
+  }
+  else if (runner.run())
   {
     std::cout << test_name << " - OK:\n";
     std::cout << "  loop count:    " << T::loop_count << '\n';
@@ -0,0 +1,130 @@
+// Copyright (c) 2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/block_entry_cache.h"
+
+static cryptonote::block_complete_entry make_entry(size_t block_size, size_t ntxs)
+{
+  cryptonote::block_complete_entry entry;
+  entry.block = std::string(block_size, 'b');
+  for (size_t n = 0; n < ntxs; ++n)
+    entry.txs.push_back(std::string(100, 't'));
+  return entry;
+}
+
+TEST(block_entry_cache, empty)
+{
+  cryptonote::block_entry_cache cache(1000000);
+  cryptonote::block_complete_entry entry;
+  ASSERT_FALSE(cache.get(crypto::rand<crypto::hash>(), entry));
+  ASSERT_FALSE(cache.get(0, entry));
+  ASSERT_EQ(cache.get_num_entries(), 0);
+  ASSERT_EQ(cache.get_size(), 0);
+  ASSERT_EQ(cache.get_misses(), 2);
+}
+
+TEST(block_entry_cache, lookup)
+{
+  cryptonote::block_entry_cache cache(1000000);
+  const crypto::hash id = crypto::rand<crypto::hash>();
+  cache.add(10, id, make_entry(500, 2));
+
+  cryptonote::block_complete_entry entry;
+  ASSERT_TRUE(cache.get(id, entry));
+  ASSERT_EQ(entry.block.size(), 500);
+  ASSERT_EQ(entry.txs.size(), 2);
+  entry = cryptonote::block_complete_entry();
+  ASSERT_TRUE(cache.get(10, entry));
+  ASSERT_EQ(entry.block.size(), 500);
+  ASSERT_FALSE(cache.get(11, entry));
+  ASSERT_EQ(cache.get_hits(), 2);
+  ASSERT_EQ(cache.get_misses(), 1);
+
+  // a different block at the same height replaces the old one
+  const crypto::hash id2 = crypto::rand<crypto::hash>();
+  cache.add(10, id2, make_entry(600, 0));
+  ASSERT_FALSE(cache.get(id, entry));
+  ASSERT_TRUE(cache.get(10, entry));
+  ASSERT_EQ(entry.block.size(), 600);
+  ASSERT_EQ(cache.get_num_entries(), 1);
+}
+
+TEST(block_entry_cache, lru_eviction)
+{
+  std::vector<crypto::hash> ids;
+  for (size_t n = 0; n < 4; ++n)
+    ids.push_back(crypto::rand<crypto::hash>());
+
+  // room for three entries only
+  cryptonote::block_entry_cache cache(3 * 2000 + 1000);
+  cryptonote::block_complete_entry entry;
+  for (size_t n = 0; n < 3; ++n)
+    cache.add(n, ids[n], make_entry(1900, 0));
+  ASSERT_EQ(cache.get_num_entries(), 3);
+
+  // use the oldest one, so the second one is now the least recently used
+  ASSERT_TRUE(cache.get(ids[0], entry));
+  cache.add(3, ids[3], make_entry(1900, 0));
+  ASSERT_EQ(cache.get_num_entries(), 3);
+  ASSERT_TRUE(cache.get(ids[0], entry));
+  ASSERT_FALSE(cache.get(ids[1], entry));
+  ASSERT_TRUE(cache.get(ids[2], entry));
+  ASSERT_TRUE(cache.get(ids[3], entry));
+  ASSERT_LE(cache.get_size(), 3 * 2000 + 1000);
+
+  // too large to ever fit
+  cache.add(4, crypto::rand<crypto::hash>(), make_entry(10000, 0));
+  ASSERT_FALSE(cache.get(4, entry));
+  ASSERT_EQ(cache.get_num_entries(), 3);
+}
+
+TEST(block_entry_cache, invalidate)
+{
+  cryptonote::block_entry_cache cache(1000000);
+  std::vector<crypto::hash> ids;
+  for (size_t n = 0; n < 10; ++n)
+  {
+    ids.push_back(crypto::rand<crypto::hash>());
+    cache.add(n, ids[n], make_entry(100, 1));
+  }
+
+  // popping blocks 7 to 9
+  cache.invalidate(7);
+  cryptonote::block_complete_entry entry;
+  ASSERT_EQ(cache.get_num_entries(), 7);
+  ASSERT_TRUE(cache.get(ids[6], entry));
+  ASSERT_FALSE(cache.get(ids[7], entry));
+  ASSERT_FALSE(cache.get(9, entry));
+
+  cache.clear();
+  ASSERT_EQ(cache.get_num_entries(), 0);
+  ASSERT_EQ(cache.get_size(), 0);
+  ASSERT_FALSE(cache.get(ids[0], entry));
+}
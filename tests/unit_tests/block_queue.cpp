@@ -85,3 +85,142 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+static const boost::uuids::uuid &uuid3()
+{
+  static const boost::uuids::uuid uuid = crypto::rand<boost::uuids::uuid>();
+  return uuid;
+}
+
+static std::list<crypto::hash> make_hashes(size_t n)
+{
+  std::list<crypto::hash> hashes;
+  for (size_t i = 0; i < n; ++i)
+    hashes.push_back(crypto::rand<crypto::hash>());
+  return hashes;
+}
+
+static void add_filled_span(cryptonote::block_queue &bq, uint64_t height, size_t nblocks, const boost::uuids::uuid &connection_id, float rate)
+{
+  std::list<cryptonote::block_complete_entry> bcel(nblocks);
+  bq.add_blocks(height, std::move(bcel), connection_id, rate, nblocks * 1000);
+}
+
+TEST(block_queue, adaptive_span_size)
+{
+  cryptonote::block_queue bq;
+  const std::list<crypto::hash> hashes = make_hashes(100);
+
+  // uuid1 is ten times faster than uuid2, uuid3 is not measured yet
+  add_filled_span(bq, 1000, 10, uuid1(), 100000.0f);
+  add_filled_span(bq, 2000, 10, uuid2(), 10000.0f);
+
+  std::pair<uint64_t, uint64_t> span = bq.reserve_span(0, 99, 20, uuid1(), hashes);
+  ASSERT_EQ(span.first, 0);
+  ASSERT_EQ(span.second, 20);
+  span = bq.reserve_span(0, 99, 20, uuid2(), hashes);
+  ASSERT_EQ(span.first, 20);
+  ASSERT_EQ(span.second, 2);
+  span = bq.reserve_span(0, 99, 20, uuid3(), hashes);
+  ASSERT_EQ(span.first, 22);
+  ASSERT_EQ(span.second, 20);
+}
+
+TEST(block_queue, steal_span_tail)
+{
+  cryptonote::block_queue bq;
+  const std::list<crypto::hash> hashes = make_hashes(100);
+
+  // the slow peer reserves a full span before its speed is known
+  std::pair<uint64_t, uint64_t> span = bq.reserve_span(0, 99, 20, uuid2(), hashes);
+  ASSERT_EQ(span.first, 0);
+  ASSERT_EQ(span.second, 20);
+  add_filled_span(bq, 1000, 10, uuid1(), 100000.0f);
+  add_filled_span(bq, 2000, 10, uuid2(), 10000.0f);
+
+  // a slow peer does not take over from a faster one
+  std::list<crypto::hash> stolen;
+  span = bq.steal_span_tail(uuid2(), stolen);
+  ASSERT_EQ(span.second, 0);
+
+  // a peer which can't serve the tail leaves the span alone
+  span = bq.steal_span_tail(uuid1(), stolen, [](const std::pair<uint64_t, uint64_t> &tail) { return tail.first >= 20; });
+  ASSERT_EQ(span.second, 0);
+  bq.foreach([](const cryptonote::block_queue::span &s) {
+    if (s.start_block_height == 0)
+      EXPECT_EQ(s.nblocks, 20);
+    return true;
+  });
+
+  span = bq.steal_span_tail(uuid1(), stolen);
+  ASSERT_EQ(span.first, 10);
+  ASSERT_EQ(span.second, 10);
+  ASSERT_EQ(stolen.size(), 10);
+  ASSERT_EQ(stolen.front(), *std::next(hashes.begin(), 10));
+  ASSERT_EQ(stolen.back(), *std::next(hashes.begin(), 19));
+  ASSERT_TRUE(bq.requested(*std::next(hashes.begin(), 9)));
+  ASSERT_TRUE(bq.requested(*std::next(hashes.begin(), 10)));
+
+  bool found_head = false, found_tail = false;
+  bq.foreach([&](const cryptonote::block_queue::span &s) {
+    if (s.start_block_height == 0)
+    {
+      found_head = true;
+      EXPECT_EQ(s.nblocks, 10);
+      EXPECT_EQ(s.connection_id, uuid2());
+    }
+    else if (s.start_block_height == 10)
+    {
+      found_tail = true;
+      EXPECT_EQ(s.nblocks, 10);
+      EXPECT_EQ(s.connection_id, uuid1());
+    }
+    return true;
+  });
+  ASSERT_TRUE(found_head);
+  ASSERT_TRUE(found_tail);
+
+  // the slow peer still sends the whole span it was asked for, only the head is kept
+  add_filled_span(bq, 0, 20, uuid2(), 10000.0f);
+  uint64_t height;
+  std::list<cryptonote::block_complete_entry> bcel;
+  boost::uuids::uuid connection_id;
+  ASSERT_TRUE(bq.get_next_span(height, bcel, connection_id));
+  ASSERT_EQ(height, 0);
+  ASSERT_EQ(bcel.size(), 10);
+  ASSERT_EQ(connection_id, uuid2());
+
+  // nothing left worth taking over
+  span = bq.steal_span_tail(uuid1(), stolen);
+  ASSERT_EQ(span.second, 0);
+}
+
+TEST(block_queue, heterogeneous_peers)
+{
+  cryptonote::block_queue bq;
+  const std::list<crypto::hash> hashes = make_hashes(1000);
+  const boost::uuids::uuid peers[] = {uuid1(), uuid2(), uuid3()};
+  const float rates[] = {100000.0f, 50000.0f, 5000.0f};
+
+  // measure every peer once, far away from the range we sync
+  for (size_t n = 0; n < 3; ++n)
+    add_filled_span(bq, 10000 + n * 100, 10, peers[n], rates[n]);
+
+  // peers reserve in turn, the faster ones get the bigger spans
+  std::vector<uint64_t> reserved(3, 0);
+  uint64_t next_height = 0;
+  while (next_height < 1000)
+  {
+    for (size_t n = 0; n < 3 && next_height < 1000; ++n)
+    {
+      std::pair<uint64_t, uint64_t> span = bq.reserve_span(0, 999, 20, peers[n], hashes);
+      ASSERT_EQ(span.first, next_height);
+      ASSERT_GT(span.second, 0);
+      next_height += span.second;
+      reserved[n] += span.second;
+    }
+  }
+  ASSERT_GT(reserved[0], reserved[1]);
+  ASSERT_GT(reserved[1], reserved[2]);
+  ASSERT_EQ(reserved[0] + reserved[1] + reserved[2], 1000);
+}
@@ -37,10 +37,12 @@
 
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
+#include "blockchain_db/memory/db_memory.h"
 #ifdef BERKELEY_DB
 #include "blockchain_db/berkeleydb/db_bdb.h"
 #endif
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "ringct/rctOps.h"
 
 using namespace cryptonote;
 using epee::string_tools::pod_to_hex;
@@ -82,6 +84,37 @@ const std::vector<std::vector<std::string>> t_transactions =
     }
   };
 
+// a block on top of prev with a RingCT miner tx, whose outputs are stored
+// with amount 0 and a commitment to their amount
+block make_rct_miner_block(const block& prev, uint64_t height)
+{
+  block b;
+  b.major_version = prev.major_version;
+  b.minor_version = prev.minor_version;
+  b.timestamp = prev.timestamp + 120;
+  b.prev_id = get_block_hash(prev);
+  b.nonce = 0;
+
+  transaction &tx = b.miner_tx;
+  tx.set_null();
+  tx.version = 2;
+  tx.unlock_time = height + 60;
+  txin_gen in;
+  in.height = height;
+  tx.vin.push_back(in);
+  for (uint64_t i = 0; i < 3; ++i)
+  {
+    tx_out out;
+    out.amount = (i + 1) * 1000000;
+    txout_to_key tk;
+    tk.key = rct::rct2pk(rct::pkGen());
+    out.target = tk;
+    tx.vout.push_back(out);
+  }
+  tx.rct_signatures.type = rct::RCTTypeNull;
+  return b;
+}
+
 // if the return type (blobdata for now) of block_to_blob ever changes
 // from std::string, this might break.
 bool compare_blocks(const block& a, const block& b)
@@ -233,6 +266,7 @@ protected:
 using testing::Types;
 
 typedef Types<BlockchainLMDB
+  , BlockchainMemory
 #ifdef BERKELEY_DB
   , BlockchainBDB
 #endif
@@ -343,4 +377,548 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, PrunedTxBlob)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // keep only the top block in full, so the first one gets pruned
+  this->m_db->set_pruning_tip_blocks(1);
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // both blocks are in the first stripe, which the second stripe does not keep
+  ASSERT_EQ(1, get_pruning_stripe(0));
+  ASSERT_EQ(1, get_pruning_stripe(1));
+  ASSERT_TRUE(this->m_db->prune_blockchain(2));
+  ASSERT_EQ(2, this->m_db->get_pruning_seed());
+  ASSERT_FALSE(this->m_db->prune_blockchain(1));
+
+  ASSERT_FALSE(this->m_blocks[0].tx_hashes.empty());
+  for (size_t i = 0; i < this->m_blocks[0].tx_hashes.size(); ++i)
+  {
+    const crypto::hash &h = this->m_blocks[0].tx_hashes[i];
+    const blobdata full = tx_to_blob(this->m_txs[0][i]);
+
+    // only the base is left
+    blobdata bd;
+    ASSERT_FALSE(this->m_db->get_tx_blob(h, bd));
+    ASSERT_TRUE(this->m_db->get_pruned_tx_blob(h, bd));
+    ASSERT_LT(bd.size(), full.size());
+    ASSERT_EQ(0, full.compare(0, bd.size(), bd));
+
+    transaction tx;
+    ASSERT_TRUE(parse_and_validate_tx_base_from_blob(bd, tx));
+    ASSERT_NO_THROW(tx = this->m_db->get_tx(h));
+    ASSERT_HASH_EQ(h, get_transaction_hash(tx));
+    ASSERT_EQ(this->m_txs[0][i].vin.size(), tx.vin.size());
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, PrunedStripeKept)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // pruned before the blocks are added, so they are pruned as they come in
+  this->m_db->set_pruning_tip_blocks(1);
+  ASSERT_TRUE(this->m_db->prune_blockchain(1));
+  ASSERT_EQ(1, this->m_db->get_pruning_seed());
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the first block is past the tip, but in the stripe kept in full
+  for (size_t i = 0; i < this->m_blocks[0].tx_hashes.size(); ++i)
+  {
+    const crypto::hash &h = this->m_blocks[0].tx_hashes[i];
+    const blobdata full = tx_to_blob(this->m_txs[0][i]);
+
+    blobdata bd;
+    ASSERT_TRUE(this->m_db->get_tx_blob(h, bd));
+    ASSERT_EQ(full, bd);
+    ASSERT_TRUE(this->m_db->get_pruned_tx_blob(h, bd));
+    ASSERT_LT(bd.size(), full.size());
+    ASSERT_EQ(0, full.compare(0, bd.size(), bd));
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, OutputKeys)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // RingCT miner txes, their outputs are looked up with amount 0
+  std::vector<block> rct_blocks;
+  rct_blocks.push_back(make_rct_miner_block(this->m_blocks[1], 2));
+  rct_blocks.push_back(make_rct_miner_block(rct_blocks[0], 3));
+  for (const block &b: rct_blocks)
+    ASSERT_NO_THROW(this->m_db->add_block(b, 100, t_diffs[1], t_coins[1], std::vector<transaction>()));
+
+  auto check_outputs = [this](const block &b) {
+    const transaction &tx = b.miner_tx;
+    const crypto::hash tx_hash = get_transaction_hash(tx);
+    const bool rct = tx.version > 1;
+    uint64_t tx_id;
+    ASSERT_TRUE(this->m_db->tx_exists(tx_hash, tx_id));
+    const std::vector<uint64_t> indices = this->m_db->get_tx_amount_output_indices(tx_id);
+    ASSERT_EQ(tx.vout.size(), indices.size());
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      const uint64_t amount = rct ? 0 : tx.vout[i].amount;
+      output_data_t od;
+      ASSERT_NO_THROW(od = this->m_db->get_output_key(amount, indices[i]));
+      ASSERT_HASH_EQ(boost::get<txout_to_key>(tx.vout[i].target).key, od.pubkey);
+      ASSERT_EQ(tx.unlock_time, od.unlock_time);
+      if (rct)
+        ASSERT_HASH_EQ(rct::zeroCommit(tx.vout[i].amount), od.commitment);
+
+      tx_out_index toi;
+      ASSERT_NO_THROW(toi = this->m_db->get_output_tx_and_index(amount, indices[i]));
+      ASSERT_HASH_EQ(tx_hash, toi.first);
+      ASSERT_EQ(i, toi.second);
+    }
+
+    // the same, as ring members
+    if (rct)
+    {
+      std::vector<output_data_t> ods;
+      std::vector<tx_out_index> tois;
+      ASSERT_NO_THROW(this->m_db->get_output_key(0, indices, ods));
+      ASSERT_NO_THROW(this->m_db->get_output_tx_and_index(0, indices, tois));
+      ASSERT_EQ(tx.vout.size(), ods.size());
+      ASSERT_EQ(tx.vout.size(), tois.size());
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        ASSERT_HASH_EQ(boost::get<txout_to_key>(tx.vout[i].target).key, ods[i].pubkey);
+        ASSERT_HASH_EQ(tx_hash, tois[i].first);
+        ASSERT_EQ(i, tois[i].second);
+      }
+    }
+  };
+
+  check_outputs(this->m_blocks[0]);
+  check_outputs(this->m_blocks[1]);
+  check_outputs(rct_blocks[0]);
+  check_outputs(rct_blocks[1]);
+  ASSERT_EQ(6, this->m_db->get_num_outputs(0));
+
+  // RingCT outputs from a popped block are gone, and come back when it is added again
+  {
+    block b;
+    std::vector<transaction> txs;
+    ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+    ASSERT_EQ(3, this->m_db->get_num_outputs(0));
+    ASSERT_THROW(this->m_db->get_output_key(0, 3), OUTPUT_DNE);
+    check_outputs(rct_blocks[0]);
+    ASSERT_NO_THROW(this->m_db->add_block(rct_blocks[1], 100, t_diffs[1], t_coins[1], std::vector<transaction>()));
+    check_outputs(rct_blocks[1]);
+    for (size_t n = 0; n < rct_blocks.size(); ++n)
+      ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  }
+
+  // outputs from a popped block are gone, and come back when it is added again
+  block b;
+  std::vector<transaction> txs;
+  const uint64_t amount = this->m_blocks[1].miner_tx.vout[0].amount;
+  const uint64_t num_outputs = this->m_db->get_num_outputs(amount);
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  ASSERT_LT(this->m_db->get_num_outputs(amount), num_outputs);
+  ASSERT_THROW(this->m_db->get_output_key(amount, num_outputs - 1), OUTPUT_DNE);
+  check_outputs(this->m_blocks[0]);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  check_outputs(this->m_blocks[0]);
+  check_outputs(this->m_blocks[1]);
+}
+
+TYPED_TEST(BlockchainDBTest, PopBlocks)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  const uint64_t num_outputs = this->m_db->get_num_outputs(this->m_blocks[0].miner_tx.vout[0].amount);
+
+  std::vector<block> blocks;
+  std::vector<transaction> txs;
+  ASSERT_THROW(this->m_db->pop_blocks(3, blocks, txs), BLOCK_DNE);
+  ASSERT_EQ(2, this->m_db->height());
+
+  // the popped blocks and their txes come back in chain order
+  ASSERT_NO_THROW(this->m_db->pop_blocks(2, blocks, txs));
+  ASSERT_EQ(0, this->m_db->height());
+  ASSERT_EQ(0, this->m_db->get_tx_count());
+  ASSERT_EQ(2, blocks.size());
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), get_block_hash(blocks[0]));
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), get_block_hash(blocks[1]));
+  ASSERT_EQ(this->m_txs[0].size() + this->m_txs[1].size(), txs.size());
+  size_t n = 0;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    ASSERT_FALSE(this->m_db->block_exists(get_block_hash(this->m_blocks[i])));
+    ASSERT_FALSE(this->m_db->tx_exists(get_transaction_hash(this->m_blocks[i].miner_tx)));
+    for (const transaction &tx : this->m_txs[i])
+    {
+      ASSERT_HASH_EQ(get_transaction_hash(tx), get_transaction_hash(txs[n++]));
+      ASSERT_FALSE(this->m_db->tx_exists(get_transaction_hash(tx)));
+      for (const txin_v &in : tx.vin)
+        if (in.type() == typeid(txin_to_key))
+          ASSERT_FALSE(this->m_db->has_key_image(boost::get<txin_to_key>(in).k_image));
+    }
+  }
+
+  // the same blocks can be added again, with the same output indices
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_EQ(2, this->m_db->height());
+  ASSERT_EQ(num_outputs, this->m_db->get_num_outputs(this->m_blocks[0].miner_tx.vout[0].amount));
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), this->m_db->top_block_hash());
+
+  // popping the top block alone leaves the first one as it was
+  ASSERT_NO_THROW(this->m_db->pop_blocks(1, blocks, txs));
+  ASSERT_EQ(1, this->m_db->height());
+  ASSERT_EQ(1, blocks.size());
+  ASSERT_EQ(this->m_txs[1].size(), txs.size());
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), this->m_db->top_block_hash());
+  for (const transaction &tx : this->m_txs[0])
+    ASSERT_TRUE(this->m_db->tx_exists(get_transaction_hash(tx)));
+}
+
+TYPED_TEST(BlockchainDBTest, ParallelIteration)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the callbacks may run concurrently
+  boost::mutex lock;
+
+  std::map<uint64_t, crypto::hash> blocks;
+  ASSERT_TRUE(this->m_db->for_blocks_range_parallel(0, 10, [&](uint64_t height, const crypto::hash &hash, const blobdata *blob, const block *blk) {
+    boost::lock_guard<boost::mutex> guard(lock);
+    blocks[height] = hash;
+    return blob && blk && get_block_hash(*blk) == hash && *blob == block_to_blob(*blk);
+  }, iterate_parsed, 2));
+  ASSERT_EQ(2, blocks.size());
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), blocks[0]);
+  ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), blocks[1]);
+  ASSERT_TRUE(this->m_db->for_blocks_range_parallel(1, 1, [&](uint64_t height, const crypto::hash &hash, const blobdata *blob, const block *blk) {
+    return height == 1 && !blob && !blk;
+  }, iterate_keys));
+  ASSERT_FALSE(this->m_db->for_blocks_range_parallel(0, 1, [](uint64_t, const crypto::hash&, const blobdata*, const block*) { return false; }, iterate_keys));
+
+  std::unordered_map<crypto::hash, uint64_t> txs;
+  ASSERT_TRUE(this->m_db->for_all_transactions_parallel([&](uint64_t height, const crypto::hash &tx_hash, const blobdata *blob, const transaction *tx) {
+    boost::lock_guard<boost::mutex> guard(lock);
+    txs[tx_hash] = height;
+    transaction parsed;
+    return blob && !tx && parse_and_validate_tx_from_blob(*blob, parsed) && get_transaction_hash(parsed) == tx_hash;
+  }, iterate_blobs));
+  ASSERT_EQ(2 + this->m_txs[0].size() + this->m_txs[1].size(), txs.size());
+  size_t expected_outputs = 0;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    ASSERT_EQ(i, txs[get_transaction_hash(this->m_blocks[i].miner_tx)]);
+    expected_outputs += this->m_blocks[i].miner_tx.vout.size();
+    for (const transaction &tx : this->m_txs[i])
+    {
+      ASSERT_EQ(i, txs[get_transaction_hash(tx)]);
+      expected_outputs += tx.vout.size();
+    }
+  }
+
+  size_t num_outputs = 0;
+  ASSERT_TRUE(this->m_db->for_all_outputs_parallel([&](uint64_t amount, uint64_t amount_index, uint64_t output_id, const output_data_t &data) {
+    boost::lock_guard<boost::mutex> guard(lock);
+    ++num_outputs;
+    return data.pubkey == this->m_db->get_output_key(amount, amount_index).pubkey && output_id < expected_outputs;
+  }));
+  ASSERT_EQ(expected_outputs, num_outputs);
+}
+
+TYPED_TEST(BlockchainDBTest, BlobCompression)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  auto check_blobs = [this]() {
+    for (size_t i = 0; i < 2; ++i)
+    {
+      ASSERT_EQ(block_to_blob(this->m_blocks[i]), this->m_db->get_block_blob_from_height(i));
+      for (const transaction &tx : this->m_txs[i])
+      {
+        blobdata bd;
+        ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx), bd));
+        ASSERT_EQ(tx_to_blob(tx), bd);
+      }
+    }
+  };
+
+  ASSERT_FALSE(this->m_db->get_blob_compression());
+  const bool compressed = this->m_db->set_blob_compression(true);
+  ASSERT_EQ(compressed, this->m_db->get_blob_compression());
+  if (!compressed)
+    return; // not supported by this db or build
+  check_blobs();
+
+  // blobs added while compressing read back the same
+  block b;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(b, txs));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  check_blobs();
+
+  ASSERT_TRUE(this->m_db->set_blob_compression(false));
+  ASSERT_FALSE(this->m_db->get_blob_compression());
+  check_blobs();
+}
+
+TYPED_TEST(BlockchainDBTest, TxpoolKeyImages)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+
+  const transaction &tx = this->m_txs[0][0];
+  const crypto::hash txid = get_transaction_hash(tx);
+  txpool_tx_meta_t meta = AUTO_VAL_INIT(meta);
+  std::vector<crypto::key_image> key_images;
+
+  // the pool indexes a tx from these without parsing it
+  this->m_db->block_txn_start(false);
+  ASSERT_NO_THROW(this->m_db->add_txpool_tx(tx, meta));
+  this->m_db->block_txn_stop();
+  ASSERT_TRUE(this->m_db->get_txpool_tx_key_images(txid, key_images));
+  ASSERT_EQ(tx.vin.size(), key_images.size());
+  for (size_t i = 0; i < tx.vin.size(); ++i)
+    ASSERT_HASH_EQ(boost::get<txin_to_key>(tx.vin[i]).k_image, key_images[i]);
+
+  this->m_db->block_txn_start(false);
+  ASSERT_NO_THROW(this->m_db->remove_txpool_tx(txid));
+  this->m_db->block_txn_stop();
+  ASSERT_FALSE(this->m_db->get_txpool_tx_key_images(txid, key_images));
+
+  ASSERT_NO_THROW(this->m_db->close());
+}
+
+typedef BlockchainDBTest<BlockchainLMDB> BlockchainLMDBTest;
+
+TEST_F(BlockchainLMDBTest, OutputTableCleanAtSync)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+  this->m_db->set_batch_transactions(true);
+
+  // the table as a later open would see it
+  output_table table;
+  if (!table.open(dirPath, true))
+    return; // not available on this platform
+  table.close();
+  uint64_t num_outputs = 0;
+  auto count_outputs = [&](size_t n) {
+    num_outputs += this->m_blocks[n].miner_tx.vout.size();
+    for (const transaction &tx: this->m_txs[n])
+      num_outputs += tx.vout.size();
+  };
+  auto is_valid = [&]() {
+    table.open(dirPath, true);
+    const bool valid = table.is_valid(num_outputs, this->m_db->get_num_outputs(0), this->m_db->top_block_hash());
+    table.close();
+    return valid;
+  };
+
+  // writing marks the table dirty, a sync marks it clean
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  count_outputs(0);
+  ASSERT_FALSE(is_valid());
+  ASSERT_NO_THROW(this->m_db->sync());
+  ASSERT_TRUE(is_valid());
+
+  // a sync during a batch leaves it dirty, as the batch is not committed yet
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  count_outputs(1);
+  ASSERT_NO_THROW(this->m_db->sync());
+  ASSERT_NO_THROW(this->m_db->batch_stop());
+  ASSERT_FALSE(is_valid());
+  ASSERT_NO_THROW(this->m_db->sync());
+  ASSERT_TRUE(is_valid());
+
+  // an aborted batch leaves it dirty for good, the LMDB state is the same but the records may not be
+  block blk;
+  std::vector<transaction> txs;
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+  ASSERT_NO_THROW(static_cast<BlockchainLMDB*>(this->m_db)->batch_abort());
+  ASSERT_EQ(this->m_db->height(), 2);
+  ASSERT_NO_THROW(this->m_db->sync());
+  ASSERT_FALSE(is_valid());
+
+  ASSERT_NO_THROW(this->m_db->close());
+}
+
+TEST(blob_compressor, round_trip)
+{
+  // each blob is sampled a few times, so it all ends up in the dictionary,
+  // where real blobs would only share their structure
+  std::vector<std::string> samples;
+  for (int n = 0; n < 3; ++n)
+  {
+    for (const auto &i : t_transactions)
+      for (const auto &j : i)
+        samples.push_back(h2b(j));
+    for (const auto &i : t_blocks)
+      samples.push_back(h2b(i));
+  }
+
+  blob_compressor compressor;
+  std::string out;
+  ASSERT_FALSE(compressor.compress(samples[0].data(), samples[0].size(), out));
+  compressor.set_dictionary(blob_compressor::train_dictionary(samples));
+  ASSERT_LE(compressor.get_dictionary().size(), blob_compressor::MAX_DICTIONARY_SIZE);
+  if (!blob_compressor::available())
+    return;
+  ASSERT_FALSE(compressor.get_dictionary().empty());
+
+  for (const std::string &sample : samples)
+  {
+    ASSERT_FALSE(blob_compressor::is_compressed(sample.data(), sample.size()));
+    std::string compressed, decompressed;
+    ASSERT_TRUE(compressor.compress(sample.data(), sample.size(), compressed));
+    ASSERT_LT(compressed.size(), sample.size() / 4);
+    ASSERT_TRUE(blob_compressor::is_compressed(compressed.data(), compressed.size()));
+    ASSERT_TRUE(compressor.decompress(compressed.data(), compressed.size(), decompressed));
+    ASSERT_EQ(sample, decompressed);
+
+    // a truncated blob is caught
+    ASSERT_FALSE(compressor.decompress(compressed.data(), compressed.size() - 1, decompressed));
+  }
+}
+
+TEST(output_table, reopen)
+{
+  const std::string dirPath = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  ASSERT_TRUE(boost::filesystem::create_directories(dirPath));
+
+  output_table table;
+  if (!table.open(dirPath, false))
+  {
+    boost::filesystem::remove_all(dirPath);
+    return; // not available on this platform
+  }
+
+  crypto::hash top_hash = null_hash;
+  top_hash.data[0] = 1;
+
+  // a new table has to be built first
+  ASSERT_FALSE(table.is_valid(0, 0, null_hash));
+  table.reset();
+
+  output_data_t od;
+  memset(&od, 0, sizeof(od));
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    od.pubkey.data[0] = i;
+    od.commitment.bytes[0] = i;
+    od.unlock_time = i * 2;
+    od.height = i / 2;
+    // even outputs are RingCT
+    table.add(i, (i & 1) ? 1000 : 0, i / 2, od);
+  }
+  // a state read before the last write is not recorded
+  const uint64_t generation = table.get_generation();
+  ASSERT_FALSE(table.set_clean(9, 4, top_hash, generation - 1));
+  ASSERT_TRUE(table.set_clean(10, 5, top_hash, generation));
+  table.close();
+
+  ASSERT_TRUE(table.open(dirPath, true));
+  ASSERT_TRUE(table.is_valid(10, 5, top_hash));
+  ASSERT_FALSE(table.is_valid(11, 5, top_hash));
+  ASSERT_FALSE(table.is_valid(10, 5, null_hash));
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    const output_table_entry &e = table.get(i);
+    ASSERT_EQ(i, (uint64_t)e.data.pubkey.data[0]);
+    ASSERT_EQ(i * 2, e.data.unlock_time);
+    ASSERT_EQ(i / 2, e.data.height);
+    ASSERT_EQ((i & 1) ? 1000 : 0, e.amount);
+    // pre-RingCT commitments are not stored
+    ASSERT_EQ((i & 1) ? 0 : i, (uint64_t)e.data.commitment.bytes[0]);
+  }
+  for (uint64_t i = 0; i < 5; ++i)
+    ASSERT_EQ(i * 2, table.get_rct_output_id(i));
+  table.close();
+
+  // a table left dirty is not valid
+  ASSERT_TRUE(table.open(dirPath, false));
+  table.set_dirty();
+  table.close();
+  ASSERT_TRUE(table.open(dirPath, true));
+  ASSERT_FALSE(table.is_valid(10, 5, top_hash));
+  table.close();
+
+  boost::filesystem::remove_all(dirPath);
+}
+
 }  // anonymous namespace
@@ -0,0 +1,182 @@
+// Copyright (c) 2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+namespace
+{
+  // an amount no genesis output has, so the ring members are the ones added here
+  const uint64_t test_amount = 1234567;
+  const size_t test_outputs = 3;
+
+  const std::pair<uint8_t, uint64_t> test_hard_forks[] = { std::make_pair(1, 0), std::make_pair(0, 0) };
+
+  class check_tx_inputs_batch_test : public ::testing::Test
+  {
+  protected:
+    check_tx_inputs_batch_test(): m_pool(m_bc), m_bc(m_pool)
+    {
+    }
+
+    virtual void SetUp()
+    {
+      m_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+      cryptonote::BlockchainDB *db = new cryptonote::BlockchainLMDB();
+      db->open(m_path, DBF_FAST);
+      const cryptonote::test_options options = { test_hard_forks };
+      ASSERT_TRUE(m_bc.init(db, false, &options));
+
+      // one spendable output with a known key per block
+      for (size_t n = 0; n < test_outputs; ++n)
+      {
+        cryptonote::keypair keys = cryptonote::keypair::generate();
+        m_keys.push_back(keys);
+        add_block({}, keys.pub);
+      }
+    }
+
+    virtual void TearDown()
+    {
+      m_bc.deinit();
+      boost::filesystem::remove_all(m_path);
+    }
+
+    // a block on top of the chain, bypassing the consensus checks
+    void add_block(const std::vector<cryptonote::transaction> &txs, const crypto::public_key &key)
+    {
+      cryptonote::BlockchainDB &db = m_bc.get_db();
+      const uint64_t height = db.height();
+
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = height;
+      b.prev_id = db.top_block_hash();
+      b.nonce = 0;
+      b.miner_tx.version = 1;
+      b.miner_tx.unlock_time = 0;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{height});
+      cryptonote::txout_to_key tk;
+      tk.key = key;
+      b.miner_tx.vout.push_back({test_amount, tk});
+      for (const cryptonote::transaction &tx: txs)
+        b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+
+      db.add_block(b, 1000, height + 1, test_amount * (height + 1), txs);
+    }
+
+    // a tx spending the given output, with the given output key to tell txes apart
+    cryptonote::transaction make_tx(size_t output, const crypto::public_key &key)
+    {
+      cryptonote::transaction tx;
+      tx.version = 1;
+      tx.unlock_time = 0;
+      cryptonote::txin_to_key in;
+      in.amount = test_amount;
+      in.key_offsets.push_back(output);
+      crypto::generate_key_image(m_keys[output].pub, m_keys[output].sec, in.k_image);
+      tx.vin.push_back(in);
+      cryptonote::txout_to_key tk;
+      tk.key = key;
+      tx.vout.push_back({test_amount, tk});
+
+      const crypto::hash prefix_hash = cryptonote::get_transaction_prefix_hash(tx);
+      std::vector<const crypto::public_key*> pubs(1, &m_keys[output].pub);
+      tx.signatures.push_back(std::vector<crypto::signature>(1));
+      crypto::generate_ring_signature(prefix_hash, in.k_image, pubs, m_keys[output].sec, 0, tx.signatures.back().data());
+      tx.invalidate_hashes();
+      return tx;
+    }
+
+    cryptonote::tx_memory_pool m_pool;
+    cryptonote::Blockchain m_bc;
+    std::string m_path;
+    std::vector<cryptonote::keypair> m_keys;
+  };
+}
+
+TEST_F(check_tx_inputs_batch_test, result_reused)
+{
+  cryptonote::transaction tx = make_tx(0, crypto::rand<crypto::public_key>());
+  const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+  tools::thread_group threadpool;
+  m_bc.check_tx_inputs_batch({&tx}, threadpool);
+  ASSERT_TRUE(m_bc.has_tx_inputs_check(txid));
+
+  uint64_t max_used_block_height;
+  crypto::hash max_used_block_id;
+  cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_TRUE(m_bc.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc));
+  ASSERT_EQ(max_used_block_height, 1);
+  ASSERT_EQ(max_used_block_id, m_bc.get_db().get_block_hash_from_height(1));
+
+  // used once
+  ASSERT_FALSE(m_bc.has_tx_inputs_check(txid));
+}
+
+TEST_F(check_tx_inputs_batch_test, stale_after_tip_change)
+{
+  cryptonote::transaction tx = make_tx(1, crypto::rand<crypto::public_key>());
+  tools::thread_group threadpool;
+  m_bc.check_tx_inputs_batch({&tx}, threadpool);
+  ASSERT_TRUE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx)));
+
+  // the key image gets spent on the new tip, so the earlier result is wrong now
+  add_block({tx}, crypto::rand<crypto::public_key>());
+
+  uint64_t max_used_block_height;
+  crypto::hash max_used_block_id;
+  cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_FALSE(m_bc.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc));
+  ASSERT_TRUE(tvc.m_double_spend);
+}
+
+TEST_F(check_tx_inputs_batch_test, same_key_image_in_batch)
+{
+  cryptonote::transaction tx0 = make_tx(2, crypto::rand<crypto::public_key>());
+  cryptonote::transaction tx1 = make_tx(2, crypto::rand<crypto::public_key>());
+  cryptonote::transaction tx2 = make_tx(0, crypto::rand<crypto::public_key>());
+  tools::thread_group threadpool;
+  m_bc.check_tx_inputs_batch({&tx0, &tx1, &tx2}, threadpool);
+  ASSERT_TRUE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx0)));
+  ASSERT_FALSE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx1)));
+  ASSERT_TRUE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx2)));
+
+  // a new batch drops the results of the previous one
+  m_bc.check_tx_inputs_batch({&tx1}, threadpool);
+  ASSERT_FALSE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx0)));
+  ASSERT_TRUE(m_bc.has_tx_inputs_check(cryptonote::get_transaction_hash(tx1)));
+}
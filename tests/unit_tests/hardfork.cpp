@@ -64,6 +64,7 @@ public:
   virtual blobdata get_block_blob_from_height(const uint64_t& height) const { return cryptonote::t_serializable_object_to_blob(get_block_from_height(height)); }
   virtual blobdata get_block_blob(const crypto::hash& h) const { return blobdata(); }
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const { return false; }
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const { return false; }
   virtual uint64_t get_block_height(const crypto::hash& h) const { return 0; }
   virtual block_header get_block_header(const crypto::hash& h) const { return block_header(); }
   virtual uint64_t get_block_timestamp(const uint64_t& height) const { return 0; }
@@ -110,7 +111,15 @@ public:
   virtual bool for_blocks_range(const uint64_t&, const uint64_t&, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const { return true; }
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>) const { return true; }
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, size_t tx_idx)> f) const { return true; }
+  virtual bool for_blocks_range_parallel(uint64_t, uint64_t, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::blobdata*, const cryptonote::block*)>, iteration_detail, unsigned) const { return true; }
+  virtual bool for_all_transactions_parallel(std::function<bool(uint64_t, const crypto::hash&, const cryptonote::blobdata*, const cryptonote::transaction*)>, iteration_detail, unsigned) const { return true; }
+  virtual bool for_all_outputs_parallel(std::function<bool(uint64_t, uint64_t, uint64_t, const output_data_t&)>, unsigned) const { return true; }
   virtual bool is_read_only() const { return false; }
+  virtual uint32_t get_pruning_seed() const { return 0; }
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0) { return false; }
+  virtual bool get_blob_compression() const { return false; }
+  virtual bool set_blob_compression(bool enable) { return false; }
+  virtual bool copy_compacted(const std::string &folder) { return false; }
   virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff) const { return std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>(); }
 
   virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& details) {}
@@ -121,6 +130,7 @@ public:
   virtual txpool_tx_meta_t get_txpool_tx_meta(const crypto::hash& txid) const { return txpool_tx_meta_t(); }
   virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const { return false; }
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const { return ""; }
+  virtual bool get_txpool_tx_key_images(const crypto::hash& txid, std::vector<crypto::key_image> &key_images) const { return false; }
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false) const { return false; }
 
   virtual void add_block( const block& blk
@@ -0,0 +1,107 @@
+// Copyright (c) 2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/verified_header_cache.h"
+
+// lookups, LRU eviction and invalidation are shared with block_entry_cache and tested there
+
+static cryptonote::verified_header make_header(uint64_t height)
+{
+  cryptonote::verified_header header;
+  header.prev_id = crypto::rand<crypto::hash>();
+  header.height = height;
+  header.timestamp = 1500000000 + height * 120;
+  header.major_version = 1;
+  header.difficulty = 1000 + height;
+  header.cumulative_difficulty = 1000 * height;
+  header.proof_of_work = crypto::rand<crypto::hash>();
+  return header;
+}
+
+TEST(verified_header_cache, take)
+{
+  cryptonote::verified_header_cache cache(100);
+  const crypto::hash id = crypto::rand<crypto::hash>();
+  cache.add(10, id, make_header(10));
+
+  cryptonote::verified_header header;
+  ASSERT_TRUE(cache.take(id, header));
+  ASSERT_EQ(header.height, 10);
+  ASSERT_EQ(header.difficulty, 1010);
+  ASSERT_EQ(cache.get_num_entries(), 0);
+  ASSERT_FALSE(cache.take(id, header));
+  ASSERT_FALSE(cache.get(id, header));
+}
+
+TEST(verified_header_cache, bounded_by_count)
+{
+  cryptonote::verified_header_cache cache(3);
+  std::vector<crypto::hash> ids;
+  for (size_t n = 0; n < 4; ++n)
+  {
+    ids.push_back(crypto::rand<crypto::hash>());
+    cache.add(n, ids[n], make_header(n));
+  }
+  cryptonote::verified_header header;
+  ASSERT_EQ(cache.get_num_entries(), 3);
+  ASSERT_EQ(cache.get_size(), 3);
+  ASSERT_FALSE(cache.get(ids[0], header));
+  ASSERT_TRUE(cache.get(ids[3], header));
+}
+
+TEST(verified_header_cache, competing_headers_and_prune)
+{
+  cryptonote::verified_header_cache cache(100);
+  std::vector<crypto::hash> ids;
+  for (size_t n = 0; n < 10; ++n)
+  {
+    ids.push_back(crypto::rand<crypto::hash>());
+    cache.add(n, ids[n], make_header(n));
+  }
+
+  // a competing header at height 8 does not replace the other one
+  const crypto::hash alt = crypto::rand<crypto::hash>();
+  cache.add(8, alt, make_header(8));
+  cryptonote::verified_header header;
+  ASSERT_EQ(cache.get_num_entries(), 11);
+  ASSERT_TRUE(cache.get(ids[8], header));
+  ASSERT_TRUE(cache.get(alt, header));
+
+  // the chain reached height 3
+  cache.prune(3);
+  ASSERT_EQ(cache.get_num_entries(), 8);
+  ASSERT_FALSE(cache.get(ids[2], header));
+  ASSERT_TRUE(cache.get(ids[3], header));
+
+  // popping back to height 8 drops both headers there
+  cache.invalidate(8);
+  ASSERT_EQ(cache.get_num_entries(), 5);
+  ASSERT_FALSE(cache.get(alt, header));
+}